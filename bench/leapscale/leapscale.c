@@ -0,0 +1,73 @@
+/*
+ * Recording throughput: each thread increments its own global counter, so
+ * the threads share no variable and the recording should scale with their
+ * number. Run it with 1, 2, 4 and 8 threads and compare the accesses per ms.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#define MAX_THREADS 8
+#define ITERATIONS 1000000
+
+/* separate globals, so that they are separate shared variables, on separate
+ * cache lines, so that only the recorder can make the threads contend */
+#define COUNTER(N) volatile long counter##N __attribute__((aligned(64)))
+
+COUNTER(0);
+COUNTER(1);
+COUNTER(2);
+COUNTER(3);
+COUNTER(4);
+COUNTER(5);
+COUNTER(6);
+COUNTER(7);
+
+#define WORKER(N) \
+void * worker##N(void * arg) { \
+    int i; \
+    for (i = 0; i < ITERATIONS; i++) { \
+        counter##N++; \
+    } \
+    return NULL; \
+}
+
+WORKER(0)
+WORKER(1)
+WORKER(2)
+WORKER(3)
+WORKER(4)
+WORKER(5)
+WORKER(6)
+WORKER(7)
+
+void * (*workers[MAX_THREADS])(void *) = {
+    worker0, worker1, worker2, worker3, worker4, worker5, worker6, worker7
+};
+
+int main(int argc, char *argv[]) {
+    int num = argc > 1 ? atoi(argv[1]) : 4;
+    if (num < 1 || num > MAX_THREADS) {
+        printf("Usage: %s [1-%d]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    pthread_t threads[MAX_THREADS];
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    int i;
+    for (i = 0; i < num; i++) {
+        pthread_create(&threads[i], NULL, workers[i], NULL);
+    }
+    for (i = 0; i < num; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    gettimeofday(&end, NULL);
+    double ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+    /* a load and a store per increment */
+    printf("%d threads: %.0f ms, %.0f accesses per ms\n", num, ms, 2.0 * num * ITERATIONS / ms);
+    return 0;
+}
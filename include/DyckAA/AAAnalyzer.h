@@ -13,6 +13,10 @@
 #include "DyckAA/EdgeLabel.h"
 #include "DyckAA/DyckAliasAnalysis.h"
 #include "DyckAA/ProgressBar.h"
+#include "DyckAA/LibraryModel.h"
+#include "DyckAA/FieldPolicy.h"
+#include "DyckAA/ResourceBudget.h"
+#include "DyckAA/PointerRelevance.h"
 #include <map>
 #include <unordered_map>
 
@@ -39,6 +43,29 @@ private:
 
 	DyckAA::ProgressBar PB;
 
+	/// Library models, and the model of each external function in the module,
+	/// so that a library call is dispatched by a single lookup.
+	LibraryModelSet libModels;
+	unordered_map<Function*, const LibraryModel*> libModelMap;
+
+	/// Decides how precisely struct fields are modeled.
+	FieldSensitivity fieldSensitivity;
+
+	/// Values that cannot carry pointers get no vertices,
+	/// see -dyckaa-pointer-relevance.
+	PointerRelevance* relevance = nullptr;
+
+	/// -dyckaa-time-budget and -dyckaa-mem-budget. When a budget is nearly
+	/// used up, the analysis switches to cheaper but still sound strategies,
+	/// see checkBudget().
+	/// @{
+	DyckAA::ResourceBudget budget;
+	bool fieldsCollapsed = false;
+	bool classesCollapsed = false;
+	bool conservativePointerCalls = false;
+	vector<string> degradationReport;
+	/// @}
+
 public:
 	AAAnalyzer(Module* m, DyckAliasAnalysis* a, DyckGraph* d, DyckCallGraph* cg);
 	~AAAnalyzer();
@@ -76,6 +103,19 @@ private:
 	void destroyFunctionGroups();
 	void combineFunctionGroups(FunctionType * ft1, FunctionType* ft2);
 
+	void initLibraryModels();
+
+	bool isRelevant(Value* v) {
+		return !relevance || relevance->isRelevant(v);
+	}
+
+private:
+	void checkBudget();
+	void collapseFields();
+	void collapseLargestAliasClasses(unsigned num);
+	void mergeVertices(vector<pair<DyckVertex*, DyckVertex*>>& pairs);
+	void reportDegradation(const char* step, unsigned verticesBefore);
+
 private:
 	DyckVertex* addField(DyckVertex* val, long fieldIndex, DyckVertex* field);
 	DyckVertex* addPtrTo(DyckVertex* address, DyckVertex* val);
@@ -84,6 +124,15 @@ private:
 
 	DyckVertex* handle_gep(GEPOperator* gep);
 	DyckVertex* wrapValue(Value * v);
+
+	/// Large constant initializers, see -dyckaa-summarize-initializers.
+	/// @{
+	typedef map<vector<long>, set<Value*>> InitializerLayout;
+	DyckVertex* summarizeInitializer(Constant* init);
+	void collectInitializerLeaves(Constant* c, vector<long>& path, InitializerLayout& layout,
+			set<pair<Constant*, vector<long>>>& visited);
+	unsigned long numSummarizedElements = 0;
+	/// @}
 };
 
 #endif	/* AAANALYZER_H */
@@ -0,0 +1,106 @@
+/*
+ * Bounded field-sensitivity of the alias analysis.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef DYCKAA_FIELDPOLICY_H
+#define DYCKAA_FIELDPOLICY_H
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Module.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+/// How precisely the fields of a struct type are modeled. Every field
+/// the analysis touches costs a field vertex and a field pointer vertex,
+/// so the policies below trade precision for a smaller graph.
+typedef struct FieldPolicy {
+    /// All fields are merged into the struct itself.
+    bool Insensitive;
+
+    /// The fields of a struct type whose nesting depth (see
+    /// getNestingDepth) is above MaxDepth are merged. 0 means no limit.
+    unsigned MaxDepth;
+
+    /// Fields whose index is >= MaxFields share the last modeled field.
+    /// 0 means no limit.
+    unsigned MaxFields;
+
+    /// A struct type that (transitively) contains itself is modeled
+    /// field-insensitively.
+    bool CollapseRecursive;
+} FieldPolicy;
+
+/// Decides, per struct type, which field vertex a field access is modeled by.
+///
+/// The default policy comes from -dyckaa-field-insensitive,
+/// -dyckaa-max-field-depth, -dyckaa-max-fields and
+/// -dyckaa-collapse-recursive-types. Entries of -dyckaa-field-policy,
+/// written as <type-name-pattern>:<policy>, refine it for the struct types
+/// whose names match the pattern ('*' and '?' are wildcards), e.g.
+///
+///   -dyckaa-field-policy=struct.conn*:insensitive,class.std::*:fields=4
+///
+/// where <policy> is one of insensitive, sensitive, depth=N, fields=N and
+/// collapse-recursive. Matching entries are applied in order.
+class FieldSensitivity {
+private:
+    typedef struct PatternPolicy {
+        std::string Pattern;
+        std::string Policy;
+    } PatternPolicy;
+
+    FieldPolicy DefaultPolicy;
+    std::vector<PatternPolicy> PatternPolicies;
+
+    std::map<StructType*, FieldPolicy> PolicyCache;
+    std::map<StructType*, bool> RecursiveCache;
+    std::map<StructType*, unsigned> NestingDepths;
+
+    unsigned long NumCollapsedAccesses = 0;
+
+    /// Set when the analysis runs out of budget, see makeInsensitive().
+    bool ForcedInsensitive = false;
+
+public:
+    FieldSensitivity();
+
+    /// Computes the nesting depth of every struct type of M. It must be
+    /// called before the fields are modeled.
+    void collectNestingDepths(Module* M);
+
+    /// Returns the index of the field vertex that models field Idx of Ty.
+    /// Returns -1 if the field is merged into the struct itself. The result
+    /// only depends on Ty and Idx, so every access path to a field gets the
+    /// same vertex.
+    long getModeledFieldIndex(StructType* Ty, unsigned Idx);
+
+    /// Whether any option makes the analysis less than fully field-sensitive.
+    bool isBounded() const;
+
+    /// From now on, merge every field into its struct regardless of the
+    /// options. The caller is responsible for merging the fields modeled
+    /// so far, otherwise the analysis is unsound.
+    void makeInsensitive() {
+        ForcedInsensitive = true;
+    }
+
+    unsigned long getNumCollapsedAccesses() const {
+        return NumCollapsedAccesses;
+    }
+
+private:
+    const FieldPolicy& getPolicy(StructType* Ty);
+    bool isRecursive(StructType* Ty);
+    unsigned getNestingDepth(StructType* Ty);
+    static bool applyPolicy(FieldPolicy& P, const std::string& Policy);
+    static bool matchPattern(const char* Pattern, const char* Str);
+};
+
+#endif /* DYCKAA_FIELDPOLICY_H */
@@ -0,0 +1,90 @@
+/*
+ * Declarative models of external library functions.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef DYCKAA_LIBRARYMODEL_H
+#define DYCKAA_LIBRARYMODEL_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/// A LibraryModel describes the alias semantics of a function that has
+/// no body in the module, e.g. strcpy or pthread_create.
+///
+/// Models are written in a spec file, one function per line:
+///
+///   # name            #args  actions
+///   strcpy            2      content-alias(arg0, arg1) alias(ret, arg0)
+///   pthread_create    4      thread-spawn(arg2, arg3)
+///
+/// #args is the exact number of actual arguments the model applies to,
+/// or "*" for any. An operand is either "ret" or "argN". Actions are
+///   alias(a, b)          a and b point to the same memory
+///   content-alias(a, b)  what a points to is aliased with what b points to
+///   key-value(k, v)      v is stored under/loaded from key k (pthread_*specific)
+///   thread-spawn(f, x)   f is called with x as its only argument
+class LibraryModel {
+public:
+    enum ActionKind {
+        LMA_Alias,
+        LMA_ContentAlias,
+        LMA_KeyValue,
+        LMA_ThreadSpawn
+    };
+
+    /// Operand index of the return value; arguments use 0, 1, 2, ...
+    static const int RetOperand = -1;
+
+    typedef struct Action {
+        ActionKind Kind;
+        int First;
+        int Second;
+    } Action;
+
+    std::string Name;
+
+    /// -1 means the model applies to any number of arguments.
+    int NumArgs;
+
+    std::vector<Action> Actions;
+
+public:
+    LibraryModel(const std::string& N, int NA) : Name(N), NumArgs(NA) {
+    }
+};
+
+/// A set of library models indexed by function name. The built-in models
+/// cover the libc and pthread functions canary has always handled; a user
+/// spec file may add new models or override the built-in ones.
+class LibraryModelSet {
+private:
+    std::unordered_map<std::string, LibraryModel*> Models;
+
+public:
+    LibraryModelSet();
+    ~LibraryModelSet();
+
+    /// Load the built-in models.
+    void loadDefaults();
+
+    /// Load models from a spec file. Returns false if the file cannot be read
+    /// or is malformed; the reason is printed to errs().
+    bool loadFile(const std::string& FileName);
+
+    /// Returns nullptr if there is no model named Name.
+    const LibraryModel* lookup(const std::string& Name) const;
+
+    unsigned size() const {
+        return Models.size();
+    }
+
+private:
+    bool parse(const std::string& Text, const std::string& Source);
+    bool parseLine(const std::string& Line, const std::string& Source, unsigned LineNo);
+};
+
+#endif /* DYCKAA_LIBRARYMODEL_H */
@@ -0,0 +1,79 @@
+/*
+ * A pre-analysis that finds the values that may carry pointers.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef DYCKAA_POINTERRELEVANCE_H
+#define DYCKAA_POINTERRELEVANCE_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Constants.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+/// A value is pointer-relevant if the alias analysis needs a vertex for it.
+/// That is
+///   1. values whose type contains a pointer, and
+///   2. other values that are connected to 1 through the alias edges the
+///      analysis creates (casts such as ptrtoint/inttoptr, phi, select,
+///      aggregate and vector operations, call arguments and returns), and
+///   3. integers at least as wide as a pointer that are loaded, stored or
+///      passed where the analysis cannot see the other end (indirect calls,
+///      external functions, varargs), since they may carry a pointer through
+///      memory, together with everything connected to them.
+///
+/// Other values, e.g. loop counters, comparison results, floating-point
+/// data, labels and metadata, never change the alias relations of pointers
+/// and are skipped during constraint generation.
+class PointerRelevance {
+private:
+    unsigned PointerBits;
+
+    /// Relevant values whose types do not contain pointers.
+    std::set<Value*> Relevant;
+
+    /// Alias edges between values whose types do not contain pointers.
+    std::map<Value*, std::vector<Value*>> Links;
+
+    std::map<Function*, std::vector<Value*>> Returns;
+    std::set<Value*> VisitedConstants;
+    std::vector<Value*> Worklist;
+
+    /// Non-pointer values seen in the module, only for statistics.
+    std::set<Value*> Seen;
+    unsigned long NumIrrelevant = 0;
+
+    std::map<Type*, bool> HasPointerCache;
+
+public:
+    PointerRelevance(Module* M, unsigned PointerBits);
+
+    bool isRelevant(Value* V);
+
+    /// The number of values that will not get a vertex.
+    unsigned long getNumIrrelevant() const {
+        return NumIrrelevant;
+    }
+
+private:
+    bool hasPointer(Type* Ty);
+    bool mayCarryPointer(Type* Ty);
+
+    void link(Value* A, Value* B);
+    void seed(Value* V);
+    void seedIfCarrier(Value* V);
+    void note(Value* V);
+
+    void visitInstruction(Instruction* I, bool InAddressTakenFunction);
+    void visitCall(CallInst* CI);
+    void visitConstant(Constant* C);
+};
+
+#endif /* DYCKAA_POINTERRELEVANCE_H */
@@ -0,0 +1,44 @@
+/*
+ * Wall-clock and memory budgets of the alias analysis.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef DYCKAA_RESOURCEBUDGET_H
+#define DYCKAA_RESOURCEBUDGET_H
+
+#include <chrono>
+
+namespace DyckAA {
+
+class ResourceBudget {
+private:
+    /// in seconds, 0 means no budget
+    unsigned TimeBudget;
+
+    /// in MB, 0 means no budget
+    unsigned MemBudget;
+
+    std::chrono::steady_clock::time_point Start;
+
+public:
+    ResourceBudget(unsigned Seconds, unsigned MB);
+
+    bool isEnabled() const {
+        return TimeBudget || MemBudget;
+    }
+
+    /// The fraction of the tighter budget used so far, e.g. 0.5 if half
+    /// of the time budget has passed and less than half of the memory is used.
+    float getUsage() const;
+
+    double getElapsedSeconds() const;
+
+    /// The peak resident set size of the process.
+    unsigned long getPeakMemoryMB() const;
+};
+
+}
+
+#endif /* DYCKAA_RESOURCEBUDGET_H */
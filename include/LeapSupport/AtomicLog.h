@@ -0,0 +1,109 @@
+/*
+ * The values observed by the atomic operations (cmpxchg and atomicrmw) of
+ * each thread, in program order. An atomic operation is ordered by the memory
+ * itself, so it takes no lock and is not logged with the shared variables;
+ * each thread appends the value it observed to its own log. The replayer
+ * makes the thread wait until the memory holds that value again, so the
+ * operation has the same outcome. An operation that may hold an address is
+ * recorded like a store instead, as addresses differ between runs.
+ *
+ * The file is
+ *
+ *   unsigned <number of threads>
+ *   unsigned <number of values of each thread>...
+ *   unsigned long long <the values of thread 0>..., <the values of thread 1>..., ...
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPSUPPORT_ATOMICLOG_H
+#define LEAPSUPPORT_ATOMICLOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LEAP_ATOMIC_LOG_FILE "log.atomic.dat"
+
+typedef struct AtomicLog {
+    unsigned long long* values;
+    unsigned idx;
+    unsigned capacity;
+} AtomicLog;
+
+static inline void appendAtomic(AtomicLog* log, unsigned long long value) {
+    if (log->idx == log->capacity) {
+        log->capacity = log->capacity ? log->capacity * 2 : 1024;
+        log->values = (unsigned long long*) realloc(log->values, sizeof (unsigned long long) * log->capacity);
+        if (log->values == NULL) {
+            printf("Atomic log is too long to record!\n");
+            exit(1);
+        }
+    }
+    log->values[log->idx++] = value;
+}
+
+static inline void writeAtomicLogs(AtomicLog* logs, unsigned num) {
+    FILE* fout = fopen(LEAP_ATOMIC_LOG_FILE, "wb");
+    if (fout == NULL) {
+        printf("Cannot write the atomic log: %s!\n", LEAP_ATOMIC_LOG_FILE);
+        return;
+    }
+
+    fwrite(&num, sizeof (unsigned), 1, fout);
+    for (unsigned i = 0; i < num; i++) {
+        fwrite(&logs[i].idx, sizeof (unsigned), 1, fout);
+    }
+    for (unsigned i = 0; i < num; i++) {
+        fwrite(logs[i].values, sizeof (unsigned long long), logs[i].idx, fout);
+    }
+    fclose(fout);
+}
+
+/// the values of each thread are read into logs[t].values[0, capacity),
+/// and idx is where the replay is
+static inline bool readAtomicLogs(AtomicLog* logs, unsigned num) {
+    FILE* fin = fopen(LEAP_ATOMIC_LOG_FILE, "rb");
+    if (fin == NULL) {
+        return false;
+    }
+
+    unsigned recorded = 0;
+    if (fread(&recorded, sizeof (unsigned), 1, fin) != 1 || recorded > num) {
+        fclose(fin);
+        return false;
+    }
+
+    for (unsigned i = 0; i < recorded; i++) {
+        logs[i].idx = 0;
+        if (fread(&logs[i].capacity, sizeof (unsigned), 1, fin) != 1) {
+            fclose(fin);
+            return false;
+        }
+    }
+    for (unsigned i = 0; i < recorded; i++) {
+        logs[i].values = (unsigned long long*) malloc(sizeof (unsigned long long) * (logs[i].capacity + 1));
+        if (fread(logs[i].values, sizeof (unsigned long long), logs[i].capacity, fin) != logs[i].capacity) {
+            fclose(fin);
+            return false;
+        }
+    }
+    fclose(fin);
+    return true;
+}
+
+/// the value of size bytes at addr
+static inline unsigned long long loadAtomic(void* addr, int size) {
+    switch (size) {
+        case 1:
+            return __atomic_load_n((unsigned char*) addr, __ATOMIC_ACQUIRE);
+        case 2:
+            return __atomic_load_n((unsigned short*) addr, __ATOMIC_ACQUIRE);
+        case 4:
+            return __atomic_load_n((unsigned*) addr, __ATOMIC_ACQUIRE);
+        default:
+            return __atomic_load_n((unsigned long long*) addr, __ATOMIC_ACQUIRE);
+    }
+}
+
+#endif /* LEAPSUPPORT_ATOMICLOG_H */
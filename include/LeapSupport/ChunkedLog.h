@@ -0,0 +1,74 @@
+/*
+ * The chunks of the logs of the leap recorder. The log of each shared
+ * variable is cut into chunks of LEAP_CHUNK_LEN entries, which a background
+ * thread appends to log.replay.dat as blocks of a global log (CompactLog.h)
+ * as they fill up. The chunks of a shared variable are in order, but they are
+ * interleaved with the chunks of the others; the last ones are written at
+ * exit.
+ *
+ * The tsx and ticket recorders keep the log of each thread for each shared
+ * variable it accesses in LeapChunks, which start small and grow, see
+ * ThreadLogs.h.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPSUPPORT_CHUNKEDLOG_H
+#define LEAPSUPPORT_CHUNKEDLOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* entries of a chunk, even */
+#define LEAP_CHUNK_LEN (1 << 14)
+
+/* full chunks not written yet; recording threads wait for the writer
+ * beyond that, before they take a lock, so that the memory does not grow
+ * with the run */
+#define LEAP_MAX_PENDING_CHUNKS 1024
+
+/* The first chunk of a log that grows in chunks (LeapChunk); each chunk is
+ * twice as long as the one before, up to LEAP_CHUNK_LEN, so that a log of a
+ * few entries stays small and a long one is never copied. */
+#define LEAP_FIRST_CHUNK_LEN 16
+
+typedef struct LeapChunk {
+    struct LeapChunk* next;
+    unsigned len; // the entries used
+    unsigned capacity;
+    unsigned* entries; // right after the chunk
+} LeapChunk;
+
+/// appends a new chunk to a log whose last chunk is last, NULL if it has none
+static inline LeapChunk* growLeapChunks(LeapChunk* last) {
+    unsigned capacity = LEAP_FIRST_CHUNK_LEN;
+    if (last != NULL) {
+        capacity = last->capacity < LEAP_CHUNK_LEN / 2 ? last->capacity * 2 : LEAP_CHUNK_LEN;
+    }
+
+    LeapChunk* chunk = (LeapChunk*) malloc(sizeof (LeapChunk) + sizeof (unsigned) * capacity);
+    if (chunk == NULL) {
+        printf("Log is too long to record!\n");
+        exit(1);
+    }
+    chunk->next = NULL;
+    chunk->len = 0;
+    chunk->capacity = capacity;
+    chunk->entries = (unsigned*) (chunk + 1);
+
+    if (last != NULL) {
+        last->next = chunk;
+    }
+    return chunk;
+}
+
+static inline void freeLeapChunks(LeapChunk* first) {
+    while (first != NULL) {
+        LeapChunk* next = first->next;
+        free(first);
+        first = next;
+    }
+}
+
+#endif /* LEAPSUPPORT_CHUNKEDLOG_H */
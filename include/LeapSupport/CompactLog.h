@@ -0,0 +1,324 @@
+/*
+ * The compact log.replay.dat written by the leap recorders:
+ *
+ *   Sig ("leaplog")
+ *   LeapLogHeader
+ *   LeapLogBlock, payload
+ *   LeapLogBlock, payload
+ *   ...
+ *
+ * A block holds a piece of the log of a shared variable: the whole log of a
+ * thread (LEAP_LOG_LOCAL, the tsx and ticket recorders), or a chunk of the
+ * global log (LEAP_LOG_GLOBAL, the leap recorder, see ChunkedLog.h), whose
+ * chunks are in order. The entries are pairs, <thread id, number of
+ * consecutive accesses> or <first index, number of consecutive indices>, and
+ * are stored as varints; the indices of a local log are ascending and stored
+ * as the gap to the end of the previous pair. A payload may be compressed
+ * with the LZ77 compressor below, which needs no library.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPSUPPORT_COMPACTLOG_H
+#define LEAPSUPPORT_COMPACTLOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEAP_LOG_SIG "leaplog"
+#define LEAP_LOG_VERSION 1
+
+/* kinds of logs */
+#define LEAP_LOG_GLOBAL 0
+#define LEAP_LOG_LOCAL 1
+
+/* flags of LeapLogHeader */
+#define LEAP_LOG_COMPRESSED 1
+
+/* whether the recorders compress the blocks */
+#ifndef LEAP_LOG_COMPRESS
+#define LEAP_LOG_COMPRESS 1
+#endif
+
+typedef struct LeapLogHeader {
+    unsigned version;
+    unsigned kind;
+    unsigned numSharedVars;
+    unsigned numThreads;
+    unsigned flags;
+} LeapLogHeader;
+
+typedef struct LeapLogBlock {
+    int svId;
+    int thread; // the thread of a local log, from 1; 0 in a global log
+    unsigned count; // the number of entries
+    unsigned rawLen; // the bytes of the varints
+    unsigned storedLen; // the bytes of the payload, rawLen if it is not compressed
+} LeapLogBlock;
+
+static inline unsigned char* putVarint(unsigned char* out, unsigned value) {
+    while (value >= 0x80) {
+        *out++ = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char) value;
+    return out;
+}
+
+/// returns NULL if the varint does not end before end
+static inline const unsigned char* getVarint(const unsigned char* in, const unsigned char* end, unsigned* value) {
+    unsigned v = 0;
+    for (int shift = 0; in < end && shift < 35; shift += 7) {
+        unsigned char b = *in++;
+        v |= (unsigned) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return in;
+        }
+    }
+    return NULL;
+}
+
+/// out has room for 5 * count bytes; returns the bytes used
+static inline unsigned encodeEntries(const unsigned* entries, unsigned count, unsigned kind, unsigned char* out) {
+    unsigned char* p = out;
+    unsigned end = 0;
+    for (unsigned i = 0; i + 1 < count; i += 2) {
+        if (kind == LEAP_LOG_LOCAL) {
+            p = putVarint(p, entries[i] - end);
+            end = entries[i] + entries[i + 1];
+        } else {
+            p = putVarint(p, entries[i]);
+        }
+        p = putVarint(p, entries[i + 1]);
+    }
+    return p - out;
+}
+
+static inline bool decodeEntries(const unsigned char* in, unsigned len, unsigned kind, unsigned* entries, unsigned count) {
+    const unsigned char* end = in + len;
+    unsigned last = 0;
+    for (unsigned i = 0; i < count; i++) {
+        in = getVarint(in, end, &entries[i]);
+        if (in == NULL) {
+            return false;
+        }
+        if (kind == LEAP_LOG_LOCAL) {
+            if (i % 2 == 0) {
+                entries[i] += last;
+            } else {
+                last = entries[i - 1] + entries[i];
+            }
+        }
+    }
+    return in == end;
+}
+
+/* The compressed stream is a sequence of
+ *   0lllllll, l + 1 literal bytes
+ *   1lllllll, varint offset: copy l + 4 bytes from offset bytes back */
+#define LEAP_LZ_HASH_BITS 12
+#define LEAP_LZ_MIN_MATCH 4
+#define LEAP_LZ_MAX_MATCH (0x7f + LEAP_LZ_MIN_MATCH)
+#define LEAP_LZ_MAX_LITERALS 0x80
+
+static inline unsigned lzHash(const unsigned char* p) {
+    unsigned v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LEAP_LZ_HASH_BITS);
+}
+
+static inline unsigned char* lzLiterals(unsigned char* out, const unsigned char* from, unsigned num) {
+    while (num > 0) {
+        unsigned n = num < LEAP_LZ_MAX_LITERALS ? num : LEAP_LZ_MAX_LITERALS;
+        *out++ = (unsigned char) (n - 1);
+        memcpy(out, from, n);
+        out += n;
+        from += n;
+        num -= n;
+    }
+    return out;
+}
+
+/// the bytes of num literals
+static inline size_t lzLiteralsLen(size_t num) {
+    return num + (num + LEAP_LZ_MAX_LITERALS - 1) / LEAP_LZ_MAX_LITERALS;
+}
+
+/// returns the compressed length, or 0 if it would not be shorter than len;
+/// out has room for len bytes
+static inline unsigned compressBlock(const unsigned char* in, unsigned len, unsigned char* out) {
+    if (len < 2 * LEAP_LZ_MIN_MATCH) {
+        return 0;
+    }
+
+    const unsigned char** table = (const unsigned char**) calloc(1 << LEAP_LZ_HASH_BITS, sizeof (unsigned char*));
+    if (table == NULL) {
+        return 0;
+    }
+    unsigned char* oend = out + len;
+    unsigned char* op = out;
+    const unsigned char* ip = in;
+    const unsigned char* literals = in;
+    const unsigned char* end = in + len;
+    unsigned result = 0;
+
+    while (ip + LEAP_LZ_MIN_MATCH <= end) {
+        unsigned h = lzHash(ip);
+        const unsigned char* candidate = table[h];
+        table[h] = ip;
+        if (candidate == NULL || memcmp(candidate, ip, LEAP_LZ_MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+
+        unsigned matched = LEAP_LZ_MIN_MATCH;
+        while (matched < LEAP_LZ_MAX_MATCH && ip + matched < end && candidate[matched] == ip[matched]) {
+            matched++;
+        }
+
+        // the literals, the token and at most 5 bytes of the offset
+        if (lzLiteralsLen(ip - literals) + 6 >= (size_t) (oend - op)) {
+            free(table);
+            return 0;
+        }
+        op = lzLiterals(op, literals, ip - literals);
+        *op++ = (unsigned char) (0x80 | (matched - LEAP_LZ_MIN_MATCH));
+        op = putVarint(op, ip - candidate);
+        ip += matched;
+        literals = ip;
+    }
+
+    if (lzLiteralsLen(end - literals) < (size_t) (oend - op)) {
+        op = lzLiterals(op, literals, end - literals);
+        result = op - out;
+    }
+    free(table);
+    return result;
+}
+
+/// out has room for len bytes, which is the exact decompressed length
+static inline bool decompressBlock(const unsigned char* in, unsigned storedLen, unsigned char* out, unsigned len) {
+    const unsigned char* end = in + storedLen;
+    unsigned char* op = out;
+    unsigned char* oend = out + len;
+    while (in < end) {
+        unsigned char token = *in++;
+        if (!(token & 0x80)) {
+            unsigned n = token + 1;
+            if (n > (unsigned) (end - in) || n > (unsigned) (oend - op)) {
+                return false;
+            }
+            memcpy(op, in, n);
+            op += n;
+            in += n;
+        } else {
+            unsigned n = (token & 0x7f) + LEAP_LZ_MIN_MATCH;
+            unsigned offset = 0;
+            in = getVarint(in, end, &offset);
+            if (in == NULL || offset == 0 || offset > (unsigned) (op - out) || n > (unsigned) (oend - op)) {
+                return false;
+            }
+            // the source may overlap the destination
+            for (unsigned i = 0; i < n; i++, op++) {
+                *op = *(op - offset);
+            }
+        }
+    }
+    return op == oend;
+}
+
+static inline void writeLeapLogHeader(FILE* fout, unsigned kind, unsigned numSharedVars, unsigned numThreads) {
+    LeapLogHeader header;
+    header.version = LEAP_LOG_VERSION;
+    header.kind = kind;
+    header.numSharedVars = numSharedVars;
+    header.numThreads = numThreads;
+    header.flags = LEAP_LOG_COMPRESS ? LEAP_LOG_COMPRESSED : 0;
+    fwrite(&header, sizeof (LeapLogHeader), 1, fout);
+}
+
+/// entries are pairs; returns the bytes written
+static inline unsigned writeLeapLogBlock(FILE* fout, unsigned kind, int svId, int thread, const unsigned* entries, unsigned count) {
+    unsigned char* raw = (unsigned char*) malloc(5 * (size_t) count + 1);
+    unsigned char* packed = (unsigned char*) malloc(5 * (size_t) count + 1);
+    if (raw == NULL || packed == NULL) {
+        printf("Cannot allocate the buffer of a log block!\n");
+        exit(1);
+    }
+
+    LeapLogBlock block;
+    block.svId = svId;
+    block.thread = thread;
+    block.count = count;
+    block.rawLen = encodeEntries(entries, count, kind, raw);
+    block.storedLen = LEAP_LOG_COMPRESS ? compressBlock(raw, block.rawLen, packed) : 0;
+    if (block.storedLen == 0) {
+        block.storedLen = block.rawLen;
+    }
+
+    fwrite(&block, sizeof (LeapLogBlock), 1, fout);
+    fwrite(block.storedLen < block.rawLen ? packed : raw, 1, block.storedLen, fout);
+    free(raw);
+    free(packed);
+    return sizeof (LeapLogBlock) + block.storedLen;
+}
+
+static inline bool checkLeapLogBlock(const LeapLogBlock* block) {
+    return block->storedLen <= block->rawLen && block->rawLen <= 5 * (size_t) block->count && block->count % 2 == 0;
+}
+
+/// decodes the storedLen bytes of the payload of a block at in; entries has
+/// room for block->count entries. Returns false if the payload is corrupted.
+static inline bool decodeLeapLogBlock(const unsigned char* in, unsigned kind, const LeapLogBlock* block, unsigned* entries) {
+    if (block->storedLen == block->rawLen) {
+        return decodeEntries(in, block->rawLen, kind, entries, block->count);
+    }
+
+    unsigned char* raw = (unsigned char*) malloc(block->rawLen + 1);
+    if (raw == NULL) {
+        printf("Cannot allocate the buffer of a log block!\n");
+        exit(1);
+    }
+    bool decoded = decompressBlock(in, block->storedLen, raw, block->rawLen)
+            && decodeEntries(raw, block->rawLen, kind, entries, block->count);
+    free(raw);
+    return decoded;
+}
+
+/// reads the next block; *entries is allocated with malloc. Returns false at
+/// the end of the file or a truncated block, and exits on a corrupted one.
+static inline bool readLeapLogBlock(FILE* fin, unsigned kind, LeapLogBlock* block, unsigned** entries) {
+    if (fread(block, sizeof (LeapLogBlock), 1, fin) != 1) {
+        return false;
+    }
+    if (!checkLeapLogBlock(block)) {
+        printf("Bad block of the log!\n");
+        exit(1);
+    }
+
+    unsigned char* stored = (unsigned char*) malloc(block->storedLen + 1);
+    *entries = (unsigned*) malloc(sizeof (unsigned) * block->count + 1);
+    if (stored == NULL || *entries == NULL) {
+        printf("Cannot allocate the buffer of a log block!\n");
+        exit(1);
+    }
+
+    if (fread(stored, 1, block->storedLen, fin) != block->storedLen) {
+        // the recorder was killed while writing
+        free(stored);
+        free(*entries);
+        return false;
+    }
+    if (!decodeLeapLogBlock(stored, kind, block, *entries)) {
+        printf("Bad block of the log!\n");
+        exit(1);
+    }
+
+    free(stored);
+    return true;
+}
+
+#endif /* LEAPSUPPORT_COMPACTLOG_H */
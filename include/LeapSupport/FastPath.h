@@ -0,0 +1,53 @@
+/*
+ * The layout of the per-shared-variable records of the leap recorder, which
+ * the transformer reads and writes directly with -leap-inline-fast-path.
+ * Keep the struct, the field indices and the symbol names in sync; bump
+ * LEAP_FAST_PATH_VERSION on any change, so that a bitcode file transformed
+ * against an old layout fails to link instead of corrupting the log.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPSUPPORT_FASTPATH_H
+#define LEAPSUPPORT_FASTPATH_H
+
+#define LEAP_FAST_PATH_VERSION 2
+
+/* the size of a LeapVar, one cache line; the records of an array are this
+ * many bytes apart */
+#define LEAP_VAR_SIZE 64
+
+typedef struct LeapVar {
+    int lock; // 0 if free, 1 if held; acquired with cmpxchg, released with an atomic store
+    unsigned idx; // the first free slot of log
+    unsigned* log; // pairs of <thread id, number of consecutive accesses>
+    unsigned capacity; // the length of log
+    unsigned long long owned; // the owner thread and its accesses not logged
+                              // yet, see OnOwnerCheck; not used by the fast
+                              // path, which never records the shared
+                              // variables of owner checks
+} __attribute__((aligned(LEAP_VAR_SIZE))) LeapVar;
+
+/* field indices of LeapVar, in the transformer it is {i32, i32, i32*, i32}
+ * followed by the fields it does not use */
+#define LEAP_VAR_LOCK 0
+#define LEAP_VAR_IDX 1
+#define LEAP_VAR_LOG 2
+#define LEAP_VAR_CAPACITY 3
+
+/* LeapVar* , an array indexed by shared variable ids */
+#define LEAP_VARS_SYMBOL "__leap_vars"
+/* int, nonzero while recording */
+#define LEAP_RECORDING_SYMBOL "__leap_recording"
+/* thread local int, the id of the current thread, see ThreadStart.h */
+#define LEAP_TID_SYMBOL "__leap_tid"
+/* int, referenced by the inline fast path so that a layout mismatch fails to link */
+#define LEAP_VERSION_SYMBOL "__leap_fast_path_v2"
+
+/* int OnPreAccessSlow(int svId, int debug): called when the fast path cannot
+ * record the access (contention, full log). It returns 1 if it has taken the
+ * lock of the shared variable and 0 if nothing is recorded. */
+#define LEAP_SLOW_PATH_SYMBOL "OnPreAccessSlow"
+
+#endif /* LEAPSUPPORT_FASTPATH_H */
@@ -5,8 +5,17 @@
 
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-#define MAXNUMLOCKS 100
+#ifndef LEAP_CACHE_LINE
+#define LEAP_CACHE_LINE 64
+#endif
+
+/* a lock for each index up to this many; beyond it, the indices are hashed
+ * onto MAXNUMLOCKS stripes. Define LEAP_NO_LOCK_STRIPING to never stripe. */
+#ifndef MAXNUMLOCKS
+#define MAXNUMLOCKS (1 << 16)
+#endif
 
 inline void initialize(int lock_num);
 
@@ -14,44 +23,129 @@ inline void lock(int idx);
 
 inline void unlock(int idx);
 
+/// lock idx[0, num) in a deadlock-free order, each stripe once
+inline void lockall(const int* idx, int num);
+
+inline void unlockall(const int* idx, int num);
+
 inline void wait(int idx);
 
 inline void forklock(int idx);
 
 inline void forkunlock(int idx);
 
+/* the number of locks, and whether several indices share one */
+static int lock_stripes = 0;
+static bool lock_striped = false;
+
+inline int sizelocks(int lock_num) {
+    lock_striped = false;
+    lock_stripes = lock_num;
+#ifndef LEAP_NO_LOCK_STRIPING
+    if (lock_num > MAXNUMLOCKS) {
+        lock_striped = true;
+        lock_stripes = MAXNUMLOCKS;
+    }
+#endif
+    return lock_stripes;
+}
+
+inline int lockstripe(int idx) {
+    // ids are dense, so consecutive ones go to different stripes
+    return lock_striped ? (int) ((unsigned) idx % (unsigned) lock_stripes) : idx;
+}
+
+/// an array of num locks of the given size, each on its own cache lines
+inline void* allocatelocks(int num, size_t size) {
+    void* locks = NULL;
+    if (posix_memalign(&locks, LEAP_CACHE_LINE, num * size) != 0) {
+        printf("Cannot allocate %d locks!\n", num);
+        exit(1);
+    }
+    return locks;
+}
+
+inline void printlocks(int lock_num) {
+    if (lock_striped) {
+        printf("%d locks are hashed onto %d stripes\n", lock_num, lock_stripes);
+    } else {
+        printf("%d locks\n", lock_stripes);
+    }
+}
+
+/// the stripes of idx[0, num), ascending and distinct, each with an index
+/// locking it; returns their number
+inline int sortstripes(const int* idx, int num, int* stripes, int* reps) {
+    int n = 0;
+    for (int i = 0; i < num; i++) {
+        int s = lockstripe(idx[i]);
+        int pos = n;
+        while (pos > 0 && stripes[pos - 1] > s) {
+            pos--;
+        }
+        if (pos > 0 && stripes[pos - 1] == s) {
+            continue;
+        }
+        for (int k = n; k > pos; k--) {
+            stripes[k] = stripes[k - 1];
+            reps[k] = reps[k - 1];
+        }
+        stripes[pos] = s;
+        reps[pos] = idx[i];
+        n++;
+    }
+    return n;
+}
+
+inline void lockall(const int* idx, int num) {
+    int stripes[num], reps[num];
+    int n = sortstripes(idx, num, stripes, reps);
+    for (int i = 0; i < n; i++) {
+        lock(reps[i]);
+    }
+}
+
+inline void unlockall(const int* idx, int num) {
+    int stripes[num], reps[num];
+    int n = sortstripes(idx, num, stripes, reps);
+    for (int i = n - 1; i >= 0; i--) {
+        unlock(reps[i]);
+    }
+}
+
 #ifdef HLE_ENABLED
 #include <immintrin.h>
 
-int * LOCKS;
+typedef struct {
+    int word;
+} __attribute__((aligned(LEAP_CACHE_LINE))) padded_lock;
+
+padded_lock * LOCKS;
 pthread_mutex_t forkmutex;
 
 inline void initialize(int lock_num) {
-    if (lock_num > MAXNUMLOCKS) {
-        printf("Too many locks!\n");
-        exit(1);
-    }
-    
-    LOCKS = new int[lock_num];
-    for (int i = 0; i < lock_num; i++) {
-        LOCKS[i] = 0;
+    int num = sizelocks(lock_num);
+    LOCKS = (padded_lock*) allocatelocks(num, sizeof (padded_lock));
+    for (int i = 0; i < num; i++) {
+        LOCKS[i].word = 0;
     }
     pthread_mutex_init(&forkmutex, NULL);
 }
 
 inline void lock(int idx) {
-    while (__atomic_exchange_n(&LOCKS[idx], 1, __ATOMIC_ACQUIRE | __ATOMIC_HLE_ACQUIRE) != 0) {
+    int* word = &LOCKS[lockstripe(idx)].word;
+    while (__atomic_exchange_n(word, 1, __ATOMIC_ACQUIRE | __ATOMIC_HLE_ACQUIRE) != 0) {
         int val = 0;
         /* Wait for lock to become free again before retrying. */
         do {
             _mm_pause(); /* Abort speculation */
-            __atomic_load(&LOCKS[idx], &val, __ATOMIC_CONSUME);
+            __atomic_load(word, &val, __ATOMIC_CONSUME);
         } while (val == 1);
     }
 }
 
 inline void unlock(int idx) {
-    __atomic_clear(&LOCKS[idx], __ATOMIC_RELEASE | __ATOMIC_HLE_RELEASE);
+    __atomic_clear(&LOCKS[lockstripe(idx)].word, __ATOMIC_RELEASE | __ATOMIC_HLE_RELEASE);
 }
 
 inline void forklock(int idx) {
@@ -72,35 +166,36 @@ inline void wait(int idx) {
 #ifdef EXCH_ENABLED
 #include <immintrin.h>
 
-int * LOCKS;
+typedef struct {
+    int word;
+} __attribute__((aligned(LEAP_CACHE_LINE))) padded_lock;
+
+padded_lock * LOCKS;
 pthread_mutex_t forkmutex;
 
 inline void initialize(int lock_num) {
-    if (lock_num > MAXNUMLOCKS) {
-        printf("Too many locks!\n");
-        exit(1);
-    }
-    
-    LOCKS = new int[lock_num];
-    for (int i = 0; i < lock_num; i++) {
-        LOCKS[i] = 0;
+    int num = sizelocks(lock_num);
+    LOCKS = (padded_lock*) allocatelocks(num, sizeof (padded_lock));
+    for (int i = 0; i < num; i++) {
+        LOCKS[i].word = 0;
     }
     pthread_mutex_init(&forkmutex, NULL);
 }
 
 inline void lock(int idx) {
-    while (__atomic_exchange_n(&LOCKS[idx], 1, __ATOMIC_ACQUIRE) != 0) {
+    int* word = &LOCKS[lockstripe(idx)].word;
+    while (__atomic_exchange_n(word, 1, __ATOMIC_ACQUIRE) != 0) {
         int val = 0;
         /* Wait for lock to become free again before retrying. */
         do {
             _mm_pause(); /* Abort speculation */
-            __atomic_load(&LOCKS[idx], &val, __ATOMIC_CONSUME);
+            __atomic_load(word, &val, __ATOMIC_CONSUME);
         } while (val == 1);
     }
 }
 
 inline void unlock(int idx) {
-    __atomic_clear(&LOCKS[idx], __ATOMIC_RELEASE);
+    __atomic_clear(&LOCKS[lockstripe(idx)].word, __ATOMIC_RELEASE);
 }
 
 inline void forklock(int idx) {
@@ -122,10 +217,7 @@ inline void wait(int idx) {
 pthread_mutex_t forkmutex;
 
 inline void initialize(int lock_num) {
-    if (lock_num > MAXNUMLOCKS) {
-        printf("Too many locks!\n");
-        exit(1);
-    }
+    sizelocks(lock_num);
     pthread_mutex_init(&forkmutex, NULL);
 }
 
@@ -161,33 +253,36 @@ inline void forkunlock(int idx) {
 #include <sys/time.h>
 
 
-pthread_mutex_t LOCKS[MAXNUMLOCKS];
-pthread_cond_t conditions[MAXNUMLOCKS];
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+} __attribute__((aligned(LEAP_CACHE_LINE))) padded_mutex;
 
-inline void initialize(int lock_num) {
-    if (lock_num > MAXNUMLOCKS) {
-        printf("Too many locks!\n");
-        exit(1);
-    }
+padded_mutex * LOCKS;
 
-    for (int i = 0; i < lock_num; i++) {
-        pthread_mutex_init(&LOCKS[i], NULL);
+inline void initialize(int lock_num) {
+    int num = sizelocks(lock_num);
+    LOCKS = (padded_mutex*) allocatelocks(num, sizeof (padded_mutex));
+    for (int i = 0; i < num; i++) {
+        pthread_mutex_init(&LOCKS[i].mutex, NULL);
+        pthread_cond_init(&LOCKS[i].condition, NULL);
     }
 }
 
 inline void lock(int idx) {
-    pthread_mutex_lock(&LOCKS[idx]);
+    pthread_mutex_lock(&LOCKS[lockstripe(idx)].mutex);
 }
 
 inline void unlock(int idx) {
-    pthread_mutex_unlock(&LOCKS[idx]);
+    pthread_mutex_unlock(&LOCKS[lockstripe(idx)].mutex);
 }
 
 inline void wait(int idx) {
+    padded_mutex& m = LOCKS[lockstripe(idx)];
     struct timespec tv;
     tv.tv_sec = time(0);
     tv.tv_nsec = 100000000; //100ms
-    pthread_cond_timedwait(&conditions[idx], &LOCKS[idx], &tv);
+    pthread_cond_timedwait(&m.condition, &m.mutex, &tv);
 }
 
 inline void forklock(int idx) {
@@ -220,7 +315,7 @@ inline void forkunlock(int idx) {
 typedef struct {
     pthread_mutex_t posix_mutex;
     short elision;
-} rtm_enabled_mutex;
+} __attribute__((aligned(LEAP_CACHE_LINE))) rtm_enabled_mutex;
 
 struct elision_config {
     int skip_lock_busy;
@@ -229,26 +324,25 @@ struct elision_config {
     int skip_trylock_internal_abort;
 } aconf;
 
-rtm_enabled_mutex LOCKS[MAXNUMLOCKS];
+rtm_enabled_mutex * LOCKS;
 
 inline void initialize(int lock_num) {
-    if (lock_num > MAXNUMLOCKS) {
-        printf("Too many locks!\n");
-        exit(1);
-    }
+    int num = sizelocks(lock_num);
+    LOCKS = (rtm_enabled_mutex*) allocatelocks(num, sizeof (rtm_enabled_mutex));
 
     aconf.skip_lock_busy = 3;
     aconf.skip_lock_internal_abort = 3;
     aconf.retry_try_xbegin = 3;
     aconf.skip_trylock_internal_abort = 3;
 
-    for (int i = 0; i < lock_num; i++) {
+    for (int i = 0; i < num; i++) {
         pthread_mutex_init(&(LOCKS[i].posix_mutex), NULL);
         LOCKS[i].elision = 0;
     }
 }
 
 inline void lock(int idx) {
+    idx = lockstripe(idx);
     if (LOCKS[idx].elision <= 0) {
         unsigned status;
         int try_xbegin;
@@ -287,6 +381,7 @@ inline void lock(int idx) {
 }
 
 inline void unlock(int idx) {
+    idx = lockstripe(idx);
     /* If lock is free, assume that the lock was elided */
     if (LOCKS[idx].posix_mutex.__data.__lock == 0)
         _xend(); /* commit */
@@ -301,11 +396,11 @@ inline void wait(int idx) {
 }
 
 inline void forklock(int idx) {
-    pthread_mutex_lock(&(LOCKS[idx].posix_mutex));
+    pthread_mutex_lock(&(LOCKS[lockstripe(idx)].posix_mutex));
 }
 
 inline void forkunlock(int idx) {
-    pthread_mutex_unlock(&(LOCKS[idx].posix_mutex));
+    pthread_mutex_unlock(&(LOCKS[lockstripe(idx)].posix_mutex));
 }
 #endif
 
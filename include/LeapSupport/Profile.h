@@ -0,0 +1,22 @@
+/*
+ * The profile written by the leap profiler and read by the transformer with
+ * -leap-profile. It is a text file:
+ *
+ *   leap-profile <version> <number of shared variables>
+ *   var <svId> <accesses> <owner changes>
+ *   site <debug index> <executions>
+ *
+ * An owner change is an access to a shared variable by a thread other than
+ * the one that accessed it last.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPSUPPORT_PROFILE_H
+#define LEAPSUPPORT_PROFILE_H
+
+#define LEAP_PROFILE_VERSION 1
+#define LEAP_PROFILE_FILE "leap.profile"
+
+#endif /* LEAPSUPPORT_PROFILE_H */
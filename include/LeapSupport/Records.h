@@ -0,0 +1,35 @@
+/*
+ * The per-shared-variable records of the recorders. A record takes whole
+ * cache lines, so that threads recording unrelated shared variables do not
+ * write to the same line. The records are mapped, not initialized: the pages
+ * are zero, and each is placed on the NUMA node of the thread that touches it
+ * first rather than on the node of the thread running OnInit. Placement is
+ * per page, not per record: the records on a page (64 of 64 bytes in a 4 KB
+ * page) are on the node of whichever thread recorded into one of them first.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPSUPPORT_RECORDS_H
+#define LEAPSUPPORT_RECORDS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#ifndef LEAP_CACHE_LINE
+#define LEAP_CACHE_LINE 64
+#endif
+
+/// num zeroed records of the given size
+static inline void* allocateRecords(int num, size_t size) {
+    void* records = mmap(NULL, num * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (records == MAP_FAILED) {
+        printf("Cannot allocate the records of %d shared variables!\n", num);
+        exit(1);
+    }
+    return records;
+}
+
+#endif /* LEAPSUPPORT_RECORDS_H */
@@ -0,0 +1,141 @@
+/*
+ * The logs of a thread in the recorders that order the events of a shared
+ * variable by index (the tsx and ticket recorders, local logs in
+ * CompactLog.h): for each shared variable the thread accessed, pairs of
+ * <first index, number of consecutive indices> in LeapChunks (ChunkedLog.h).
+ * The logs are kept in an open addressing table, so a thread only takes
+ * memory for the shared variables it accesses. Only the thread appends to
+ * its logs.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPSUPPORT_THREADLOGS_H
+#define LEAPSUPPORT_THREADLOGS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "LeapSupport/ChunkedLog.h"
+#include "LeapSupport/CompactLog.h"
+
+/* the slots of the table of a thread at its first event, a power of 2 */
+#define LEAP_FIRST_THREAD_LOGS 16
+
+// the log of a thread for a shared variable
+typedef struct LeapThreadLog {
+    int svId; // -1 if the slot is free
+    LeapChunk* first;
+    LeapChunk* last;
+} LeapThreadLog;
+
+typedef struct LeapThreadLogs {
+    LeapThreadLog* slots;
+    unsigned num; // the slots used, at most half of them
+    unsigned capacity; // a power of 2
+    LeapThreadLog* recent; // the log of the last event
+} LeapThreadLogs;
+
+static inline LeapThreadLog* allocateThreadLogSlots(unsigned capacity) {
+    LeapThreadLog* slots = (LeapThreadLog*) malloc(sizeof (LeapThreadLog) * capacity);
+    if (slots == NULL) {
+        printf("Cannot allocate the logs of a thread!\n");
+        exit(1);
+    }
+    for (unsigned i = 0; i < capacity; i++) {
+        slots[i].svId = -1;
+        slots[i].first = NULL;
+        slots[i].last = NULL;
+    }
+    return slots;
+}
+
+/// the slot of the log of svId, or the free slot it goes to
+static inline LeapThreadLog* findThreadLog(LeapThreadLog* slots, unsigned capacity, int svId) {
+    unsigned i = ((unsigned) svId * 2654435761u) & (capacity - 1);
+    while (slots[i].svId != svId && slots[i].svId != -1) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &slots[i];
+}
+
+static inline void initThreadLogs(LeapThreadLogs* logs) {
+    logs->slots = allocateThreadLogSlots(LEAP_FIRST_THREAD_LOGS);
+    logs->num = 0;
+    logs->capacity = LEAP_FIRST_THREAD_LOGS;
+    logs->recent = NULL;
+}
+
+/// the log of a shared variable, created when the thread first accesses it
+static inline LeapThreadLog* getThreadLog(LeapThreadLogs* logs, int svId) {
+    if (logs->recent != NULL && logs->recent->svId == svId) {
+        return logs->recent;
+    }
+
+    LeapThreadLog* log = findThreadLog(logs->slots, logs->capacity, svId);
+    if (log->svId == -1) {
+        if (2 * (logs->num + 1) > logs->capacity) {
+            unsigned capacity = logs->capacity * 2;
+            LeapThreadLog* slots = allocateThreadLogSlots(capacity);
+            for (unsigned i = 0; i < logs->capacity; i++) {
+                if (logs->slots[i].svId != -1) {
+                    *findThreadLog(slots, capacity, logs->slots[i].svId) = logs->slots[i];
+                }
+            }
+            free(logs->slots);
+            logs->slots = slots;
+            logs->capacity = capacity;
+            log = findThreadLog(slots, capacity, svId);
+        }
+        log->svId = svId;
+        logs->num++;
+    }
+    logs->recent = log;
+    return log;
+}
+
+/// appends the event of the given index of a shared variable
+static inline void appendThreadLog(LeapThreadLogs* logs, int svId, unsigned index) {
+    LeapThreadLog* log = getThreadLog(logs, svId);
+    LeapChunk* last = log->last;
+
+    if (last != NULL && last->entries[last->len - 1] + last->entries[last->len - 2] == index) {
+        last->entries[last->len - 1]++;
+        return;
+    }
+
+    if (last == NULL || last->len + 2 > last->capacity) {
+        last = growLeapChunks(last);
+        if (log->first == NULL) {
+            log->first = last;
+        }
+        log->last = last;
+    }
+
+    last->entries[last->len] = index;
+    last->entries[last->len + 1] = 1;
+    last->len += 2;
+}
+
+/// writes the logs of thread tid, each chunk as a block
+static inline void writeThreadLogs(FILE* f, const LeapThreadLogs* logs, int tid) {
+    for (unsigned i = 0; i < logs->capacity; i++) {
+        const LeapThreadLog& log = logs->slots[i];
+        for (LeapChunk* chunk = log.first; log.svId != -1 && chunk != NULL; chunk = chunk->next) {
+            writeLeapLogBlock(f, LEAP_LOG_LOCAL, log.svId, tid, chunk->entries, chunk->len);
+        }
+    }
+}
+
+static inline void freeThreadLogs(LeapThreadLogs* logs) {
+    for (unsigned i = 0; i < logs->capacity; i++) {
+        freeLeapChunks(logs->slots[i].first);
+    }
+    free(logs->slots);
+    logs->slots = NULL;
+    logs->num = 0;
+    logs->capacity = 0;
+    logs->recent = NULL;
+}
+
+#endif /* LEAPSUPPORT_THREADLOGS_H */
@@ -0,0 +1,68 @@
+/*
+ * The pseudo ids of the threads of the leap runtimes. The transformer calls
+ * __leap_pthread_create instead of pthread_create; each runtime defines it
+ * with createThread below, giving the new thread the next id. The call is
+ * between OnPreFork and OnFork, which order the forks, so a thread gets the
+ * same id when it is recorded and when it is replayed. The new thread keeps
+ * its id in __leap_tid before it runs its start routine, and a hook reads it
+ * with threadid(), one thread-local load.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPSUPPORT_THREADSTART_H
+#define LEAPSUPPORT_THREADSTART_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+extern "C" {
+    // the id of the current thread, from 1; 0 in the threads not created by
+    // the program, e.g. the log writer
+    __thread int __leap_tid = 0;
+}
+
+typedef struct LeapThreadStart {
+    void* (*routine)(void*);
+    void* arg;
+    int tid;
+} LeapThreadStart;
+
+static void* startThread(void* start) {
+    LeapThreadStart s = *((LeapThreadStart*) start);
+    free(start);
+
+    __leap_tid = s.tid;
+    return s.routine(s.arg);
+}
+
+/// pthread_create, starting the thread with the id tid
+static inline int createThread(pthread_t* thread, const pthread_attr_t* attr, void* (*routine)(void*), void* arg, int tid) {
+    LeapThreadStart* start = (LeapThreadStart*) malloc(sizeof (LeapThreadStart));
+    if (start == NULL) {
+        printf("Cannot allocate the start of a thread!\n");
+        exit(1);
+    }
+    start->routine = routine;
+    start->arg = arg;
+    start->tid = tid;
+
+    int ret = pthread_create(thread, attr, startThread, start);
+    if (ret != 0) {
+        free(start);
+    }
+    return ret;
+}
+
+int static inline threadid() {
+    int tid = __leap_tid;
+    if (tid == 0) {
+        printf("A thread not created by the transformed program runs its code!\n");
+        exit(1);
+    }
+    return tid;
+}
+
+#endif /* LEAPSUPPORT_THREADSTART_H */
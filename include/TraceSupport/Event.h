@@ -19,6 +19,7 @@ typedef struct Event {
     int eid;
     pthread_t tid; //unsigned long int %lu
     long mem;
+    long size; // the bytes of a memcpy, memmove or memset, 0 for others
     int type;
     long line;
     int * locks;
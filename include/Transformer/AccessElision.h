@@ -0,0 +1,76 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef ACCESSELISION_H
+#define	ACCESSELISION_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Transformer/TransformerUtils.h"
+
+#include <functional>
+#include <map>
+#include <set>
+
+using namespace std;
+using namespace llvm;
+
+/// Finds the loads and stores of shared variables whose recording is
+/// redundant: an earlier recorded access to the same shared variable reaches
+/// them on every path, and no synchronization, atomic operation or call that
+/// may synchronize lies in between. Only the earlier one is logged.
+///
+/// This is a trade-off, not a soundness argument: another thread may still
+/// access the shared variable between the two accesses, racing with them.
+/// Its access is recorded, but the elided access is not, so the replay does
+/// not order it against the racing one, and such a race may not be
+/// reproduced. Programs whose shared accesses between synchronizations are
+/// race-free replay as recorded.
+///
+/// A load is redundant after any access to its shared variable, and a store
+/// only after a store, so that the first write of a sequence is always logged.
+class AccessElision {
+private:
+    IndexFunction getIndex;
+
+    set<Instruction*> redundant;
+
+    /// function -> (#access sites, #redundant sites)
+    map<Function*, pair<unsigned, unsigned> > stats;
+
+public:
+    AccessElision(const IndexFunction& indexFunc) : getIndex(indexFunc) {
+    }
+
+    /// must be called before any instrumentation is inserted into f
+    void analyze(Function* f);
+
+    bool isRedundant(Instruction* inst) const {
+        return redundant.count(inst);
+    }
+
+    /// prints the number of removed sites of the analyzed functions in module order
+    void printReport(Module* module, raw_ostream& os) const;
+
+    /// whether the instruction may order the thread with others
+    static bool isBarrier(Instruction* inst);
+
+private:
+    /// the state of a block: shared variables accessed/written since the last barrier
+    struct State {
+        bool top; // all, before the block is visited
+        set<int> accessed;
+        set<int> written;
+
+        State() : top(true) {
+        }
+    };
+
+    void meet(State& to, const State& from) const;
+    void transfer(BasicBlock* bb, State& state, bool collect);
+};
+
+#endif	/* ACCESSELISION_H */
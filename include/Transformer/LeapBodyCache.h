@@ -0,0 +1,51 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPBODYCACHE_H
+#define	LEAPBODYCACHE_H
+
+#include "llvm/IR/Module.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+using namespace std;
+using namespace llvm;
+
+/// The instrumented bodies of the functions of the last build, in a bitcode
+/// file next to the id file (see LeapIds). A function that LeapIds finds
+/// unchanged is not instrumented again: its body is replaced by the cached
+/// one. The file has the cached functions as external definitions, the
+/// constants they use, and declarations of everything else they refer to,
+/// which the linker resolves to the values of the module.
+class LeapBodyCache {
+private:
+    std::unique_ptr<Module> cache; // NULL if there is no cache
+    set<string> reused; // the functions whose cached bodies are restored
+
+public:
+    /// a missing or unreadable file is an empty cache
+    void load(const string& file, LLVMContext& context);
+
+    /// whether the cache has a body of f
+    bool has(Function* f) const;
+
+    /// f is not instrumented, and gets its cached body in restore
+    void reuse(Function* f);
+
+    /// replaces the bodies of the reused functions by the cached ones
+    bool restore(Module* module, string& error);
+
+    unsigned getNumReused() const {
+        return reused.size();
+    }
+
+    /// writes the instrumented bodies of the named functions of module
+    static bool save(Module* module, const set<string>& functions, const string& file, string& error);
+};
+
+#endif	/* LEAPBODYCACHE_H */
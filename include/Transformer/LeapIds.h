@@ -0,0 +1,123 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPIDS_H
+#define	LEAPIDS_H
+
+#include "llvm/IR/Module.h"
+#include "Transformer/TransformerUtils.h"
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace llvm;
+
+/// The ids of shared variables and the debug indices of instrumented sites,
+/// kept from one instrumentation of a program to the next in an id file, so
+/// that the logs of an old build stay replayable after a change that does not
+/// touch shared accesses. It is a text file:
+///
+///   leap-ids <version> <number of shared variable ids> <number of debug indices>
+///   sv <id> <key of a value in the shared variable>
+///   func <hash> <decisions> <first debug index> <number of debug indices> <name>
+///
+/// A value is keyed by the name of a global, or by its function and position
+/// in the function. A shared variable keeps the id most of its recorded keys
+/// had; the others get new ids, and ids are not reused until the file is
+/// compacted.
+///
+/// A function is hashed over its instructions, without debug locations, and
+/// the ids of the shared variables they use. An unchanged function keeps its
+/// range of debug indices; a changed one gets a new range. A range has room
+/// for every site the function could instrument, so whole-program decisions
+/// (e.g. lockset elision) may change without moving it. The decisions are
+/// hashed too: a function whose decisions did not change either is
+/// instrumented as in the last build (see LeapBodyCache).
+///
+/// Compacting renumbers the shared variables without the retired ids and
+/// packs the ranges of debug indices, so logs and instrumented bodies of
+/// older builds are not valid any more.
+class LeapIds {
+private:
+    struct Range {
+        unsigned long long hash;
+        unsigned long long decisions; // 0 if not known
+        unsigned base;
+        unsigned size;
+    };
+
+    struct FunctionIds {
+        string name;
+        Range range;
+        bool unchanged; // the same range and decisions as in the last build
+    };
+
+    map<string, int> oldKeys; // key -> shared variable id
+    map<string, Range> oldFunctions;
+    unsigned numOldIds, numOldDebugIndices;
+
+    vector<set<string> > keys; // id -> keys
+    vector<FunctionIds> functions; // in module order, by name since bodies may be replaced
+    map<Function*, unsigned> functionIndex;
+    unsigned numDebugIndices;
+    unsigned numChangedFunctions;
+    unsigned numRetiredIds;
+
+    bool compact;
+
+public:
+    /// with compact, retired ids and unused debug indices are dropped
+    LeapIds(bool compact);
+
+    /// returns false and sets error if the file cannot be parsed; a missing
+    /// file is an empty one
+    bool load(const string& file, string& error);
+
+    bool save(const string& file) const;
+
+    /// reorders svs (and rebuilds index) so that the position of a shared
+    /// variable is its id; ids not used any more get empty sets
+    void assignSharedVariables(Module* module, vector<const set<Value*>*>& svs, unordered_map<const Value*, int>& index);
+
+    /// must run before any function is instrumented; getDecisions hashes the
+    /// whole-program decisions its instrumentation depends on
+    void assignFunctions(Module* module, const std::function<bool(Function*)>& toTransform, const IndexFunction& getIndex,
+            const std::function<unsigned long long(Function*)>& getDecisions);
+
+    /// the first debug index of a function from assignFunctions
+    unsigned getDebugBase(Function* f) const;
+
+    /// whether a function has the instructions, shared variable ids, debug
+    /// indices and decisions it had in the last build
+    bool isUnchanged(Function* f) const;
+
+    unsigned getNumChangedFunctions() const {
+        return numChangedFunctions;
+    }
+
+    unsigned getNumFunctions() const {
+        return functions.size();
+    }
+
+    /// ids of shared variables no value has any more
+    unsigned getNumRetiredIds() const {
+        return numRetiredIds;
+    }
+
+    /// debug indices of ranges no function has any more
+    unsigned getNumUnusedDebugIndices() const;
+
+private:
+    static void getKeys(Module* module, unordered_map<const Value*, string>& valueKeys);
+    static unsigned long long hashFunction(Function* f, const IndexFunction& getIndex);
+    static unsigned getMaxSites(Function* f);
+};
+
+#endif	/* LEAPIDS_H */
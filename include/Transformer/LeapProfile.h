@@ -0,0 +1,69 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LEAPPROFILE_H
+#define	LEAPPROFILE_H
+
+#include "llvm/IR/Instructions.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace llvm;
+
+/// The profile of a run of the program with the leap profiler (see
+/// LeapSupport/Profile.h), and the instrumentation decisions derived from it.
+/// A shared variable whose owner thread never changed during the run is
+/// single-owner: its loads and stores only check the owner at runtime, and
+/// are logged only if another thread shows up.
+class LeapProfile {
+private:
+    unsigned numSharedVariables;
+
+    /// shared variable -> <accesses, owner changes>
+    map<int, pair<unsigned long, unsigned long> > vars;
+
+    /// debug index -> executions
+    map<int, unsigned long> sites;
+
+    struct Site {
+        int debugIdx;
+        string location;
+    };
+
+    /// shared variable -> its sites that only check the owner
+    map<int, vector<Site> > ownerCheckedSites;
+
+    /// the number of sites of the other shared variables
+    unsigned numRecordedSites;
+
+public:
+    LeapProfile() : numSharedVariables(0), numRecordedSites(0) {
+    }
+
+    /// returns false and sets error if the file cannot be read or does not
+    /// match the shared variables of the module
+    bool load(const string& file, unsigned numSharedVariables, string& error);
+
+    bool isSingleOwner(int svIdx) const;
+
+    void noteOwnerCheck(int svIdx, int debugIdx, Instruction* inst);
+
+    void noteRecorded() {
+        numRecordedSites++;
+    }
+
+    /// lists the decisions for each shared variable and the single-owner
+    /// sites grouped by shared variable, hottest first; a site is hot if it
+    /// ran at least hotCount times
+    bool writeReport(const string& file, unsigned long hotCount) const;
+
+private:
+    unsigned long getSiteCount(int debugIdx) const;
+};
+
+#endif	/* LEAPPROFILE_H */
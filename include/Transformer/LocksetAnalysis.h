@@ -0,0 +1,90 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef LOCKSETANALYSIS_H
+#define	LOCKSETANALYSIS_H
+
+#include "DyckAA/DyckAliasAnalysis.h"
+#include "Transformer/TransformerUtils.h"
+
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace std;
+using namespace llvm;
+
+/// A static lockset analysis. A lock is the shared variable (DyckAA alias
+/// class) of the mutexes passed to pthread_mutex_lock; it is only used if the
+/// class contains a single global mutex, since holding one of several mutexes
+/// of a class does not exclude the others.
+///
+/// The locks held at each point are computed by a must-dataflow analysis in
+/// each function, where the locks held at the entry of a function are those
+/// held at all its call sites. A shared variable is protected by a lock if
+/// the lock is held at all its accesses. The order of the accesses is then
+/// implied by the order in which the lock is acquired, and they need not be
+/// recorded.
+class LocksetAnalysis {
+public:
+    /// accesses that need no ordering, e.g. the single-threaded ones
+    typedef std::function<bool(Instruction*)> IgnoreFunction;
+
+private:
+    IndexFunction getIndex;
+    IgnoreFunction isIgnored;
+    const vector<const set<Value*>*>& sharedVariables;
+    DyckCallGraph* callGraph; // NULL if not preserved
+
+    /// the locks held, all of them if top
+    struct Lockset {
+        bool top;
+        set<int> held;
+
+        Lockset() : top(true) {
+        }
+    };
+
+    map<Function*, Lockset> entries;
+    set<Function*> roots; // functions that may be called without any lock
+
+    /// the locks a function may release, all of them if mayUnlockAll
+    map<Function*, set<int> > unlocks;
+    set<Function*> mayUnlockAll;
+
+    map<int, bool> singleMutex;
+
+    /// shared variable -> the locks held at all its accesses
+    map<int, Lockset> guards;
+    set<int> syncObjects; // mutexes, condition variables, etc.
+
+public:
+    LocksetAnalysis(const IndexFunction& indexFunc, const IgnoreFunction& ignoreFunc,
+            const vector<const set<Value*>*>& sharedVariables, DyckAliasAnalysis* AA);
+
+    void analyze(Module* module);
+
+    /// whether all accesses to the shared variable hold a lock
+    bool isProtected(int svIdx) const;
+
+private:
+    /// the lock of a mutex pointer, -1 if it is not a single global mutex
+    int getLock(Value* mutex);
+
+    void computeUnlocks(Module* module);
+
+    void meet(Lockset& to, const Lockset& from) const;
+
+    /// returns whether the lockset at the entry of a callee changes
+    bool transfer(Function* f, bool collect);
+
+    /// effects: propagate to callees and, if collect, record the accesses
+    void step(Instruction* inst, Lockset& state, bool effects, bool collect, bool& changed);
+
+    void noteAccess(Value* pointer, Instruction* inst, const Lockset& state);
+};
+
+#endif	/* LOCKSETANALYSIS_H */
@@ -0,0 +1,72 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef REGIONCOARSENING_H
+#define	REGIONCOARSENING_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+#include "Transformer/TransformerUtils.h"
+
+#include <functional>
+#include <map>
+#include <vector>
+
+using namespace std;
+using namespace llvm;
+
+/// Groups the shared loads and stores of a basic block into regions, so that
+/// the recorder locks and logs each shared variable once per region instead
+/// of once per access. A region is a run of at least two shared accesses in a
+/// block that contains no synchronization, atomic operation or call, touches
+/// at most maxVars shared variables and spans at most maxSize instructions.
+/// A loop whose body is such a block records once per iteration.
+class RegionCoarsening {
+public:
+    struct Region {
+        Instruction* first;
+        Instruction* last;
+        vector<int> svIndices; // sorted, the order in which the locks are taken
+    };
+
+private:
+    IndexFunction getIndex;
+    unsigned maxSize;
+    unsigned maxVars;
+
+    vector<Region*> regions;
+    map<Instruction*, Region*> regionOf;
+
+    unsigned numAccesses;
+
+public:
+    RegionCoarsening(const IndexFunction& indexFunc, unsigned maxSize, unsigned maxVars) :
+            getIndex(indexFunc), maxSize(maxSize), maxVars(maxVars), numAccesses(0) {
+    }
+
+    ~RegionCoarsening();
+
+    /// must be called before any instrumentation is inserted into f
+    void analyze(Function* f);
+
+    /// the region containing the access, NULL if it is recorded alone
+    Region* getRegion(Instruction* inst) const {
+        auto it = regionOf.find(inst);
+        return it == regionOf.end() ? NULL : it->second;
+    }
+
+    unsigned getNumRegions() const {
+        return regions.size();
+    }
+
+    unsigned getNumCoveredAccesses() const {
+        return numAccesses;
+    }
+
+private:
+    void close(vector<Instruction*>& accesses, vector<int>& vars);
+};
+
+#endif	/* REGIONCOARSENING_H */
@@ -0,0 +1,63 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef THREADPHASEANALYSIS_H
+#define	THREADPHASEANALYSIS_H
+
+#include "DyckAA/DyckAliasAnalysis.h"
+#include "Transformer/TransformerUtils.h"
+
+#include <functional>
+#include <set>
+
+using namespace std;
+using namespace llvm;
+
+/// Finds the accesses to shared variables whose order needs no recording.
+///
+/// 1. Single-threaded points: the instructions of main that cannot run after
+///    a call that may create a thread, and the functions that are only called
+///    from such points (and neither create threads nor have their address
+///    taken). Only the main thread exists there.
+/// 2. Read-only shared variables: every write to them, including passing
+///    them to external functions, happens at a single-threaded point. After
+///    the threads are created they are only read, and a load of them always
+///    sees the same value.
+///
+/// Pointer calls are resolved with the call graph of DyckAA if it is
+/// preserved; otherwise they are assumed to create threads.
+class ThreadPhaseAnalysis {
+private:
+    IndexFunction getIndex;
+    DyckCallGraph* callGraph; // NULL if not preserved
+
+    set<Function*> spawners; // functions that may create threads
+    set<Function*> singleThreadedFunctions;
+    set<Instruction*> multiThreadedInMain; // instructions of main that may run with other threads
+    Function* mainFunction;
+
+    set<int> writtenWhenMultiThreaded;
+
+public:
+    ThreadPhaseAnalysis(const IndexFunction& indexFunc, DyckAliasAnalysis* AA);
+
+    void analyze(Module* module);
+
+    bool isSingleThreaded(Instruction* inst) const;
+
+    bool isReadOnlyShared(int svIdx) const {
+        return mainFunction != NULL && !writtenWhenMultiThreaded.count(svIdx);
+    }
+
+private:
+    bool mayCreateThread(CallInst* call);
+
+    void computeSpawners(Module* module);
+    void computeMainPhases();
+    void computeSingleThreadedFunctions(Module* module);
+    void computeWrites(Module* module);
+};
+
+#endif	/* THREADPHASEANALYSIS_H */
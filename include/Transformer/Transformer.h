@@ -31,6 +31,7 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <unordered_map>
 
 using namespace std;
 using namespace llvm;
@@ -46,6 +47,12 @@ public:
     CallInst* insertCallInstAtHead(Function* theFunc, Function * tocall, ...);
     CallInst* insertCallInstAtTail(Function* theFunc, Function * tocall, ...);
 
+    /// Sort the shared variables (alias sets) by the first of their values in
+    /// module order, so that their indices do not change from run to run,
+    /// and map every value in a set to the index of the set.
+    static void indexSharedVariables(Module* module, std::vector<const set<Value*>*>& svs,
+            std::unordered_map<const Value*, int>& index);
+
 public:
 
     virtual ~Transformer() {
@@ -57,6 +64,12 @@ public:
     virtual void afterTransform(Module* module, AliasAnalysis& AA) {
     }
 
+    /// called before the instructions of a function to transform are visited;
+    /// returns false if they need not be, e.g. its instrumented body is cached
+    virtual bool beforeTransformFunction(Module* module, Function* f) {
+        return true;
+    }
+
     virtual bool functionToTransform(Module* module, Function * f) {
         return false;
     }
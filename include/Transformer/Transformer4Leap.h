@@ -11,20 +11,50 @@
 #define	TRANSFORMER4LEAP_H
 
 #include "Transformer.h"
+#include "AccessElision.h"
+#include "RegionCoarsening.h"
+#include "LeapProfile.h"
+#include "ThreadPhaseAnalysis.h"
+#include "LocksetAnalysis.h"
+#include "LeapIds.h"
+#include "LeapBodyCache.h"
 
 class Transformer4Leap : public Transformer, public ModulePass {
 private:
     Function *F_preload, *F_load, *F_prestore, *F_store;
     Function *F_prelock, *F_lock, *F_preunlock, *F_unlock;
     Function *F_prefork, *F_fork, *F_prejoin, *F_join;
+    Function *F_create; // called instead of pthread_create
     Function *F_prewait, *F_wait, *F_prenotify, *F_notify;
+    Function *F_prememaccess, *F_memaccess; // memcpy, memmove and memset
+    Function *F_preatomic, *F_atomic; // cmpxchg and atomicrmw
     Function *F_init, *F_exit/*, *F_thread_init, *F_thread_exit*/;
+    Function *F_fast_preaccess, *F_fast_postaccess, *F_slow_preaccess; // -leap-inline-fast-path
+    Function *F_preregion, *F_region;
+    Function *F_ownercheck, *F_ownercheckend; // -leap-profile
 private:
     static int stmt_idx;
 
 private:
     size_t ptrsize; // = sizeof(int*)
     std::vector<const set<Value*>*> sharedVariables;
+    std::unordered_map<const Value*, int> sharedVariableIndex; // value -> index of its alias set
+
+    AccessElision* elision; // NULL if redundant accesses are instrumented
+
+    RegionCoarsening* regions; // NULL if each access is recorded alone
+    map<RegionCoarsening::Region*, Constant*> regionIndices; // region -> its shared variable ids in an array
+
+    LeapProfile* profile; // NULL if every shared variable is recorded
+
+    ThreadPhaseAnalysis* phases; // NULL if accesses are recorded in all phases
+    unsigned numSingleThreadedSites, numReadOnlySites;
+
+    LocksetAnalysis* locksets; // NULL if lock-protected accesses are recorded
+    unsigned numProtectedSites;
+
+    LeapIds* ids; // NULL if ids are not kept across builds
+    LeapBodyCache* bodies; // NULL if every function is instrumented
 
 public:
     static char ID;
@@ -40,6 +70,7 @@ public:
     virtual bool runOnModule(Module &M);
     virtual void beforeTransform(Module* module, AliasAnalysis& AA);
     virtual void afterTransform(Module* module, AliasAnalysis& AA);
+    virtual bool beforeTransformFunction(Module* module, Function* f);
     virtual bool functionToTransform(Module* module, Function * f);
     virtual bool blockToTransform(Module* module, BasicBlock * bb);
     virtual bool instructionToTransform(Module* module, Instruction * ins);
@@ -56,6 +87,8 @@ public:
     virtual void transformMemCpyMov(Module* module, CallInst* ins, AliasAnalysis& AA);
     virtual void transformMemSet(Module* module, CallInst* ins, AliasAnalysis& AA);
     virtual void transformOtherFunctionCalls(Module* module, CallInst* ins, AliasAnalysis& AA);
+    virtual void transformAtomicCmpXchgInst(Module* module, AtomicCmpXchgInst* inst, AliasAnalysis& AA);
+    virtual void transformAtomicRMWInst(Module* module, AtomicRMWInst* inst, AliasAnalysis& AA);
     virtual bool isInstrumentationFunction(Module* module, Function *f);
 
     virtual bool debug();
@@ -64,6 +97,24 @@ private:
 
     int getValueIndex(Module* module, Value * v, AliasAnalysis& AA);
 
+    /// hashes what the instrumentation of f depends on besides its
+    /// instructions and shared variables, see LeapIds
+    unsigned long long hashDecisions(Module* module, Function* f, AliasAnalysis& AA);
+
+    /// emits the fast path of the recorder as always-inline functions, see LeapSupport/FastPath.h
+    void createFastPathFunctions(Module* module);
+
+    /// returns false if the access is not in a region
+    bool transformRegionAccess(Module* module, Instruction* inst);
+
+    /// records a bulk memory operation as one event for each shared variable
+    /// it writes or reads (-1 if none)
+    void transformMemAccess(Module* module, CallInst* call, int svIdx_dst, int svIdx_src);
+
+    /// logs the value in memory that a cmpxchg or atomicrmw saw, or records
+    /// it like a store if it may hold an address; value is the value it writes
+    void transformAtomicAccess(Module* module, Instruction* inst, Value* pointer, Value* value, AliasAnalysis& AA);
+
 };
 
 
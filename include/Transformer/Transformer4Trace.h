@@ -19,6 +19,7 @@ private:
     Function *F_prelock, *F_lock, *F_preunlock, *F_unlock;
     Function *F_prefork, *F_fork, *F_prejoin, *F_join;
     Function *F_prewait, *F_wait, *F_prenotify, *F_notify;
+    Function *F_prememaccess, *F_memaccess; // memcpy, memmove and memset
     Function *F_init, *F_exit/*, *F_thread_init, *F_thread_exit*/;
 
     set<Function*> ignored_funcs;
@@ -26,6 +27,7 @@ private:
 private:
     size_t ptrsize; // = sizeof(int*)
     std::vector<const set<Value*>*> sharedVariables;
+    std::unordered_map<const Value*, int> sharedVariableIndex; // value -> index of its alias set
 
 public:
     static char ID;
@@ -66,6 +68,9 @@ private:
 
     Value* getOrInsertSrcFileNameValue(Module* module, Instruction* inst);
     Value* getOtInsertLineNumberValue(Module* module, Instruction * inst);
+
+    /// dst and src are NULL if not shared
+    void transformMemAccess(Module* module, CallInst* call, Value* dst, Value* src);
 };
 
 #endif	/* TRANSFORMER4TRACE_H */
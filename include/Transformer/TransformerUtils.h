@@ -0,0 +1,33 @@
+/*
+ * Helpers shared by the analyses of the leap transformer.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#ifndef TRANSFORMERUTILS_H
+#define	TRANSFORMERUTILS_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include <functional>
+#include <set>
+
+using namespace std;
+using namespace llvm;
+
+class DyckCallGraph;
+
+/// maps an address to the index of its shared variable, -1 if not shared
+typedef std::function<int(Value*)> IndexFunction;
+
+/// whether f is used other than as the callee of a call
+bool isAddressTaken(Function* f);
+
+/// Adds the functions the call may call to callees. A pointer call is
+/// resolved with the call graph, if it is not NULL. Returns false if the
+/// callees cannot be resolved; an inline asm has none.
+bool getCallees(CallInst* call, DyckCallGraph* callGraph, set<Function*>& callees);
+
+#endif	/* TRANSFORMERUTILS_H */
@@ -16,6 +16,21 @@ static cl::opt<bool> WithFunctionCastComb("with-function-cast-comb", cl::init(fa
 static cl::opt<unsigned> NumInterIteration("dyckaa-inter-iteration", cl::init(UINT_MAX), cl::Hidden,
         cl::desc("The max number of iterators for fix-pointer computation during interprocedure analysis."));
 
+static cl::opt<std::string> LibrarySpecFile("dyckaa-lib-spec", cl::init(""), cl::Hidden,
+        cl::desc("A file describing the alias semantics of library functions, which extends the built-in models."));
+
+static cl::opt<bool> PointerRelevanceFilter("dyckaa-pointer-relevance", cl::init(true), cl::Hidden,
+        cl::desc("Do not create vertices for values that cannot carry pointers."));
+
+static cl::opt<bool> SummarizeInitializers("dyckaa-summarize-initializers", cl::init(true), cl::Hidden,
+        cl::desc("Model the elements of aggregate global initializers by one vertex per field path."));
+
+static cl::opt<unsigned> TimeBudget("dyckaa-time-budget", cl::init(0), cl::Hidden,
+        cl::desc("The wall-clock budget of the analysis in seconds (0 = no budget). The analysis degrades soundly when it runs short."));
+
+static cl::opt<unsigned> MemBudget("dyckaa-mem-budget", cl::init(0), cl::Hidden,
+        cl::desc("The memory budget of the analysis in MB (0 = no budget). The analysis degrades soundly when it runs short."));
+
 static Instruction* RunningInst = nullptr;
 
 static void OnSegmentFalut(int) {
@@ -29,7 +44,7 @@ static void OnSegmentFalut(int) {
 }
 
 AAAnalyzer::AAAnalyzer(Module* m, DyckAliasAnalysis* a, DyckGraph* d, DyckCallGraph* cg) :
-        PB("[Canary]", DyckAA::ProgressBar::PBS_CharacterStyle) {
+        PB("[Canary]", DyckAA::ProgressBar::PBS_CharacterStyle), budget(TimeBudget, MemBudget) {
 	module = m;
 	aa = a;
 	dgraph = d;
@@ -38,15 +53,28 @@ AAAnalyzer::AAAnalyzer(Module* m, DyckAliasAnalysis* a, DyckGraph* d, DyckCallGr
 
 AAAnalyzer::~AAAnalyzer() {
 	this->destroyFunctionGroups();
+	delete relevance;
 }
 
 void AAAnalyzer::start_intra_procedure_analysis() {
 	this->initFunctionGroups();
+	this->initLibraryModels();
+	fieldSensitivity.collectNestingDepths(module);
+	if (PointerRelevanceFilter) {
+		unsigned pointerBits = aa->getTypeStoreSize(Type::getInt8PtrTy(module->getContext())) * 8;
+		relevance = new PointerRelevance(module, pointerBits);
+	}
 	outs() << "[Canary] Intra-procedural analysis...";
 }
 
 void AAAnalyzer::end_intra_procedure_analysis() {
 	outs() << "\r\033[K"; // clear the line
+	DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Vertices after intra-procedural analysis: " << dgraph->numVertices() << "\n");
+	DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Pointer-irrelevant values without vertices: "
+			<< (relevance ? relevance->getNumIrrelevant() : 0) << "\n");
+	DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Initializer elements without vertices: " << numSummarizedElements << "\n");
+	DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Field accesses merged by field-sensitivity bounds: "
+			<< fieldSensitivity.getNumCollapsedAccesses() << "\n");
 }
 
 void AAAnalyzer::start_inter_procedure_analysis() {
@@ -54,6 +82,13 @@ void AAAnalyzer::start_inter_procedure_analysis() {
 
 void AAAnalyzer::end_inter_procedure_analysis() {
 	DEBUG_WITH_TYPE("pointercalls", this->printNoAliasedPointerCalls());
+
+	if (!degradationReport.empty()) {
+		outs() << "[Canary] The analysis ran short of its budget and was coarsened soundly:\n";
+		for (auto& step : degradationReport) {
+			outs() << "[Canary]     " << step << "\n";
+		}
+	}
 }
 
 void AAAnalyzer::intra_procedure_analysis() {
@@ -67,6 +102,8 @@ void AAAnalyzer::intra_procedure_analysis() {
 			intrinsicsNum++;
 			continue;
 		}
+		checkBudget();
+
 		DyckCallGraphNode* df = callgraph->getOrInsertFunction(&F);
 		for (auto& B : F) {
 			for (auto& I : B) {
@@ -106,6 +143,8 @@ void AAAnalyzer::inter_procedure_analysis() {
             break;
         }
 
+		checkBudget();
+
         // outs() << "\n\nIteration #" << IterationCounter << "... \n\n";
         // outs() << "Phase: " << IterationPhase << "\n\n";
 
@@ -149,6 +188,7 @@ void AAAnalyzer::inter_procedure_analysis() {
 			while (dfit != callgraph->end()) {
 				DyckCallGraphNode * df = dfit->second;
 
+				checkBudget();
 				if (handle_pointer_function_calls(df, ++NumProcessedFunctions)) {
 					finished = false;
 				}
@@ -355,6 +395,143 @@ void AAAnalyzer::combineFunctionGroups(FunctionType * ft1, FunctionType* ft2) {
 	ftn2->compatibleFuncs.insert(ftn1->compatibleFuncs.begin(), ftn1->compatibleFuncs.end());
 }
 
+void AAAnalyzer::initLibraryModels() {
+	libModels.loadDefaults();
+	if (!LibrarySpecFile.empty() && !libModels.loadFile(LibrarySpecFile)) {
+		exit(1);
+	}
+
+	for (auto& F : *module) {
+		if (!F.empty() || F.isIntrinsic()) {
+			continue;
+		}
+
+		const LibraryModel* model = libModels.lookup(F.getName().str());
+		if (model) {
+			libModelMap.insert(pair<Function*, const LibraryModel*>(&F, model));
+		}
+	}
+	DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Modeled library functions: " << libModelMap.size() << "\n");
+}
+
+/// Called at safe points, i.e. when no DyckVertex* is held across the call.
+/// Each step is taken at most once, the cheaper ones first.
+void AAAnalyzer::checkBudget() {
+	if (!budget.isEnabled()) {
+		return;
+	}
+
+	float usage = budget.getUsage();
+	if (usage >= 0.5 && !fieldsCollapsed) {
+		fieldsCollapsed = true;
+		unsigned before = dgraph->numVertices();
+		this->collapseFields();
+		reportDegradation("dropped field sensitivity", before);
+	}
+
+	if (usage >= 0.75 && !classesCollapsed) {
+		classesCollapsed = true;
+		unsigned before = dgraph->numVertices();
+		this->collapseLargestAliasClasses(16);
+		reportDegradation("merged the 16 largest alias classes with what they point to", before);
+	}
+
+	if (usage >= 0.9 && !conservativePointerCalls) {
+		conservativePointerCalls = true;
+		reportDegradation("resolved pointer calls to all type-compatible functions", dgraph->numVertices());
+	}
+}
+
+void AAAnalyzer::reportDegradation(const char* step, unsigned verticesBefore) {
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%.1fs, %luMB: %s (#vertices %u -> %u)", budget.getElapsedSeconds(),
+			budget.getPeakMemoryMB(), step, verticesBefore, dgraph->numVertices());
+	degradationReport.push_back(buf);
+	DEBUG_WITH_TYPE("dyckaa-stats", errs() << "\n# Degradation at " << buf << "\n");
+}
+
+/// Merge every field into its struct and every field pointer into the
+/// struct pointer, as if the fields were never distinguished, and model
+/// the fields met later in the same way.
+void AAAnalyzer::collapseFields() {
+	fieldSensitivity.makeInsensitive();
+
+	set<void*> fieldLabels;
+	for (auto& it : aa->OFFSET_LABEL_MAP) {
+		fieldLabels.insert(it.second);
+	}
+	for (auto& it : aa->INDEX_LABEL_MAP) {
+		// -1 labels key:value pairs, which are not fields
+		if (it.first != -1)
+			fieldLabels.insert(it.second);
+	}
+
+	vector<pair<DyckVertex*, DyckVertex*>> pairs;
+	for (auto& v : dgraph->getVertices()) {
+		for (auto& labelTargets : v->getOutVertices()) {
+			if (!fieldLabels.count(labelTargets.first))
+				continue;
+			for (auto& t : labelTargets.second) {
+				if (t != v)
+					pairs.push_back(make_pair(v, t));
+			}
+		}
+	}
+	this->mergeVertices(pairs);
+}
+
+/// Merge each of the largest alias classes with the class it points to.
+/// The merge propagates along the deref edges in qirunAlgorithm, so the
+/// memory reachable from these classes ends up in a few vertices.
+void AAAnalyzer::collapseLargestAliasClasses(unsigned num) {
+	dgraph->qirunAlgorithm();
+
+	vector<DyckVertex*> classes(dgraph->getVertices().begin(), dgraph->getVertices().end());
+	if (num > classes.size())
+		num = classes.size();
+	partial_sort(classes.begin(), classes.begin() + num, classes.end(), [](DyckVertex* a, DyckVertex* b) {
+		return a->getEquivalentSet()->size() > b->getEquivalentSet()->size();
+	});
+
+	vector<pair<DyckVertex*, DyckVertex*>> pairs;
+	for (unsigned i = 0; i < num; i++) {
+		set<DyckVertex*>* derefs = classes[i]->getOutVertices((void*) aa->DEREF_LABEL);
+		if (!derefs)
+			continue;
+		for (auto& t : *derefs) {
+			if (t != classes[i])
+				pairs.push_back(make_pair(classes[i], t));
+		}
+	}
+	this->mergeVertices(pairs);
+
+	dgraph->qirunAlgorithm();
+}
+
+/// DyckGraph::combine deletes one of the two vertices, so we remember
+/// which vertex each deleted one has been merged into.
+void AAAnalyzer::mergeVertices(vector<pair<DyckVertex*, DyckVertex*>>& pairs) {
+	map<DyckVertex*, DyckVertex*> mergedInto;
+	auto find = [&mergedInto](DyckVertex* v) {
+		auto it = mergedInto.find(v);
+		while (it != mergedInto.end()) {
+			v = it->second;
+			it = mergedInto.find(v);
+		}
+		return v;
+	};
+
+	for (auto& p : pairs) {
+		DyckVertex* x = find(p.first);
+		DyckVertex* y = find(p.second);
+		if (x == y)
+			continue;
+
+		DyckVertex* rep = this->makeAlias(x, y);
+		mergedInto[rep == x ? y : x] = rep;
+	}
+}
+
 /// return the structure's field vertex
 
 DyckVertex* AAAnalyzer::addField(DyckVertex* val, long fieldIndex, DyckVertex* field) {
@@ -427,12 +604,18 @@ DyckVertex* AAAnalyzer::handle_gep(GEPOperator* gep) {
 		if (AggOrPointerTy->isStructTy()) {
 			// example: gep y 0 constIdx
 			// s1: y--deref-->?1--(fieldIdx idxLabel)-->?2
-			DyckVertex* theStruct = this->addPtrTo(current, nullptr);
-
 			assert(ci && "ERROR: when dealing with gep");
 
+			long fieldIdx = fieldSensitivity.getModeledFieldIndex((StructType*) AggOrPointerTy,
+					(unsigned) (*(ci->getValue().getRawData())));
+			if (fieldIdx < 0) {
+				// the field is merged into the struct, so is the field pointer into y
+				continue;
+			}
+
+			DyckVertex* theStruct = this->addPtrTo(current, nullptr);
+
 			// s2: ?3--deref-->?2
-			unsigned fieldIdx = (unsigned) (*(ci->getValue().getRawData()));
 			DyckVertex* field = this->addField(theStruct, fieldIdx, nullptr);
 			DyckVertex* fieldPtr = this->addPtrTo(nullptr, field);
 
@@ -443,7 +626,7 @@ DyckVertex* AAAnalyzer::handle_gep(GEPOperator* gep) {
 			// update current
 			current = fieldPtr;
 		} else if (AggOrPointerTy->isPointerTy() || AggOrPointerTy->isArrayTy() || AggOrPointerTy->isVectorTy()) {
-			if (!ci)
+			if (!ci && isRelevant(idx))
 				wrapValue(idx);
 		} else {
 			errs() << "ERROR in handle_gep: unknown type:\n";
@@ -527,7 +710,8 @@ DyckVertex* AAAnalyzer::wrapValue(Value * v) {
 			for (unsigned i = 0; i < ((ConstantExpr*) v)->getNumOperands(); i++) {
 				// e.g. i1 icmp ne (i8* bitcast (i32 (i32*, void (i8*)*)* @__pthread_key_create to i8*), i8* null)
 				// we should handle op<0>
-				wrapValue(((ConstantExpr*) v)->getOperand(i));
+				if (isRelevant(((ConstantExpr*) v)->getOperand(i)))
+					wrapValue(((ConstantExpr*) v)->getOperand(i));
 			}
 		}
 	} else if (isa<ConstantStruct>(v) || isa<ConstantArray>(v)) {
@@ -535,6 +719,8 @@ DyckVertex* AAAnalyzer::wrapValue(Value * v) {
 		unsigned numElmt = vAgg->getNumOperands();
 		for (unsigned i = 0; i < numElmt; i++) {
 			Value * vi = vAgg->getOperand(i);
+			if (!isRelevant(vi))
+				continue;
 
 			std::vector<unsigned> indices;
 			indices.push_back(i);
@@ -547,7 +733,8 @@ DyckVertex* AAAnalyzer::wrapValue(Value * v) {
 		unsigned numElmt = CV->getNumOperands();
 		for (unsigned i = 0; i < numElmt; i++) {
 			Value * vi = CV->getOperand(i);
-			this->handle_extract_insert_elmt_inst(CV, vi);
+			if (isRelevant(vi))
+				this->handle_extract_insert_elmt_inst(CV, vi);
 		}
 		vdv = wrapValue(v);
 	} else if (isa<GlobalValue>(v)) {
@@ -555,10 +742,18 @@ DyckVertex* AAAnalyzer::wrapValue(Value * v) {
 			GlobalVariable * global = (GlobalVariable *) v;
 			if (global->hasInitializer()) {
 				Value * initializer = global->getInitializer();
-				if (!isa<UndefValue>(initializer)) {
-					DyckVertex * initVer = wrapValue(initializer);
-					vdv = wrapValue(v);
-					addPtrTo(vdv, initVer);
+				if (!isa<UndefValue>(initializer) && isRelevant(initializer)) {
+					DyckVertex * initVer = nullptr;
+					if (SummarizeInitializers && (isa<ConstantArray>(initializer) || isa<ConstantStruct>(initializer))) {
+						// nullptr if no element can be a pointer
+						initVer = summarizeInitializer((Constant*) initializer);
+					} else {
+						initVer = wrapValue(initializer);
+					}
+					if (initVer) {
+						vdv = wrapValue(v);
+						addPtrTo(vdv, initVer);
+					}
 				}
 			}
 		} else if (isa<GlobalAlias>(v)) {
@@ -648,7 +843,8 @@ void AAAnalyzer::handle_instrinsic(Instruction *inst) {
 	case Intrinsic::memset: {
 		Value * ptr = call->getArgOperand(0);
 		Value * val = call->getArgOperand(1);
-		addPtrTo(wrapValue(ptr), wrapValue(val));
+		if (isRelevant(val))
+			addPtrTo(wrapValue(ptr), wrapValue(val));
 		// 0b11
 		mask |= 3;
 	}
@@ -662,8 +858,10 @@ void AAAnalyzer::handle_instrinsic(Instruction *inst) {
 		// vec_load = load ptr
 		// vec_return = select mask vec_load vec_passthru
 
-		this->makeAlias(wrapValue(vec_return), wrapValue(vec_passthru));
-		this->addPtrTo(wrapValue(ptr), wrapValue(vec_return));
+		if (isRelevant(vec_return)) {
+			this->makeAlias(wrapValue(vec_return), wrapValue(vec_passthru));
+			this->addPtrTo(wrapValue(ptr), wrapValue(vec_return));
+		}
 
 		// 0b101
 		mask |= 5;
@@ -680,7 +878,8 @@ void AAAnalyzer::handle_instrinsic(Instruction *inst) {
 		Value* vec = call->getArgOperand(0);
 		Value* ptr = call->getArgOperand(1);
 
-		this->addPtrTo(wrapValue(ptr), wrapValue(vec));
+		if (isRelevant(vec))
+			this->addPtrTo(wrapValue(ptr), wrapValue(vec));
 
 		// 0b11
 		mask |= 3;
@@ -707,7 +906,7 @@ void AAAnalyzer::handle_instrinsic(Instruction *inst) {
 
 	// wrap unhandled operand
 	for (unsigned i = 0; i < inst->getNumOperands(); i++) {
-		if (!(mask & (1 << i))) {
+		if (!(mask & (1 << i)) && isRelevant(call->getArgOperand(i))) {
 			wrapValue(call->getArgOperand(i));
 		}
 	}
@@ -746,7 +945,8 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 		// vector operations
 	case Instruction::ExtractElement: {
 		Value* vect = ((ExtractElementInst*) inst)->getVectorOperand();
-		this->handle_extract_insert_elmt_inst(vect, inst);
+		if (isRelevant(inst))
+			this->handle_extract_insert_elmt_inst(vect, inst);
 
 		mask |= (~0);
 	}
@@ -754,8 +954,10 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 	case Instruction::InsertElement: {
 		Value* vect = ((InsertElementInst*) inst)->getOperand(0);
 		Value* elmt2insert = ((InsertElementInst*) inst)->getOperand(1);
-		this->handle_extract_insert_elmt_inst(vect, elmt2insert);
-		this->handle_extract_insert_elmt_inst(inst, elmt2insert);
+		if (isRelevant(inst)) {
+			this->handle_extract_insert_elmt_inst(vect, elmt2insert);
+			this->handle_extract_insert_elmt_inst(inst, elmt2insert);
+		}
 
 		mask |= (~0);
 	}
@@ -765,8 +967,10 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 		Value* vect2 = ((ShuffleVectorInst*) inst)->getOperand(1);
 		Value* vectRet = inst;
 
-		this->makeAlias(wrapValue(vectRet), wrapValue(vect1));
-		this->makeAlias(wrapValue(vectRet), wrapValue(vect2));
+		if (isRelevant(inst)) {
+			this->makeAlias(wrapValue(vectRet), wrapValue(vect1));
+			this->makeAlias(wrapValue(vectRet), wrapValue(vect2));
+		}
 
 		mask |= (~0);
 	}
@@ -777,12 +981,17 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 		Value * agg = ((ExtractValueInst*) inst)->getAggregateOperand();
 		ArrayRef<unsigned> indices = ((ExtractValueInst*) inst)->getIndices();
 
-		this->handle_extract_insert_value_inst(agg, agg->getType(), indices, inst);
+		if (isRelevant(inst))
+			this->handle_extract_insert_value_inst(agg, agg->getType(), indices, inst);
 
 		mask |= (~0);
 	}
 		break;
 	case Instruction::InsertValue: {
+		mask |= (~0);
+		if (!isRelevant(inst))
+			break;
+
 		DyckVertex* resultV = wrapValue(inst);
 		Value * agg = ((InsertValueInst*) inst)->getAggregateOperand();
 		if (!isa<UndefValue>(agg)) {
@@ -792,8 +1001,6 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 		ArrayRef<unsigned> indices = ((InsertValueInst*) inst)->getIndices();
 
 		this->handle_extract_insert_value_inst(inst, inst->getType(), indices, ((InsertValueInst*) inst)->getInsertedValueOperand());
-
-		mask |= (~0);
 	}
 		break;
 
@@ -805,9 +1012,11 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 		Value * retXchg = inst;
 		Value * ptrXchg = inst->getOperand(0);
 		Value * newXchg = inst->getOperand(2);
-		addPtrTo(wrapValue(ptrXchg), wrapValue(retXchg));
-		wrapValue(newXchg);
-		addPtrTo(wrapValue(ptrXchg), wrapValue(newXchg));
+		wrapValue(ptrXchg);
+		if (isRelevant(retXchg))
+			addPtrTo(wrapValue(ptrXchg), wrapValue(retXchg));
+		if (isRelevant(newXchg))
+			addPtrTo(wrapValue(ptrXchg), wrapValue(newXchg));
 
 		// 0b101
 		mask |= 5;
@@ -816,9 +1025,15 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 	case Instruction::AtomicRMW: {
 		Value * retRmw = inst;
 		Value * ptrRmw = ((AtomicRMWInst*) inst)->getPointerOperand();
-		addPtrTo(wrapValue(ptrRmw), wrapValue(retRmw));
+		wrapValue(ptrRmw);
+		if (isRelevant(retRmw))
+			addPtrTo(wrapValue(ptrRmw), wrapValue(retRmw));
 
 		Value * newRmw = ((AtomicRMWInst*) inst)->getValOperand();
+		if (!isRelevant(newRmw)) {
+			mask |= (~0);
+			break;
+		}
 		wrapValue(newRmw);
 
 		switch (((AtomicRMWInst*) inst)->getOperation()) {
@@ -839,7 +1054,11 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 	case Instruction::Load: {
 		Value *lval = inst;
 		Value *ladd = inst->getOperand(0);
-		addPtrTo(wrapValue(ladd), wrapValue(lval));
+		// the address is kept even if the loaded value is irrelevant,
+		// since clients query the aliases of addresses
+		DyckVertex* laddVer = wrapValue(ladd);
+		if (isRelevant(lval))
+			addPtrTo(laddVer, wrapValue(lval));
 
 		mask |= (~0);
 	}
@@ -848,8 +1067,10 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 		Value * sval = inst->getOperand(0);
 		Value * sadd = inst->getOperand(1);
 		wrapValue(sadd);
-		wrapValue(sval);
-		addPtrTo(wrapValue(sadd), wrapValue(sval));
+		if (isRelevant(sval)) {
+			wrapValue(sval);
+			addPtrTo(wrapValue(sadd), wrapValue(sval));
+		}
 
 		mask |= (~0);
 	}
@@ -875,6 +1096,10 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 	case Instruction::BitCast:
 	case Instruction::PtrToInt:
 	case Instruction::IntToPtr: {
+		mask |= (~0);
+		if (!isRelevant(inst))
+			break;
+
 		Value * itpv = inst->getOperand(0);
 		makeAlias(wrapValue(inst), wrapValue(itpv));
 
@@ -886,8 +1111,6 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 				&& castTy->getPointerElementType()->isFunctionTy()) {
 			combineFunctionGroups((FunctionType*) origTy->getPointerElementType(), (FunctionType*) castTy->getPointerElementType());
 		}
-
-		mask |= (~0);
 	}
 		break;
 
@@ -922,13 +1145,14 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 		Value * cv = callinst->getCalledValue();
 		vector<Value*> args;
 		for (unsigned i = 0; i < callinst->getNumArgOperands(); i++) {
-		    wrapValue(callinst->getArgOperand(i));
+		    if (isRelevant(callinst->getArgOperand(i)))
+		        wrapValue(callinst->getArgOperand(i));
 		    args.push_back(callinst->getArgOperand(i));
 		}
 
 		this->handle_invoke_call_inst(callinst, cv, &args, parent_func);
 
-		if (!callinst->getType()->isVoidTy()) {
+		if (!callinst->getType()->isVoidTy() && isRelevant(callinst)) {
 		    wrapValue(callinst);
 		}
 
@@ -936,6 +1160,10 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 	}
 		break;
 	case Instruction::PHI: {
+		mask |= (~0);
+		if (!isRelevant(inst))
+			break;
+
 		PHINode *phi = (PHINode *) inst;
 		int nums = phi->getNumIncomingValues();
 		for (int i = 0; i < nums; i++) {
@@ -944,28 +1172,30 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 			auto* pv = wrapValue(p);
 			makeAlias(wrapValue(inst), pv);
 		}
-
-		mask |= (~0);
 	}
 		break;
 	case Instruction::Select: {
+		mask |= (~0);
+		if (!isRelevant(inst))
+			break;
+
 		Value *first = ((SelectInst*) inst)->getTrueValue();
 		Value *second = ((SelectInst*) inst)->getFalseValue();
 		makeAlias(wrapValue(inst), wrapValue(first));
 		wrapValue(second);
 		makeAlias(wrapValue(inst), wrapValue(second));
 
-		wrapValue(((SelectInst*) inst)->getCondition());
-
-		mask |= (~0);
+		if (isRelevant(((SelectInst*) inst)->getCondition()))
+			wrapValue(((SelectInst*) inst)->getCondition());
 	}
 		break;
 	case Instruction::VAArg: {
 		parent_func->addVAArg(inst);
 
-		DyckVertex* vaarg = wrapValue(inst);
 		Value * ptrVaarg = inst->getOperand(0);
-		addPtrTo(wrapValue(ptrVaarg), vaarg);
+		wrapValue(ptrVaarg);
+		if (isRelevant(inst))
+			addPtrTo(wrapValue(ptrVaarg), wrapValue(inst));
 
 		mask |= (~0);
 	}
@@ -979,7 +1209,7 @@ void AAAnalyzer::handle_inst(Instruction *inst, DyckCallGraphNode * parent_func)
 
 	// wrap unhandled operand
 	for (unsigned i = 0; i < inst->getNumOperands(); i++) {
-		if (!(mask & (1 << i))) {
+		if (!(mask & (1 << i)) && isRelevant(inst->getOperand(i))) {
 			wrapValue(inst->getOperand(i));
 		}
 	}
@@ -992,15 +1222,21 @@ void AAAnalyzer::handle_extract_insert_value_inst(Value* aggV, Type* aggTy, Arra
 	for (unsigned int i = 0; i < indices.size(); i++) {
 		assert(aggTy->isAggregateType() && "Error in handle_extract_insert_value_inst, not an agg (array/struct) type!");
 
-		if (aggTy->isArrayTy()) {
+		long fieldIdx = -1;
+		if (aggTy->isStructTy()) {
+			fieldIdx = fieldSensitivity.getModeledFieldIndex((StructType*) aggTy, indices[i]);
+		}
+
+		if (fieldIdx < 0) {
+			// arrays, and structs whose fields are merged
 			if (i == indices.size() - 1) {
 				currentStruct = this->makeAlias(currentStruct, toInOrExVal);
 			}
-		} else /*if (aggTy->isStructTy())*/{
+		} else {
 			if (i != indices.size() - 1) {
-				currentStruct = this->addField(currentStruct, indices[i], nullptr);
+				currentStruct = this->addField(currentStruct, fieldIdx, nullptr);
 			} else {
-				currentStruct = this->addField(currentStruct, indices[i], toInOrExVal);
+				currentStruct = this->addField(currentStruct, fieldIdx, toInOrExVal);
 			}
 		}
 
@@ -1008,6 +1244,79 @@ void AAAnalyzer::handle_extract_insert_value_inst(Value* aggV, Type* aggTy, Arra
 	}
 }
 
+/// Instead of building a vertex for every element of a constant aggregate,
+/// the elements are smashed: all elements of an array share one vertex, and
+/// the structs in an array share one set of field vertices. The elements
+/// that cannot be pointers (numbers, null, undef, zeros) get no vertices at
+/// all. The result is the same as wrapValue's, except that the aggregate
+/// constants inside the initializer are not in any alias set.
+DyckVertex* AAAnalyzer::summarizeInitializer(Constant* init) {
+	InitializerLayout layout;
+	set<pair<Constant*, vector<long>>> visited;
+	vector<long> path;
+	collectInitializerLeaves(init, path, layout, visited);
+	if (layout.empty()) {
+		return nullptr;
+	}
+
+	// wrap the leaves first, which may merge vertices
+	for (auto& pathLeaves : layout) {
+		for (auto& leaf : pathLeaves.second) {
+			wrapValue(leaf);
+		}
+	}
+
+	for (auto& pathLeaves : layout) {
+		// the vertex of init may have been merged, so always retrieve it by value
+		DyckVertex* field = wrapValue(init);
+		for (auto& idx : pathLeaves.first) {
+			field = this->addField(field, idx, nullptr);
+		}
+		for (auto& leaf : pathLeaves.second) {
+			field = this->makeAlias(field, wrapValue(leaf));
+		}
+	}
+	return wrapValue(init);
+}
+
+void AAAnalyzer::collectInitializerLeaves(Constant* c, vector<long>& path, InitializerLayout& layout,
+		set<pair<Constant*, vector<long>>>& visited) {
+	if (isa<ConstantInt>(c) || isa<ConstantFP>(c) || isa<ConstantPointerNull>(c) || isa<UndefValue>(c)
+			|| isa<ConstantAggregateZero>(c) || isa<ConstantDataSequential>(c) || isa<BlockAddress>(c) || !isRelevant(c)) {
+		numSummarizedElements++;
+		return;
+	}
+
+	if (!visited.insert(make_pair(c, path)).second) {
+		// e.g. the same string or function appears many times in a table
+		numSummarizedElements++;
+		return;
+	}
+
+	if (isa<ConstantArray>(c) || isa<ConstantVector>(c)) {
+		numSummarizedElements++;
+		for (unsigned i = 0; i < c->getNumOperands(); i++) {
+			collectInitializerLeaves((Constant*) c->getOperand(i), path, layout, visited);
+		}
+	} else if (isa<ConstantStruct>(c)) {
+		numSummarizedElements++;
+		StructType* sty = (StructType*) c->getType();
+		for (unsigned i = 0; i < c->getNumOperands(); i++) {
+			long fieldIdx = fieldSensitivity.getModeledFieldIndex(sty, i);
+			if (fieldIdx < 0) {
+				collectInitializerLeaves((Constant*) c->getOperand(i), path, layout, visited);
+			} else {
+				path.push_back(fieldIdx);
+				collectInitializerLeaves((Constant*) c->getOperand(i), path, layout, visited);
+				path.pop_back();
+			}
+		}
+	} else {
+		// functions, globals and constant expressions
+		layout[path].insert(c);
+	}
+}
+
 void AAAnalyzer::handle_extract_insert_elmt_inst(Value* v, Value* elmt) {
 	auto elmtVer = wrapValue(elmt);
 	auto vecVer = wrapValue(v);
@@ -1096,7 +1405,8 @@ void AAAnalyzer::handle_common_function_call(Call* c, DyckCallGraphNode* caller,
 			set<Value*>::iterator retIt = rets.begin();
 			while (retIt != rets.end()) {
 				Value* val = (Value*) *retIt;
-				if (aa->getTypeStoreSize(retTy) >= aa->getTypeStoreSize(val->getType())) {
+				if (aa->getTypeStoreSize(retTy) >= aa->getTypeStoreSize(val->getType())
+						&& (isRelevant(val) || isRelevant(c->instruction))) {
 				    wrapValue(c->instruction);
 				    makeAlias(wrapValue(val), wrapValue(c->instruction));
 				}
@@ -1120,8 +1430,10 @@ void AAAnalyzer::handle_common_function_call(Call* c, DyckCallGraphNode* caller,
 			Value* par = (Value*) (&(*pIt));
 			Value* arg = c->args[i];
 
-			wrapValue(arg);
-			makeAlias(wrapValue(par), wrapValue(arg));
+			if (isRelevant(par) || isRelevant(arg)) {
+				wrapValue(arg);
+				makeAlias(wrapValue(par), wrapValue(arg));
+			}
 
 			if (aa->getTypeStoreSize(par->getType()) < aa->getTypeStoreSize(arg->getType())) {
 				// the first pair of arg and par that are not type matched can be aliased,
@@ -1136,13 +1448,15 @@ void AAAnalyzer::handle_common_function_call(Call* c, DyckCallGraphNode* caller,
 
 			for (unsigned int i = NumPars; i < NumArgs; i++) {
 				Value * arg = c->args[i];
+				if (!isRelevant(arg))
+					continue;
 				DyckVertex* argV = wrapValue(arg);
 
 				for (unsigned j = 0; j < NumVarPars; j++) {
 					Value * var_par = (Value*) var_parameters[j];
 
 					// for var arg function, we only can get var args according to exact types.
-					if (aa->getTypeStoreSize(var_par->getType()) == aa->getTypeStoreSize(arg->getType())) {
+					if (aa->getTypeStoreSize(var_par->getType()) == aa->getTypeStoreSize(arg->getType()) && isRelevant(var_par)) {
 						argV = makeAlias(argV, wrapValue(var_par));
 					}
 				}
@@ -1174,10 +1488,15 @@ bool AAAnalyzer::handle_pointer_function_calls(DyckCallGraphNode* caller, int FU
 
 		// handle each unhandled, possible function
 		set<Value*> equivAndTypeCompSet;
-		const set<Value*>* equivSet = aa->getAliasSet(pcall->calledValue);
 		set<Function*>* cands = this->getCompatibleFunctions((FunctionType*) fty);
-		set_intersection(cands->begin(), cands->end(), equivSet->begin(), equivSet->end(),
-				inserter(equivAndTypeCompSet, equivAndTypeCompSet.begin()));
+		if (conservativePointerCalls) {
+			// out of budget: the call may call every compatible function
+			equivAndTypeCompSet.insert(cands->begin(), cands->end());
+		} else {
+			const set<Value*>* equivSet = aa->getAliasSet(pcall->calledValue);
+			set_intersection(cands->begin(), cands->end(), equivSet->begin(), equivSet->end(),
+					inserter(equivAndTypeCompSet, equivAndTypeCompSet.begin()));
+		}
 
 		set<Value*> unhandled_function;
 		set<Function*>* maycallfuncs = &(pcall->mayAliasedCallees);
@@ -1204,7 +1523,8 @@ bool AAAnalyzer::handle_pointer_function_calls(DyckCallGraphNode* caller, int FU
 //				outs() << "Handling indirect calls in Function #" << FUNCTION_COUNT << "... " << percentage << "%, " << RATE << "%         \r";
 			}
 
-			AliasAnalysis::AliasResult ar = aa->alias(mayAliasedFunctioin, pcall->calledValue);
+			AliasAnalysis::AliasResult ar = conservativePointerCalls ? AliasAnalysis::MayAlias
+					: aa->alias(mayAliasedFunctioin, pcall->calledValue);
 			if (ar == AliasAnalysis::MayAlias || ar == AliasAnalysis::MustAlias) {
 				ret = true;
 				maycallfuncs->insert(mayAliasedFunctioin);
@@ -1231,89 +1551,52 @@ bool AAAnalyzer::handle_pointer_function_calls(DyckCallGraphNode* caller, int FU
 }
 
 void AAAnalyzer::handle_lib_invoke_call_inst(Value* ret, Function* f, vector<Value*>* args, DyckCallGraphNode* parent) {
-    // args must be the real arguments, not the parameters.
-    if (!f->empty() || f->isIntrinsic())
-        return;
-
-    const string& functionName = f->getName().str();
-    switch (args->size()) {
-	case 1: {
-		if (functionName == "strdup" || functionName == "__strdup" || functionName == "strdupa") {
-			// content alias r/1st
-			this->makeContentAlias(wrapValue(args->at(0)), wrapValue(ret));
-		} else if (functionName == "pthread_getspecific" && ret) {
-			DyckVertex* keyRep = wrapValue(args->at(0));
-			DyckVertex* valRep = wrapValue(ret);
-			// we use label -1 to indicate that it is a key:value pair
-			keyRep->addTarget(valRep, aa->getOrInsertIndexEdgeLabel(-1));
-		}
-	}
-		break;
-	case 2: {
-		if (functionName == "strcat" || functionName == "strcpy") {
-			if (ret) {
-				DyckVertex * dst_ptr = wrapValue(args->at(0));
-				DyckVertex * src_ptr = wrapValue(args->at(1));
-
-				this->makeContentAlias(dst_ptr, src_ptr);
-				this->makeAlias(wrapValue(ret), dst_ptr);
-			} else {
-				errs() << "ERROR strcat/cpy does not return.\n";
-				exit(1);
-			}
-		} else if (functionName == "strndup" || functionName == "strndupa") {
-			// content alias r/1st
-			this->makeContentAlias(wrapValue(args->at(0)), wrapValue(ret));
-		} else if (functionName == "strstr" || functionName == "strcasestr") {
-			// content alias r/2nd
-			this->makeContentAlias(wrapValue(args->at(1)), wrapValue(ret));
-			// alias r/1st
-			this->makeAlias(wrapValue(ret), wrapValue(args->at(0)));
-		} else if (functionName == "strchr" || functionName == "strrchr" || functionName == "strchrnul" || functionName == "rawmemchr") {
-			// alias r/1st
-			this->makeAlias(wrapValue(ret), wrapValue(args->at(0)));
-		} else if (functionName == "strtok") {
-			// content alias r/1st
-			this->makeContentAlias(wrapValue(args->at(0)), wrapValue(ret));
-		} else if (functionName == "pthread_setspecific") {
-			DyckVertex* keyRep = wrapValue(args->at(0));
-			DyckVertex* valRep = wrapValue(args->at(1));
+	// args must be the real arguments, not the parameters.
+	// only external functions have models, see initLibraryModels().
+	auto modelIt = libModelMap.find(f);
+	if (modelIt == libModelMap.end())
+		return;
+
+	const LibraryModel* model = modelIt->second;
+	if (model->NumArgs >= 0 && (unsigned) model->NumArgs != args->size())
+		return;
+
+	auto operand = [ret, args](int idx) -> Value* {
+		if (idx == LibraryModel::RetOperand)
+			return ret;
+		if ((unsigned) idx < args->size())
+			return args->at(idx);
+		return nullptr;
+	};
+
+	for (auto& action : model->Actions) {
+		Value* first = operand(action.First);
+		Value* second = operand(action.Second);
+		// e.g. an implicit call has no return value
+		if (!first || !second)
+			continue;
+
+		switch (action.Kind) {
+		case LibraryModel::LMA_Alias:
+			this->makeAlias(wrapValue(first), wrapValue(second));
+			break;
+		case LibraryModel::LMA_ContentAlias:
+			this->makeContentAlias(wrapValue(first), wrapValue(second));
+			break;
+		case LibraryModel::LMA_KeyValue: {
+			DyckVertex* keyRep = wrapValue(first);
+			DyckVertex* valRep = wrapValue(second);
 			// we use label -1 to indicate that it is a key:value pair
 			keyRep->addTarget(valRep, aa->getOrInsertIndexEdgeLabel(-1));
 		}
-	}
-		break;
-	case 3: {
-		if (functionName == "strncat" || functionName == "strncpy" || functionName == "memcpy" || functionName == "memmove") {
-			if (ret) {
-				DyckVertex * dst_ptr = wrapValue(args->at(0));
-				DyckVertex * src_ptr = wrapValue(args->at(1));
-
-				this->makeContentAlias(dst_ptr, src_ptr);
-				this->makeAlias(wrapValue(ret), dst_ptr);
-			} else {
-				errs() << "ERROR strncat/cpy does not return.\n";
-				exit(1);
-			}
-		} else if (functionName == "memchr" || functionName == "memrchr" || functionName == "memset") {
-			// alias r/1st
-			this->makeAlias(wrapValue(ret), wrapValue(args->at(0)));
-		} else if (functionName == "strtok_r" || functionName == "__strtok_r") {
-			// content alias r/1st
-			this->makeContentAlias(wrapValue(args->at(0)), wrapValue(ret));
-		}
-	}
-		break;
-	case 4: {
-		if (functionName == "pthread_create") {
+			break;
+		case LibraryModel::LMA_ThreadSpawn: {
 			vector<Value*> xargs;
-			xargs.push_back(args->at(3));
-			DyckCallGraphNode* parent = callgraph->getOrInsertFunction(f);
-			this->handle_invoke_call_inst(nullptr, args->at(2), &xargs, parent);
+			xargs.push_back(second);
+			DyckCallGraphNode* spawner = callgraph->getOrInsertFunction(f);
+			this->handle_invoke_call_inst(nullptr, first, &xargs, spawner);
+		}
+			break;
 		}
 	}
-		break;
-	default:
-		break;
-    }
 }
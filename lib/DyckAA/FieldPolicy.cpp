@@ -0,0 +1,231 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "DyckAA/FieldPolicy.h"
+#include "llvm/IR/TypeFinder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <set>
+#include <stdlib.h>
+
+static cl::opt<bool> FieldInsensitive("dyckaa-field-insensitive", cl::init(false), cl::Hidden,
+        cl::desc("Merge all fields of a struct into the struct itself."));
+
+static cl::opt<unsigned> MaxFieldDepth("dyckaa-max-field-depth", cl::init(0), cl::Hidden,
+        cl::desc("Merge the fields of struct types nested deeper than this in other struct types (0 = no limit)."));
+
+static cl::opt<unsigned> MaxFields("dyckaa-max-fields", cl::init(0), cl::Hidden,
+        cl::desc("Model at most this many fields of a struct; the rest share the last one (0 = no limit)."));
+
+static cl::opt<bool> CollapseRecursiveTypes("dyckaa-collapse-recursive-types", cl::init(false), cl::Hidden,
+        cl::desc("Model recursive struct types (e.g. list nodes) field-insensitively."));
+
+static cl::list<std::string> FieldPolicies("dyckaa-field-policy", cl::CommaSeparated, cl::Hidden,
+        cl::desc("<type-name-pattern>:<insensitive|sensitive|depth=N|fields=N|collapse-recursive>, "
+                "refining the field sensitivity of matching struct types."));
+
+FieldSensitivity::FieldSensitivity() {
+    DefaultPolicy.Insensitive = FieldInsensitive;
+    DefaultPolicy.MaxDepth = MaxFieldDepth;
+    DefaultPolicy.MaxFields = MaxFields;
+    DefaultPolicy.CollapseRecursive = CollapseRecursiveTypes;
+
+    for (auto& Entry : FieldPolicies) {
+        size_t Colon = Entry.rfind(':');
+        FieldPolicy Dummy = DefaultPolicy;
+        if (Colon == std::string::npos || Colon == 0 || !applyPolicy(Dummy, Entry.substr(Colon + 1))) {
+            errs() << "[Canary] Invalid -dyckaa-field-policy entry: " << Entry << "\n";
+            errs() << "[Canary] Expect <type-name-pattern>:<insensitive|sensitive|depth=N|fields=N|collapse-recursive>\n";
+            exit(1);
+        }
+
+        PatternPolicy PP;
+        PP.Pattern = Entry.substr(0, Colon);
+        PP.Policy = Entry.substr(Colon + 1);
+        PatternPolicies.push_back(PP);
+    }
+}
+
+bool FieldSensitivity::isBounded() const {
+    return ForcedInsensitive || DefaultPolicy.Insensitive || DefaultPolicy.MaxDepth || DefaultPolicy.MaxFields
+            || DefaultPolicy.CollapseRecursive || !PatternPolicies.empty();
+}
+
+long FieldSensitivity::getModeledFieldIndex(StructType* Ty, unsigned Idx) {
+    const FieldPolicy& P = getPolicy(Ty);
+
+    if (ForcedInsensitive || P.Insensitive || (P.MaxDepth && getNestingDepth(Ty) > P.MaxDepth) || (P.CollapseRecursive && isRecursive(Ty))) {
+        NumCollapsedAccesses++;
+        return -1;
+    }
+
+    if (P.MaxFields && Idx >= P.MaxFields) {
+        NumCollapsedAccesses++;
+        return P.MaxFields - 1;
+    }
+
+    return Idx;
+}
+
+const FieldPolicy& FieldSensitivity::getPolicy(StructType* Ty) {
+    auto It = PolicyCache.find(Ty);
+    if (It != PolicyCache.end())
+        return It->second;
+
+    FieldPolicy P = DefaultPolicy;
+    if (Ty->hasName()) {
+        std::string Name = Ty->getName().str();
+        for (auto& PP : PatternPolicies) {
+            if (matchPattern(PP.Pattern.c_str(), Name.c_str()))
+                applyPolicy(P, PP.Policy);
+        }
+    }
+
+    return PolicyCache.insert(std::make_pair(Ty, P)).first->second;
+}
+
+/// A struct type is recursive if it can reach itself through its fields,
+/// pointers, arrays and vectors, e.g. struct node { int v; struct node* next; }.
+bool FieldSensitivity::isRecursive(StructType* Ty) {
+    auto It = RecursiveCache.find(Ty);
+    if (It != RecursiveCache.end())
+        return It->second;
+
+    bool Recursive = false;
+    std::set<Type*> Visited;
+    std::vector<Type*> Worklist;
+    for (unsigned i = 0; i < Ty->getNumElements(); i++)
+        Worklist.push_back(Ty->getElementType(i));
+
+    while (!Worklist.empty() && !Recursive) {
+        Type* Cur = Worklist.back();
+        Worklist.pop_back();
+        if (Cur == Ty) {
+            Recursive = true;
+        } else if (Visited.insert(Cur).second) {
+            if (StructType* ST = dyn_cast<StructType>(Cur)) {
+                if (!ST->isOpaque()) {
+                    for (unsigned i = 0; i < ST->getNumElements(); i++)
+                        Worklist.push_back(ST->getElementType(i));
+                }
+            } else if (SequentialType* SeqT = dyn_cast<SequentialType>(Cur)) {
+                // pointers, arrays and vectors
+                Worklist.push_back(SeqT->getElementType());
+            }
+        }
+    }
+
+    RecursiveCache[Ty] = Recursive;
+    return Recursive;
+}
+
+/// The nesting depth of a struct type is 1 if no struct type contains it by
+/// value (directly or in arrays and vectors), and otherwise 1 + the largest
+/// nesting depth of the struct types that contain it. Containment by value
+/// cannot be cyclic.
+void FieldSensitivity::collectNestingDepths(Module* M) {
+    TypeFinder StructTypes;
+    StructTypes.run(*M, false);
+
+    // the struct types that contain each struct type by value
+    std::map<StructType*, std::set<StructType*>> Containers;
+    for (StructType* ST : StructTypes) {
+        if (ST->isOpaque())
+            continue;
+        for (unsigned i = 0; i < ST->getNumElements(); i++) {
+            Type* ElemTy = ST->getElementType(i);
+            while (isa<ArrayType>(ElemTy) || isa<VectorType>(ElemTy))
+                ElemTy = cast<SequentialType>(ElemTy)->getElementType();
+            if (StructType* Inner = dyn_cast<StructType>(ElemTy))
+                Containers[Inner].insert(ST);
+        }
+    }
+
+    // the outermost types first
+    std::vector<StructType*> Worklist;
+    for (StructType* ST : StructTypes) {
+        if (!Containers.count(ST)) {
+            NestingDepths[ST] = 1;
+            Worklist.push_back(ST);
+        }
+    }
+    while (!Worklist.empty()) {
+        StructType* ST = Worklist.back();
+        Worklist.pop_back();
+        if (ST->isOpaque())
+            continue;
+        for (unsigned i = 0; i < ST->getNumElements(); i++) {
+            Type* ElemTy = ST->getElementType(i);
+            while (isa<ArrayType>(ElemTy) || isa<VectorType>(ElemTy))
+                ElemTy = cast<SequentialType>(ElemTy)->getElementType();
+            StructType* Inner = dyn_cast<StructType>(ElemTy);
+            if (!Inner)
+                continue;
+
+            unsigned& Depth = NestingDepths[Inner];
+            Depth = std::max(Depth, NestingDepths[ST] + 1);
+            // Inner is done after the last of its containers
+            if (Containers[Inner].erase(ST) && Containers[Inner].empty())
+                Worklist.push_back(Inner);
+        }
+    }
+}
+
+unsigned FieldSensitivity::getNestingDepth(StructType* Ty) {
+    auto It = NestingDepths.find(Ty);
+    // types not in the module, e.g. created by the analysis, are outermost
+    return It == NestingDepths.end() ? 1 : It->second;
+}
+
+bool FieldSensitivity::applyPolicy(FieldPolicy& P, const std::string& Policy) {
+    if (Policy == "insensitive") {
+        P.Insensitive = true;
+    } else if (Policy == "sensitive") {
+        P.Insensitive = false;
+        P.MaxDepth = 0;
+        P.MaxFields = 0;
+        P.CollapseRecursive = false;
+    } else if (Policy == "collapse-recursive") {
+        P.CollapseRecursive = true;
+    } else if (Policy.compare(0, 6, "depth=") == 0 || Policy.compare(0, 7, "fields=") == 0) {
+        size_t Eq = Policy.find('=');
+        char* End = nullptr;
+        long N = strtol(Policy.c_str() + Eq + 1, &End, 10);
+        if (Eq + 1 == Policy.size() || *End != '\0' || N < 0)
+            return false;
+        if (Policy[0] == 'd')
+            P.MaxDepth = (unsigned) N;
+        else
+            P.MaxFields = (unsigned) N;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// Glob-style matching, where '*' matches any sequence and '?' any character.
+bool FieldSensitivity::matchPattern(const char* Pattern, const char* Str) {
+    const char* StarP = nullptr;
+    const char* StarS = nullptr;
+    while (*Str) {
+        if (*Pattern == '?' || *Pattern == *Str) {
+            Pattern++;
+            Str++;
+        } else if (*Pattern == '*') {
+            StarP = Pattern++;
+            StarS = Str;
+        } else if (StarP) {
+            Pattern = StarP + 1;
+            Str = ++StarS;
+        } else {
+            return false;
+        }
+    }
+    while (*Pattern == '*')
+        Pattern++;
+    return *Pattern == '\0';
+}
@@ -0,0 +1,217 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "DyckAA/LibraryModel.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <assert.h>
+
+using namespace llvm;
+
+/// The models canary used to hard-code in AAAnalyzer::handle_lib_invoke_call_inst.
+static const char* DefaultLibrarySpec =
+        "strdup              1  content-alias(arg0, ret)\n"
+        "__strdup            1  content-alias(arg0, ret)\n"
+        "strdupa             1  content-alias(arg0, ret)\n"
+        "pthread_getspecific 1  key-value(arg0, ret)\n"
+        "strcat              2  content-alias(arg0, arg1) alias(ret, arg0)\n"
+        "strcpy              2  content-alias(arg0, arg1) alias(ret, arg0)\n"
+        "strndup             2  content-alias(arg0, ret)\n"
+        "strndupa            2  content-alias(arg0, ret)\n"
+        "strstr              2  content-alias(arg1, ret) alias(ret, arg0)\n"
+        "strcasestr          2  content-alias(arg1, ret) alias(ret, arg0)\n"
+        "strchr              2  alias(ret, arg0)\n"
+        "strrchr             2  alias(ret, arg0)\n"
+        "strchrnul           2  alias(ret, arg0)\n"
+        "rawmemchr           2  alias(ret, arg0)\n"
+        "strtok              2  content-alias(arg0, ret)\n"
+        "pthread_setspecific 2  key-value(arg0, arg1)\n"
+        "strncat             3  content-alias(arg0, arg1) alias(ret, arg0)\n"
+        "strncpy             3  content-alias(arg0, arg1) alias(ret, arg0)\n"
+        "memcpy              3  content-alias(arg0, arg1) alias(ret, arg0)\n"
+        "memmove             3  content-alias(arg0, arg1) alias(ret, arg0)\n"
+        "memchr              3  alias(ret, arg0)\n"
+        "memrchr             3  alias(ret, arg0)\n"
+        "memset              3  alias(ret, arg0)\n"
+        "strtok_r            3  content-alias(arg0, ret)\n"
+        "__strtok_r          3  content-alias(arg0, ret)\n"
+        "pthread_create      4  thread-spawn(arg2, arg3)\n";
+
+static std::string trim(const std::string& S) {
+    size_t B = S.find_first_not_of(" \t\r\n");
+    if (B == std::string::npos)
+        return "";
+    size_t E = S.find_last_not_of(" \t\r\n");
+    return S.substr(B, E - B + 1);
+}
+
+/// "ret" -> RetOperand, "argN" -> N, otherwise returns false.
+static bool parseOperand(const std::string& Str, int& Operand) {
+    std::string S = trim(Str);
+    if (S == "ret") {
+        Operand = LibraryModel::RetOperand;
+        return true;
+    }
+
+    if (S.size() > 3 && S.compare(0, 3, "arg") == 0) {
+        char* End = nullptr;
+        long N = strtol(S.c_str() + 3, &End, 10);
+        if (*End == '\0' && N >= 0) {
+            Operand = (int) N;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseActionKind(const std::string& S, LibraryModel::ActionKind& Kind) {
+    if (S == "alias") {
+        Kind = LibraryModel::LMA_Alias;
+    } else if (S == "content-alias") {
+        Kind = LibraryModel::LMA_ContentAlias;
+    } else if (S == "key-value") {
+        Kind = LibraryModel::LMA_KeyValue;
+    } else if (S == "thread-spawn") {
+        Kind = LibraryModel::LMA_ThreadSpawn;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+LibraryModelSet::LibraryModelSet() {
+}
+
+LibraryModelSet::~LibraryModelSet() {
+    for (auto& It : Models) {
+        delete It.second;
+    }
+}
+
+void LibraryModelSet::loadDefaults() {
+    bool Ret = parse(DefaultLibrarySpec, "<built-in>");
+    assert(Ret && "The built-in library spec is malformed!");
+    (void) Ret;
+}
+
+bool LibraryModelSet::loadFile(const std::string& FileName) {
+    std::ifstream In(FileName.c_str());
+    if (!In.is_open()) {
+        errs() << "[Canary] Cannot open the library spec file: " << FileName << "\n";
+        return false;
+    }
+
+    std::stringstream Buffer;
+    Buffer << In.rdbuf();
+    return parse(Buffer.str(), FileName);
+}
+
+const LibraryModel* LibraryModelSet::lookup(const std::string& Name) const {
+    auto It = Models.find(Name);
+    if (It == Models.end())
+        return nullptr;
+    return It->second;
+}
+
+bool LibraryModelSet::parse(const std::string& Text, const std::string& Source) {
+    std::istringstream In(Text);
+    std::string Line;
+    unsigned LineNo = 0;
+    while (std::getline(In, Line)) {
+        LineNo++;
+        if (!parseLine(Line, Source, LineNo))
+            return false;
+    }
+    return true;
+}
+
+bool LibraryModelSet::parseLine(const std::string& RawLine, const std::string& Source, unsigned LineNo) {
+    std::string Line = RawLine;
+    size_t Comment = Line.find('#');
+    if (Comment != std::string::npos)
+        Line = Line.substr(0, Comment);
+    Line = trim(Line);
+    if (Line.empty())
+        return true;
+
+    auto error = [&](const char* Msg) {
+        errs() << "[Canary] " << Source << ":" << LineNo << ": " << Msg << "\n";
+        errs() << "    " << RawLine << "\n";
+        return false;
+    };
+
+    std::istringstream Tokens(Line);
+    std::string Name, NumArgsStr;
+    Tokens >> Name >> NumArgsStr;
+    if (Name.empty() || NumArgsStr.empty())
+        return error("expect a function name and the number of arguments");
+
+    int NumArgs = -1;
+    if (NumArgsStr != "*") {
+        char* End = nullptr;
+        long N = strtol(NumArgsStr.c_str(), &End, 10);
+        if (*End != '\0' || N < 0)
+            return error("the number of arguments should be a non-negative integer or '*'");
+        NumArgs = (int) N;
+    }
+
+    LibraryModel* Model = new LibraryModel(Name, NumArgs);
+
+    std::string Rest;
+    std::getline(Tokens, Rest);
+    Rest = trim(Rest);
+    while (!Rest.empty()) {
+        size_t LParen = Rest.find('(');
+        size_t RParen = Rest.find(')');
+        if (LParen == std::string::npos || RParen == std::string::npos || RParen < LParen) {
+            delete Model;
+            return error("expect an action like alias(ret, arg0)");
+        }
+
+        LibraryModel::Action Act;
+        std::string KindStr = trim(Rest.substr(0, LParen));
+        std::string OperandsStr = Rest.substr(LParen + 1, RParen - LParen - 1);
+        size_t Comma = OperandsStr.find(',');
+        if (!parseActionKind(KindStr, Act.Kind)) {
+            delete Model;
+            return error("unknown action; expect alias, content-alias, key-value or thread-spawn");
+        }
+        if (Comma == std::string::npos || !parseOperand(OperandsStr.substr(0, Comma), Act.First)
+                || !parseOperand(OperandsStr.substr(Comma + 1), Act.Second)) {
+            delete Model;
+            return error("an action takes two operands, each of which is ret or argN");
+        }
+        if (Act.Kind == LibraryModel::LMA_ThreadSpawn
+                && (Act.First == LibraryModel::RetOperand || Act.Second == LibraryModel::RetOperand)) {
+            delete Model;
+            return error("the operands of thread-spawn must be arguments");
+        }
+        if (NumArgs >= 0 && (Act.First >= NumArgs || Act.Second >= NumArgs)) {
+            delete Model;
+            return error("an operand is out of the range of the arguments");
+        }
+
+        Model->Actions.push_back(Act);
+        Rest = trim(Rest.substr(RParen + 1));
+    }
+
+    if (Model->Actions.empty()) {
+        delete Model;
+        return error("a model needs at least one action");
+    }
+
+    // a later model overrides an earlier one with the same name
+    auto It = Models.find(Name);
+    if (It != Models.end()) {
+        delete It->second;
+        It->second = Model;
+    } else {
+        Models.insert(std::make_pair(Name, Model));
+    }
+    return true;
+}
@@ -0,0 +1,296 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "DyckAA/PointerRelevance.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+PointerRelevance::PointerRelevance(Module* M, unsigned PB) :
+        PointerBits(PB) {
+    for (auto GI = M->global_begin(), GE = M->global_end(); GI != GE; ++GI) {
+        if (GI->hasInitializer()) {
+            // the initializer is stored into the memory of the global
+            seedIfCarrier(GI->getInitializer());
+            visitConstant(GI->getInitializer());
+        }
+    }
+
+    for (auto& F : *M) {
+        for (auto& B : F) {
+            if (ReturnInst* RI = dyn_cast<ReturnInst>(B.getTerminator())) {
+                if (RI->getNumOperands() > 0)
+                    Returns[&F].push_back(RI->getReturnValue());
+            }
+        }
+    }
+
+    for (auto& F : *M) {
+        if (F.isDeclaration())
+            continue;
+
+        // a function whose address is taken may be called anywhere
+        bool AddressTaken = false;
+        for (Value::user_iterator I = F.user_begin(), E = F.user_end(); I != E; ++I) {
+            User* U = (User*) (*I);
+            if (!isa<CallInst>(U) || ((CallInst*) U)->getCalledFunction() != &F) {
+                AddressTaken = true;
+                break;
+            }
+        }
+        if (AddressTaken) {
+            for (auto& A : F.getArgumentList())
+                seedIfCarrier(&A);
+        }
+
+        for (auto& B : F) {
+            for (auto& I : B) {
+                visitInstruction(&I, AddressTaken);
+            }
+        }
+    }
+
+    while (!Worklist.empty()) {
+        Value* V = Worklist.back();
+        Worklist.pop_back();
+
+        auto It = Links.find(V);
+        if (It == Links.end())
+            continue;
+        for (auto& N : It->second)
+            seed(N);
+    }
+
+    for (auto& V : Seen) {
+        if (!Relevant.count(V))
+            NumIrrelevant++;
+    }
+
+    Links.clear();
+    Returns.clear();
+    VisitedConstants.clear();
+    Seen.clear();
+}
+
+bool PointerRelevance::isRelevant(Value* V) {
+    if (isa<GlobalValue>(V) || hasPointer(V->getType()))
+        return true;
+    return Relevant.count(V);
+}
+
+bool PointerRelevance::hasPointer(Type* Ty) {
+    auto It = HasPointerCache.find(Ty);
+    if (It != HasPointerCache.end())
+        return It->second;
+
+    bool Ret = false;
+    if (Ty->isPointerTy()) {
+        Ret = true;
+    } else if (StructType* ST = dyn_cast<StructType>(Ty)) {
+        for (unsigned i = 0; i < ST->getNumElements() && !Ret; i++)
+            Ret = hasPointer(ST->getElementType(i));
+    } else if (Ty->isArrayTy() || Ty->isVectorTy()) {
+        Ret = hasPointer(Ty->getSequentialElementType());
+    }
+
+    HasPointerCache[Ty] = Ret;
+    return Ret;
+}
+
+/// Whether a value of the type may hold a pointer, e.g. when a struct
+/// containing pointers is copied as i64s.
+bool PointerRelevance::mayCarryPointer(Type* Ty) {
+    if (hasPointer(Ty))
+        return true;
+
+    if (Ty->isIntegerTy()) {
+        return Ty->getIntegerBitWidth() >= PointerBits;
+    } else if (StructType* ST = dyn_cast<StructType>(Ty)) {
+        for (unsigned i = 0; i < ST->getNumElements(); i++) {
+            if (mayCarryPointer(ST->getElementType(i)))
+                return true;
+        }
+    } else if (Ty->isArrayTy() || Ty->isVectorTy()) {
+        return mayCarryPointer(Ty->getSequentialElementType());
+    }
+    return false;
+}
+
+void PointerRelevance::note(Value* V) {
+    if (isa<GlobalValue>(V) || V->getType()->isVoidTy() || hasPointer(V->getType()))
+        return;
+    Seen.insert(V);
+}
+
+void PointerRelevance::seed(Value* V) {
+    if (isa<GlobalValue>(V) || hasPointer(V->getType()))
+        return;
+    if (Relevant.insert(V).second)
+        Worklist.push_back(V);
+}
+
+void PointerRelevance::seedIfCarrier(Value* V) {
+    if (mayCarryPointer(V->getType()))
+        seed(V);
+}
+
+/// A and B will be aliased by the analysis.
+void PointerRelevance::link(Value* A, Value* B) {
+    bool APtr = isa<GlobalValue>(A) || hasPointer(A->getType());
+    bool BPtr = isa<GlobalValue>(B) || hasPointer(B->getType());
+    if (APtr && BPtr)
+        return;
+
+    if (APtr) {
+        seed(B);
+    } else if (BPtr) {
+        seed(A);
+    } else {
+        Links[A].push_back(B);
+        Links[B].push_back(A);
+    }
+}
+
+void PointerRelevance::visitConstant(Constant* C) {
+    if (isa<GlobalValue>(C) || !VisitedConstants.insert(C).second)
+        return;
+    note(C);
+
+    if (ConstantExpr* CE = dyn_cast<ConstantExpr>(C)) {
+        unsigned Opcode = CE->getOpcode();
+        if (CE->isCast()) {
+            link(CE, CE->getOperand(0));
+        } else if (Opcode == Instruction::Select) {
+            link(CE, CE->getOperand(1));
+            link(CE, CE->getOperand(2));
+        } else if (Opcode == Instruction::ExtractValue || Opcode == Instruction::ExtractElement) {
+            link(CE, CE->getOperand(0));
+        } else if (Opcode == Instruction::InsertValue || Opcode == Instruction::InsertElement
+                || Opcode == Instruction::ShuffleVector) {
+            link(CE, CE->getOperand(0));
+            link(CE, CE->getOperand(1));
+        }
+    } else if (isa<ConstantStruct>(C) || isa<ConstantArray>(C) || isa<ConstantVector>(C)) {
+        for (unsigned i = 0; i < C->getNumOperands(); i++)
+            link(C, C->getOperand(i));
+    }
+
+    for (unsigned i = 0; i < C->getNumOperands(); i++) {
+        if (Constant* Op = dyn_cast<Constant>(C->getOperand(i)))
+            visitConstant(Op);
+    }
+}
+
+void PointerRelevance::visitInstruction(Instruction* I, bool InAddressTakenFunction) {
+    note(I);
+    for (unsigned i = 0; i < I->getNumOperands(); i++) {
+        Value* Op = I->getOperand(i);
+        if (Constant* C = dyn_cast<Constant>(Op))
+            visitConstant(C);
+        else
+            note(Op);
+    }
+
+    switch (I->getOpcode()) {
+    case Instruction::Ret:
+        if (InAddressTakenFunction && I->getNumOperands() > 0)
+            seedIfCarrier(I->getOperand(0));
+        break;
+    case Instruction::Load:
+    case Instruction::VAArg:
+        seedIfCarrier(I);
+        break;
+    case Instruction::Store:
+        seedIfCarrier(I->getOperand(0));
+        break;
+    case Instruction::AtomicCmpXchg:
+        seedIfCarrier(I);
+        seedIfCarrier(I->getOperand(2));
+        break;
+    case Instruction::AtomicRMW:
+        seedIfCarrier(I);
+        seedIfCarrier(((AtomicRMWInst*) I)->getValOperand());
+        break;
+    case Instruction::PHI:
+        for (unsigned i = 0; i < ((PHINode*) I)->getNumIncomingValues(); i++)
+            link(I, ((PHINode*) I)->getIncomingValue(i));
+        break;
+    case Instruction::Select:
+        link(I, ((SelectInst*) I)->getTrueValue());
+        link(I, ((SelectInst*) I)->getFalseValue());
+        break;
+    case Instruction::ExtractValue:
+    case Instruction::ExtractElement:
+        link(I, I->getOperand(0));
+        break;
+    case Instruction::InsertValue:
+    case Instruction::InsertElement:
+    case Instruction::ShuffleVector:
+        link(I, I->getOperand(0));
+        link(I, I->getOperand(1));
+        break;
+    case Instruction::Call:
+        visitCall((CallInst*) I);
+        break;
+    default:
+        if (I->isCast())
+            link(I, I->getOperand(0));
+        break;
+    }
+}
+
+void PointerRelevance::visitCall(CallInst* CI) {
+    if (CI->isInlineAsm())
+        return;
+
+    if (IntrinsicInst* II = dyn_cast<IntrinsicInst>(CI)) {
+        switch (II->getIntrinsicID()) {
+        case Intrinsic::memset:
+            seedIfCarrier(II->getArgOperand(1));
+            break;
+        case Intrinsic::masked_load:
+            link(II, II->getArgOperand(2));
+            seedIfCarrier(II);
+            break;
+        case Intrinsic::masked_store:
+            seedIfCarrier(II->getArgOperand(0));
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+
+    Value* CV = CI->getCalledValue();
+    while (isa<ConstantExpr>(CV) && ((ConstantExpr*) CV)->isCast())
+        CV = ((ConstantExpr*) CV)->getOperand(0);
+
+    Function* Callee = dyn_cast<Function>(CV);
+    if (!Callee || Callee->isDeclaration()) {
+        // indirect calls and library calls: we cannot see the other end
+        for (unsigned i = 0; i < CI->getNumArgOperands(); i++)
+            seedIfCarrier(CI->getArgOperand(i));
+        if (!CI->getType()->isVoidTy())
+            seedIfCarrier(CI);
+        return;
+    }
+
+    unsigned i = 0;
+    for (auto& Par : Callee->getArgumentList()) {
+        if (i >= CI->getNumArgOperands())
+            break;
+        link(&Par, CI->getArgOperand(i++));
+    }
+    for (; i < CI->getNumArgOperands(); i++) {
+        // var args
+        seedIfCarrier(CI->getArgOperand(i));
+    }
+
+    if (!CI->getType()->isVoidTy()) {
+        auto It = Returns.find(Callee);
+        if (It != Returns.end()) {
+            for (auto& Ret : It->second)
+                link(CI, Ret);
+        }
+    }
+}
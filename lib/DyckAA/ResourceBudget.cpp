@@ -0,0 +1,43 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "DyckAA/ResourceBudget.h"
+
+using namespace DyckAA;
+
+ResourceBudget::ResourceBudget(unsigned Seconds, unsigned MB) :
+        TimeBudget(Seconds), MemBudget(MB), Start(std::chrono::steady_clock::now()) {
+}
+
+double ResourceBudget::getElapsedSeconds() const {
+    std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+    return Elapsed.count();
+}
+
+unsigned long ResourceBudget::getPeakMemoryMB() const {
+    struct rusage Usage;
+    if (getrusage(RUSAGE_SELF, &Usage) != 0)
+        return 0;
+    // ru_maxrss is in KB on linux
+    return Usage.ru_maxrss / 1024;
+}
+
+float ResourceBudget::getUsage() const {
+    float Usage = 0;
+    if (TimeBudget) {
+        float TimeUsage = getElapsedSeconds() / TimeBudget;
+        if (TimeUsage > Usage)
+            Usage = TimeUsage;
+    }
+    if (MemBudget) {
+        float MemUsage = (float) getPeakMemoryMB() / MemBudget;
+        if (MemUsage > Usage)
+            Usage = MemUsage;
+    }
+    return Usage;
+}
@@ -10,152 +10,375 @@
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
 #include "LeapSupport/Signature.h"
+#include "LeapSupport/FastPath.h"
+#include "LeapSupport/AtomicLog.h"
+#include "LeapSupport/ChunkedLog.h"
+#include "LeapSupport/CompactLog.h"
+#include "LeapSupport/Records.h"
 #include "LeapSupport/SignalRoutine.h"
+#include "LeapSupport/ThreadStart.h"
 
-#define POSIX_MUTEX
-
-#include "LeapSupport/Lock.h"
-
-#define MAX_LOG_LEN 50000
 #define MAX_THREAD_NUM 50
 
-static bool start = false;
-static pthread_t thread_idx_map[MAX_THREAD_NUM];
 static int thread_idx = 1; //start from 1, make 0 be a terminal
 
-static unsigned **GLOG = NULL;
-static unsigned *GIDX = NULL;
+// exported for the inline fast path, see FastPath.h; __leap_tid is in
+// ThreadStart.h
+extern "C" {
+    int __leap_recording = 0;
+    LeapVar* __leap_vars = NULL;
+    int __leap_fast_path_v2 = LEAP_FAST_PATH_VERSION;
+}
+
+static_assert(sizeof (LeapVar) == LEAP_VAR_SIZE, "the transformer assumes LeapVar takes LEAP_VAR_SIZE bytes");
+
 
 static int num_shared_vars = 0;
 
-// set when log is too long
-static bool stop_recording = false;
+// the values observed by the atomic operations of each thread
+static AtomicLog atomic_logs[MAX_THREAD_NUM];
+
+// a full chunk of the log of a shared variable, see ChunkedLog.h
+typedef struct Chunk {
+    int svId;
+    unsigned len;
+    unsigned* entries;
+    struct Chunk* next;
+} Chunk;
+
+// the chunks to write, a lock-free stack pushed by recording threads and
+// emptied by the writer
+static Chunk* full_chunks = NULL;
+static int pending_chunks = 0;
+
+static FILE* flog = NULL;
+static pthread_t writer;
+static int writer_stop = 0;
 
 //static struct timeval tpstart, tpend;
 
-int static inline threadid(pthread_t tid) {
-    for (int i = 1; i < thread_idx; i++) {
-        if (thread_idx_map[i] == tid) {
-            return i;
-        }
-    }
+/* LeapVar.owned: the thread that logged the last event of a shared variable
+ * in the upper half, and in the lower half the accesses it made since then
+ * through OnOwnerCheck without logging them, at most LEAP_OWNED_MAX, and
+ * LEAP_OWNED_BUSY while one of them is not done */
+#define LEAP_OWNED(tid, count) (((unsigned long long) (tid) << 32) | (count))
+#define LEAP_OWNED_TID(owned) ((int) ((owned) >> 32))
+#define LEAP_OWNED_COUNT(owned) ((unsigned) ((owned) & 0x7fffffff))
+#define LEAP_OWNED_BUSY 0x80000000ULL
+#define LEAP_OWNED_MAX 0x7fffffff
+
+// what OnOwnerCheck did for OnOwnerCheckEnd
+#define LEAP_OWNER_CHECK_NONE 0
+#define LEAP_OWNER_CHECK_COUNTED 1 // LEAP_OWNED_BUSY is set
+#define LEAP_OWNER_CHECK_LOCKED 2 // the lock of the shared variable is held
+
+static __thread int owner_check = LEAP_OWNER_CHECK_NONE;
+
+/* how long OnExit waits for the lock of a shared variable before it flushes
+ * the log anyway, see lockvarforexit */
+#ifndef LEAP_EXIT_LOCK_SECONDS
+#define LEAP_EXIT_LOCK_SECONDS 1
+#endif
 
-    return -1;
-}
+/// the id of a new thread
+int static inline threadcreate() {
+    int tid = thread_idx++;
 
-void static inline threadcreate(pthread_t tid) {
-    thread_idx_map[thread_idx++] = tid;
-    
     if (thread_idx > MAX_THREAD_NUM) {
         printf("Too many threads!\n");
         exit(0);
     }
+    return tid;
 }
 
-void static inline store(int svId, int tid) {
-    if(stop_recording){
+/// waits while too many full chunks are not written, rather than let the
+/// memory grow. It is called before a lock is taken: a thread waiting with
+/// the lock of a shared variable held would make all the threads accessing
+/// the shared variable spin behind the writer too.
+void static inline waitwriter() {
+    while (__atomic_load_n(&pending_chunks, __ATOMIC_RELAXED) >= LEAP_MAX_PENDING_CHUNKS) {
+        sched_yield();
+    }
+}
+
+void static inline acquirevar(int svId) {
+    int* word = &__leap_vars[svId].lock;
+    while (!__sync_bool_compare_and_swap(word, 0, 1)) {
+        sched_yield();
+    }
+}
+
+/// Locks a shared variable (or a synchronization slot) with the lock word of
+/// its record. The inline fast path takes the same word, so every hook of a
+/// shared variable excludes the others whether or not the fast path is used.
+void static inline lockvar(int svId) {
+    waitwriter();
+    acquirevar(svId);
+}
+
+void static inline unlockvar(int svId) {
+    __atomic_store_n(&__leap_vars[svId].lock, 0, __ATOMIC_RELEASE);
+}
+
+/// OnExit also runs in the signal handler, maybe in a thread that holds the
+/// lock of the shared variable whose access faulted, so it gives up on a lock
+/// not released within LEAP_EXIT_LOCK_SECONDS; returns whether it is taken
+bool static inline lockvarforexit(int svId) {
+    int* word = &__leap_vars[svId].lock;
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (unsigned spins = 1; !__sync_bool_compare_and_swap(word, 0, 1); spins++) {
+        sched_yield();
+        if (spins % 1024 != 0) {
+            continue;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - begin.tv_sec >= LEAP_EXIT_LOCK_SECONDS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// svIds are ascending, so that threads lock a region in the same order
+void static inline lockvars(const int* svIds, int num) {
+    waitwriter();
+    for (int i = 0; i < num; i++) {
+        if (i == 0 || svIds[i] != svIds[i - 1]) {
+            acquirevar(svIds[i]);
+        }
+    }
+}
+
+void static inline unlockvars(const int* svIds, int num) {
+    for (int i = num - 1; i >= 0; i--) {
+        if (i == 0 || svIds[i] != svIds[i - 1]) {
+            unlockvar(svIds[i]);
+        }
+    }
+}
+
+void static inline pushChunk(int svId, unsigned* entries, unsigned len) {
+    Chunk* chunk = new Chunk;
+    chunk->svId = svId;
+    chunk->len = len;
+    chunk->entries = entries;
+
+    __sync_fetch_and_add(&pending_chunks, 1);
+    Chunk* head;
+    do {
+        head = __atomic_load_n(&full_chunks, __ATOMIC_RELAXED);
+        chunk->next = head;
+    } while (!__sync_bool_compare_and_swap(&full_chunks, head, chunk));
+}
+
+/// hands the current chunk of a shared variable, if any, to the writer and
+/// starts a new one; the caller holds the lock of the shared variable, and
+/// waited for the writer in lockvar before it took it
+void static inline newChunk(int svId) {
+    LeapVar& var = __leap_vars[svId];
+    if (var.log != NULL) {
+        pushChunk(svId, var.log, var.idx);
+    }
+
+    var.log = new unsigned[LEAP_CHUNK_LEN];
+    var.capacity = LEAP_CHUNK_LEN;
+    var.idx = 0;
+}
+
+static void* writeChunks(void* nouse) {
+    while (true) {
+        int stopping = __atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE);
+        Chunk* chunk = __atomic_exchange_n(&full_chunks, (Chunk*) NULL, __ATOMIC_ACQUIRE);
+        if (chunk == NULL) {
+            if (stopping) {
+                break;
+            }
+            usleep(1000);
+            continue;
+        }
+
+        // the stack has the last chunk first
+        Chunk* ordered = NULL;
+        while (chunk != NULL) {
+            Chunk* next = chunk->next;
+            chunk->next = ordered;
+            ordered = chunk;
+            chunk = next;
+        }
+
+        while (ordered != NULL) {
+            Chunk* next = ordered->next;
+            writeLeapLogBlock(flog, LEAP_LOG_GLOBAL, ordered->svId, 0, ordered->entries, ordered->len);
+#ifdef DEBUG
+            printf("Chunk of %d: %u entries\n", ordered->svId, ordered->len);
+#endif
+            delete[] ordered->entries;
+            delete ordered;
+            __sync_fetch_and_sub(&pending_chunks, 1);
+            ordered = next;
+        }
+    }
+    return NULL;
+}
+
+/// appends count consecutive events of a thread to the log of a shared
+/// variable; the caller holds its lock
+void static inline append(int svId, int tid, unsigned count) {
+    LeapVar& var = __leap_vars[svId];
+    if (var.log == NULL && !__leap_recording) {
+        // detached by OnExit, which a thread that checked __leap_recording
+        // before it got the lock may still log to
         return;
     }
 
-    int currentIdx = GIDX[svId];
-    if(currentIdx >= MAX_LOG_LEN){
-	printf("Log is too long to record! Stop recording!\n");
-	stop_recording = true;
-	return;
+    unsigned currentIdx = var.idx;
+    if (currentIdx > 0 && (int) (var.log[currentIdx - 2]) == tid) {
+        var.log[currentIdx - 1] += count;
+        return;
+    }
+
+    if (currentIdx + 2 > var.capacity) {
+        // the first chunk is allocated on first touch
+        newChunk(svId);
+        currentIdx = 0;
+    }
+
+    var.log[currentIdx] = tid;
+    var.log[currentIdx + 1] = count;
+    var.idx += 2;
+}
+
+/// logs the accesses the owner counted in OnOwnerCheck, and makes the thread
+/// the owner; the caller holds the lock of the shared variable. An access of
+/// the owner that is not done yet is waited for, so that it comes before the
+/// access of the caller as it does in the log.
+void static inline takeowner(int svId, int tid) {
+    LeapVar& var = __leap_vars[svId];
+    // only the owner changes owned without the lock, so it stays (tid, 0)
+    unsigned long long owned = __atomic_load_n(&var.owned, __ATOMIC_ACQUIRE);
+    if (owned == LEAP_OWNED(tid, 0)) {
+        return;
     }
 
-    if (currentIdx > 0 && (int) (GLOG[svId][currentIdx - 2]) == tid) {
-        GLOG[svId][currentIdx - 1]++;
-    } else {
-        GLOG[svId][currentIdx] = tid;
-        GLOG[svId][currentIdx + 1] = 1;
-        GIDX[svId] += 2;
+    while ((owned & LEAP_OWNED_BUSY) != 0
+            || !__atomic_compare_exchange_n(&var.owned, &owned, LEAP_OWNED(tid, 0), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        if ((owned & LEAP_OWNED_BUSY) != 0) {
+            sched_yield();
+            owned = __atomic_load_n(&var.owned, __ATOMIC_ACQUIRE);
+        }
+    }
+    if (LEAP_OWNED_COUNT(owned) > 0) {
+        append(svId, LEAP_OWNED_TID(owned), LEAP_OWNED_COUNT(owned));
     }
 }
 
+void static inline store(int svId, int tid) {
+    takeowner(svId, tid);
+    append(svId, tid, 1);
+}
+
 extern "C" {
 
     void OnInit(int svsNum) {
         printf("OnInit-Record\n");
         initializeSigRoutine();
 
-        //start = true;
+        //__leap_recording = 1;
         num_shared_vars = svsNum + 2; // one for fork, and the other is for synchronizations
 
-        for (int i = 0; i < MAX_THREAD_NUM; i++) {
-            thread_idx_map[i] = 0;
-        }
-
-        initialize(num_shared_vars); // initialize locks
+        // all fields are 0 (no log, unlocked), see Records.h
+        __leap_vars = (LeapVar*) allocateRecords(num_shared_vars, sizeof (LeapVar));
 
-        GLOG = new unsigned*[num_shared_vars];
-        GIDX = new unsigned[num_shared_vars];
-        for (int i = 0; i < num_shared_vars; i++) {
-            GLOG[i] = new unsigned[MAX_LOG_LEN];
-            GIDX[i] = 0;
+        flog = fopen("log.replay.dat", "wb");
+        if (flog == NULL) {
+            printf("Cannot write log file: log.replay.dat!\n");
+            exit(1);
+        }
+        Sig sig;
+        strcpy(sig.recorder, LEAP_LOG_SIG);
+        fwrite(&sig, sizeof (Sig), 1, flog);
+        // the number of threads is known at exit
+        writeLeapLogHeader(flog, LEAP_LOG_GLOBAL, num_shared_vars, 0);
+
+        if (pthread_create(&writer, NULL, writeChunks, NULL) != 0) {
+            printf("Cannot create the log writer!\n");
+            exit(1);
         }
 
         // main thread.
-        pthread_t tid = pthread_self();
-        if (threadid(tid) == -1) {
-            threadcreate(tid);
-        }
+        __leap_tid = threadcreate();
 
         //gettimeofday(&tpstart, NULL);
     }
 
     void OnExit(int nouse) {
-        start = false;
+        __leap_recording = 0;
 
         //gettimeofday(&tpend, NULL);
         //double timeuse = 1000000 * (tpend.tv_sec - tpstart.tv_sec) + tpend.tv_usec - tpstart.tv_usec;
         //timeuse /= 1000;
         //printf("processor time is %lf ms\n", timeuse);
 
-        Sig* sig = new Sig;
-        strcpy(sig->recorder, "leap");
-
-        FILE * fout = fopen("log.replay.dat", "wb");
-        printf("OnExit-Record\n");
-
-        fwrite(sig, sizeof (Sig), 1, fout);
-        fwrite(GIDX, sizeof (unsigned), num_shared_vars, fout);
-        for (int i = 0; i < num_shared_vars; i++) {
-            fwrite(GLOG[i], sizeof (unsigned), GIDX[i], fout);
+        if (flog == NULL) {
+            // already exited
+            return;
         }
-        fclose(fout);
+        printf("OnExit-Record\n");
+        // never striped, see lockvar
+        printf("%d locks, one in the record of each shared variable\n", num_shared_vars);
 
-#ifdef DEBUG
-        // debug out
-        FILE* fdebug = fopen("log.debug", "w+");
-        for (int i = 0; i < num_shared_vars; i++) {
-            fprintf(fdebug, "%d, ", GIDX[i]);
-        }
-        fprintf(fdebug, "\n\n");
+        // the last chunks, which are not full; a thread may still be inside
+        // a hook that checked __leap_recording, so each is detached with the
+        // lock of its shared variable
         for (int i = 0; i < num_shared_vars; i++) {
-            for (unsigned j = 0; j < GIDX[i]; j++) {
-                fprintf(fdebug, "%d, ", GLOG[i][j]);
+            LeapVar& var = __leap_vars[i];
+            bool locked = lockvarforexit(i);
+            if (!locked) {
+                printf("OnExit-Record: the lock of %d is not released, its log may be incomplete\n", i);
+            }
+            // no event follows, so an access of the owner that is not done
+            // is not waited for
+            unsigned long long owned = __atomic_exchange_n(&var.owned, LEAP_OWNED(0, 0), __ATOMIC_ACQ_REL);
+            if (LEAP_OWNED_COUNT(owned) > 0) {
+                append(i, LEAP_OWNED_TID(owned), LEAP_OWNED_COUNT(owned));
+            }
+            if (var.log != NULL && var.idx > 0) {
+                pushChunk(i, var.log, var.idx);
+            } else {
+                delete[] var.log;
+            }
+            var.log = NULL;
+            var.idx = 0;
+            var.capacity = 0;
+            if (locked) {
+                unlockvar(i);
             }
-            fprintf(fdebug, "\n");
         }
-        fclose(fdebug);
-#endif
+
+        __atomic_store_n(&writer_stop, 1, __ATOMIC_RELEASE);
+        pthread_join(writer, NULL);
+        fseek(flog, sizeof (Sig), SEEK_SET);
+        writeLeapLogHeader(flog, LEAP_LOG_GLOBAL, num_shared_vars, thread_idx - 1);
+        fclose(flog);
+        flog = NULL;
+
+        writeAtomicLogs(atomic_logs, thread_idx);
     }
 
     void OnPreLoad(int svId, int debug) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
 
-        lock(svId);
+        lockvar(svId);
 
 #ifdef DEBUG
         printf("OnPreLoad: %d at t%d [%d]\n", svId, _tid, debug);
@@ -164,27 +387,23 @@ extern "C" {
     }
 
     void OnLoad(int svId, int debug) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 #ifdef DEBUG
         printf("OnLoad\n");
 #endif
-        unlock(svId);
+        unlockvar(svId);
     }
 
     void OnPreStore(int svId, int debug) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
 
-        lock(svId);
+        lockvar(svId);
 #ifdef DEBUG        
         printf("OnPreStore: %d at t%d [%d]\n", svId, _tid, debug);
 #endif
@@ -192,40 +411,156 @@ extern "C" {
     }
 
     void OnStore(int svId, int debug) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 #ifdef DEBUG
         printf("OnStore\n");
 #endif
-        unlock(svId);
+        unlockvar(svId);
+    }
+
+    /// The slow path of -leap-inline-fast-path, see FastPath.h. The inline
+    /// code releases the lock word after the access.
+    int OnPreAccessSlow(int svId, int debug) {
+        if (!__leap_recording) {
+            return 0;
+        }
+
+        int _tid = threadid();
+
+        lockvar(svId);
+
+#ifdef DEBUG
+        printf("OnPreAccessSlow: %d at t%d [%d]\n", svId, _tid, debug);
+#endif
+        store(svId, _tid);
+        return 1;
+    }
+
+    /// -leap-profile: the shared variable was only accessed by one thread at
+    /// a time when profiled. While the thread owns it, an access only counts
+    /// itself in owned with a compare-and-swap and marks owned busy until
+    /// OnOwnerCheckEnd, after the access. The compare-and-swap fails once
+    /// another thread has taken the shared variable, which waits until the
+    /// owner is not busy; the count is added to the run of the owner when the
+    /// next event is logged, so the replayer knows how many accesses of the
+    /// owner come before it.
+    void OnOwnerCheck(int svId, int debug) {
+        if (!__leap_recording) {
+            return;
+        }
+
+        int _tid = threadid();
+
+        unsigned long long* word = &__leap_vars[svId].owned;
+        unsigned long long owned = __atomic_load_n(word, __ATOMIC_RELAXED);
+        while (LEAP_OWNED_TID(owned) == _tid && LEAP_OWNED_COUNT(owned) < LEAP_OWNED_MAX) {
+            if (__atomic_compare_exchange_n(word, &owned, (owned + 1) | LEAP_OWNED_BUSY, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                owner_check = LEAP_OWNER_CHECK_COUNTED;
+                return;
+            }
+        }
+
+        lockvar(svId);
+#ifdef DEBUG
+        printf("OnOwnerCheck: %d at t%d [%d]\n", svId, _tid, debug);
+#endif
+        store(svId, _tid);
+        owner_check = LEAP_OWNER_CHECK_LOCKED;
+    }
+
+    /// after the access of an owner check; it does not look at
+    /// __leap_recording, since OnOwnerCheck may have taken the lock before
+    /// OnExit
+    void OnOwnerCheckEnd(int svId, int debug) {
+        if (owner_check == LEAP_OWNER_CHECK_LOCKED) {
+            unlockvar(svId);
+        } else if (owner_check == LEAP_OWNER_CHECK_COUNTED) {
+            __atomic_fetch_and(&__leap_vars[svId].owned, ~LEAP_OWNED_BUSY, __ATOMIC_RELEASE);
+        }
+        owner_check = LEAP_OWNER_CHECK_NONE;
+    }
+
+    /// A region of -leap-region-coarsening: the shared variables are locked
+    /// and logged once until OnRegion.
+    void OnPreRegion(int* svIds, int num, int debug) {
+        if (!__leap_recording) {
+            return;
+        }
+
+        int _tid = threadid();
+
+        lockvars(svIds, num);
+        for (int i = 0; i < num; i++) {
+            store(svIds[i], _tid);
+        }
+#ifdef DEBUG
+        printf("OnPreRegion: %d shared variables at t%d [%d]\n", num, _tid, debug);
+#endif
+    }
+
+    void OnRegion(int* svIds, int num, int debug) {
+        if (!__leap_recording) {
+            return;
+        }
+#ifdef DEBUG
+        printf("OnRegion\n");
+#endif
+        unlockvars(svIds, num);
+    }
+
+    /// A memcpy, memmove or memset: one event for each of the (at most two)
+    /// shared variables it touches, however many bytes it copies.
+    /// svId1 < svId2, or svId2 is -1.
+    void OnPreMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnPreRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    void OnMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    /// An atomic operation (cmpxchg or atomicrmw) is ordered by the memory
+    /// itself: it takes no lock, and the value it observed is appended to the
+    /// log of the thread, see AtomicLog.h.
+    void OnPreAtomic(int svId, void* addr, int size, int debug) {
+    }
+
+    void OnAtomic(int svId, unsigned long long observed, int debug) {
+        if (!__leap_recording) {
+            return;
+        }
+
+        int _tid = threadid();
+        appendAtomic(&atomic_logs[_tid], observed);
+#ifdef DEBUG
+        printf("OnAtomic: %d at t%d observed %llu [%d]\n", svId, _tid, observed, debug);
+#endif
     }
 
     void OnPreLock(int nouse) {
 #ifdef DEBUG
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
         printf("OnPreLock[%d]\n", _tid);
 #endif
     }
 
     void OnLock(int nouse) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
+        // different mutexes share the slot, which may change its chunk
+        lockvar(num_shared_vars - 2);
         store(num_shared_vars - 2, _tid);
+        unlockvar(num_shared_vars - 2);
 #ifdef DEBUG
         printf("OnLock --> t%d\n", _tid);
 #endif
@@ -234,7 +569,7 @@ extern "C" {
 
     void OnPreUnlock(int nouse) {
 #ifdef DEBUG
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
         printf("OnpreunLock\n");
@@ -243,48 +578,41 @@ extern "C" {
 
     void OnUnlock(int nouse) {
 #ifdef DEBUG
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
         printf("OnunLock <-- t%d\n", _tid);
 #endif
     }
 
     void OnPreFork(int nouse) {
-        if (!start) {
-            start = true;
+        if (!__leap_recording) {
+            __leap_recording = 1;
             //return;
         }
 #ifdef DEBUG
         printf("OnPreFork\n");
 #endif
-        forklock(num_shared_vars - 1);
+        lockvar(num_shared_vars - 1);
+    }
+
+    /// called instead of pthread_create, between OnPreFork and OnFork
+    int __leap_pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*routine)(void*), void* arg) {
+        return createThread(thread, attr, routine, arg, threadcreate());
     }
 
     void OnFork(long forked_tid_ptr) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 
-        pthread_t ftid = *((pthread_t*) forked_tid_ptr);
-        if (threadid(ftid) == -1) {
-            threadcreate(ftid);
-        }
 #ifdef DEBUG
         printf("OnFork\n");
 #endif
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
         store(num_shared_vars - 1, _tid);
-        forkunlock(num_shared_vars - 1);
+        unlockvar(num_shared_vars - 1);
     }
 
     void OnPreJoin(int id) {
@@ -294,59 +622,53 @@ extern "C" {
     }
 
     void OnPreWait(int condId) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 #ifdef DEBUG        
         printf("OnPrewait\n");
 #endif
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
+        // different mutexes share the slot, which may change its chunk
+        lockvar(num_shared_vars - 2);
         store(num_shared_vars - 2, _tid);
+        unlockvar(num_shared_vars - 2);
     }
 
     void OnWait(int condId, long cond_ptr, long mutex_ptr) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 #ifdef DEBUG
         printf("OnWait\n");
 #endif
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
+        // different mutexes share the slot, which may change its chunk
+        lockvar(num_shared_vars - 2);
         store(num_shared_vars - 2, _tid);
+        unlockvar(num_shared_vars - 2);
     }
 
     void OnPreNotify(int condId) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 #ifdef DEBUG
         printf("OnPreNotify\n");
 #endif
-        lock(num_shared_vars - 2);
+        lockvar(num_shared_vars - 2);
     }
 
     void OnNotify(int condId) {
-        if (!start) {
+        if (!__leap_recording) {
             return;
         }
 #ifdef DEBUG
         printf("OnNotify\n");
 #endif
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
         store(num_shared_vars - 2, _tid);
-        unlock(num_shared_vars - 2);
+        unlockvar(num_shared_vars - 2);
     }
 }
 
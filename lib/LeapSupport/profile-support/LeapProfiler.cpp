@@ -0,0 +1,202 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ *
+ * A runtime for the leap transformer that does not record, but counts how
+ * many times each instrumented site runs and how often each shared variable
+ * changes its owner thread. Link the transformed bitcode file with it, run
+ * the program, and pass the profile to canary with -leap-profile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <map>
+#include "LeapSupport/SignalRoutine.h"
+#include "LeapSupport/Profile.h"
+
+static bool start = false;
+
+static int num_shared_vars = 0;
+
+static pthread_mutex_t* var_locks = NULL;
+static pthread_t* owners = NULL;
+static bool* owned = NULL;
+static unsigned long* accesses = NULL;
+static unsigned long* owner_changes = NULL;
+
+static pthread_mutex_t site_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<int, unsigned long> site_counts;
+
+void static inline profile(int svId, int debug) {
+    if (!start || svId < 0 || svId >= num_shared_vars) {
+        return;
+    }
+
+    pthread_t tid = pthread_self();
+    pthread_mutex_lock(&var_locks[svId]);
+    accesses[svId]++;
+    if (owned[svId] && !pthread_equal(owners[svId], tid)) {
+        owner_changes[svId]++;
+    }
+    owners[svId] = tid;
+    owned[svId] = true;
+    pthread_mutex_unlock(&var_locks[svId]);
+
+    pthread_mutex_lock(&site_lock);
+    site_counts[debug]++;
+    pthread_mutex_unlock(&site_lock);
+}
+
+extern "C" {
+
+    void OnInit(int svsNum) {
+        printf("OnInit-Profile\n");
+        initializeSigRoutine();
+
+        // locks, forks and waits are not profiled
+        num_shared_vars = svsNum;
+
+        var_locks = new pthread_mutex_t[num_shared_vars];
+        owners = new pthread_t[num_shared_vars];
+        owned = new bool[num_shared_vars];
+        accesses = new unsigned long[num_shared_vars];
+        owner_changes = new unsigned long[num_shared_vars];
+        for (int i = 0; i < num_shared_vars; i++) {
+            pthread_mutex_init(&var_locks[i], NULL);
+            owned[i] = false;
+            accesses[i] = 0;
+            owner_changes[i] = 0;
+        }
+
+        start = true;
+    }
+
+    void OnExit(int nouse) {
+        if (!start) {
+            return;
+        }
+        start = false;
+
+        printf("OnExit-Profile\n");
+        FILE * fout = fopen(LEAP_PROFILE_FILE, "w");
+        fprintf(fout, "leap-profile %d %d\n", LEAP_PROFILE_VERSION, num_shared_vars);
+        for (int i = 0; i < num_shared_vars; i++) {
+            if (accesses[i] > 0) {
+                fprintf(fout, "var %d %lu %lu\n", i, accesses[i], owner_changes[i]);
+            }
+        }
+
+        pthread_mutex_lock(&site_lock);
+        for (std::map<int, unsigned long>::iterator it = site_counts.begin(); it != site_counts.end(); it++) {
+            fprintf(fout, "site %d %lu\n", it->first, it->second);
+        }
+        pthread_mutex_unlock(&site_lock);
+        fclose(fout);
+    }
+
+    void OnPreLoad(int svId, int debug) {
+        profile(svId, debug);
+    }
+
+    void OnLoad(int svId, int debug) {
+    }
+
+    void OnPreStore(int svId, int debug) {
+        profile(svId, debug);
+    }
+
+    void OnStore(int svId, int debug) {
+    }
+
+    void OnOwnerCheck(int svId, int debug) {
+        profile(svId, debug);
+    }
+
+    void OnOwnerCheckEnd(int svId, int debug) {
+    }
+
+    void OnPreRegion(int* svIds, int num, int debug) {
+        for (int i = 0; i < num; i++) {
+            profile(svIds[i], debug);
+        }
+    }
+
+    void OnRegion(int* svIds, int num, int debug) {
+    }
+
+    /// A memcpy, memmove or memset: one event for each of the (at most two)
+    /// shared variables it touches, however many bytes it copies.
+    /// svId1 < svId2, or svId2 is -1.
+    void OnPreMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnPreRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    void OnMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    void OnPreAtomic(int svId, void* addr, int size, int debug) {
+        profile(svId, debug);
+    }
+
+    void OnAtomic(int svId, unsigned long long observed, int debug) {
+    }
+
+    void OnPreLock(int nouse) {
+    }
+
+    void OnLock(int nouse) {
+    }
+
+    void OnPreUnlock(int nouse) {
+    }
+
+    void OnUnlock(int nouse) {
+    }
+
+    void OnPreFork(int nouse) {
+    }
+
+    /// called instead of pthread_create; threads are told apart by pthread_self
+    int __leap_pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*routine)(void*), void* arg) {
+        return pthread_create(thread, attr, routine, arg);
+    }
+
+    void OnFork(long forked_tid_ptr) {
+    }
+
+    void OnPreJoin(int id) {
+    }
+
+    void OnJoin(int id) {
+    }
+
+    void OnPreWait(int condId) {
+    }
+
+    void OnWait(int condId, long cond_ptr, long mutex_ptr) {
+    }
+
+    void OnPreNotify(int condId) {
+    }
+
+    void OnNotify(int condId) {
+    }
+}
+
+/* ************************************************************************
+ * Signal Process
+ * ************************************************************************/
+
+void sigroutine(int dunno) {
+    printSigInformation(dunno);
+
+    OnExit(num_shared_vars);
+    exit(dunno);
+}
@@ -10,59 +10,337 @@
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
+#include <immintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <algorithm>
 
 #define POSIX_MUTEX
+// a thread waits for its turn while holding the locks of a region, so shared
+// variables sharing a lock stripe could wait for each other forever
+#define LEAP_NO_LOCK_STRIPING
 #define DEBUG
 #include "LeapSupport/Lock.h"
 #include "LeapSupport/Signature.h"
+#include "LeapSupport/AtomicLog.h"
+#include "LeapSupport/CompactLog.h"
+#include "LeapSupport/ThreadStart.h"
 
 
-#define MAX_THREAD_NUM 200
+#define MAX_THREAD_NUM (1 << 14)
+
+/* whether a global leaplog is replayed from a mapping of the file, see
+ * readWindow */
+#ifndef LEAP_REPLAY_STREAM
+#define LEAP_REPLAY_STREAM 1
+#endif
+
+/* bytes of a mapped log read ahead of the blocks scanned so far */
+#define LEAP_READAHEAD (1 << 20)
+
+/* turns[svId] before the first block of a mapped log is read */
+#define LEAP_TURN_UNKNOWN -1
 
 static bool start = false;
-static pthread_t thread_idx_map[MAX_THREAD_NUM];
 static int thread_idx = 1; //start from 1, make 0 be a terminal
 
 static unsigned **GLOG = NULL;
 static unsigned *GIDX = NULL;
+static unsigned *GLEN = NULL; // the length of each GLOG
+
+// the thread of the run at GIDX of each shared variable, 0 after the end of
+// its log. Only the thread whose turn it is reads or changes GLOG, GIDX and
+// GLEN of the shared variable; the others only read turns.
+static int *turns = NULL;
 
 static int num_shared_vars = 0;
 
-int static inline threadid(pthread_t tid) {
-    for (int i = 1; i < thread_idx; i++) {
-        if (thread_idx_map[i] == tid) {
-            return i;
+// the number of shared variables of the build that recorded the log
+static int log_shared_vars = 0;
+
+// the values observed by the atomic operations of each thread when recorded
+static AtomicLog atomic_logs[MAX_THREAD_NUM];
+
+// A thread that is not scheduled next on a shared variable spins for a while
+// and then sleeps on its own futex word. The thread that ends a run on a
+// shared variable wakes the thread of the next run, and only that one.
+typedef struct Handoff {
+    int seq; // bumped by each wake
+    int sleeping; // nonzero while the thread may sleep on seq
+} __attribute__((aligned(LEAP_CACHE_LINE))) Handoff;
+
+static Handoff handoffs[MAX_THREAD_NUM];
+
+// the bounds of the spinning before a thread sleeps; each thread adapts its
+// own between them to how long its turns took to come
+#define LEAP_MIN_SPIN 16
+#define LEAP_MAX_SPIN 16384
+
+static __thread int spin_limit = LEAP_MIN_SPIN;
+
+// an atomic operation whose recorded value does not show up in memory for this
+// long is reported instead of being waited for forever
+#ifndef LEAP_ATOMIC_STALL_SECONDS
+#define LEAP_ATOMIC_STALL_SECONDS 10
+#endif
+
+// A global leaplog is replayed from a mapping of log.replay.dat instead of
+// being read by OnInit. GLOG[svId] then holds only the block of the shared
+// variable being replayed, GIDX and GLEN are relative to it, and its next
+// block is decoded when the last run of the block ends. The headers of the
+// blocks are scanned only as far as the replay needs, and the pages of a
+// block are released once it is decoded, so the replay starts at once and its
+// memory does not grow with the log.
+static unsigned char* stream_map = NULL;
+static size_t stream_len = 0;
+static size_t stream_scanned = 0; // the offset of the first block not scanned
+static size_t stream_ahead = 0; // where the next readahead starts
+// the offsets of the scanned blocks of each shared variable not decoded yet
+static std::deque<size_t>* stream_blocks = NULL;
+static pthread_mutex_t stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/// The ids of shared variables are kept from one build to the next with
+/// -leap-ids, so a log of a build with another number of them is matched by
+/// id: only the two synchronization variables, which come last, move. Returns
+/// -1 for an id this build does not have.
+static int logVarToVar(int svId) {
+    if (svId < 0 || svId >= log_shared_vars) {
+        return -1;
+    } else if (svId >= log_shared_vars - 2) {
+        return svId - log_shared_vars + num_shared_vars;
+    } else if (svId >= num_shared_vars - 2) {
+        return -1;
+    }
+    return svId;
+}
+
+/// the shared variable of a block in this build, -1 to skip the block; a
+/// block with events of a variable this build does not have cannot be
+/// replayed
+static int blockVar(const LeapLogBlock* block) {
+    int svId = logVarToVar(block->svId);
+    if (svId == -1 && (block->svId < 0 || block->svId >= log_shared_vars || block->count > 0)) {
+        printf("Bad block of the log: shared variable %d is not in this program!\n", block->svId);
+        exit(1);
+    }
+    return svId;
+}
+
+/// maps log.replay.dat, whose first block is at the position of fin
+static bool mapLog(FILE* fin) {
+    struct stat st;
+    if (fstat(fileno(fin), &st) != 0 || st.st_size == 0) {
+        return false;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fin), 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    stream_map = (unsigned char*) map;
+    stream_len = st.st_size;
+    stream_scanned = ftell(fin);
+    stream_ahead = stream_scanned;
+    stream_blocks = new std::deque<size_t>[num_shared_vars];
+    return true;
+}
+
+static void adviseLog(size_t from, size_t to, int advice) {
+    from -= from % sysconf(_SC_PAGESIZE);
+    to = to < stream_len ? to : stream_len;
+    if (from < to) {
+        madvise(stream_map + from, to - from, advice);
+    }
+}
+
+/// pops the offset of the next block of the shared variable, scanning the
+/// blocks of the others on the way; returns false at the end of its log
+static bool nextBlock(int svId, size_t* offset) {
+    pthread_mutex_lock(&stream_mutex);
+    while (stream_blocks[svId].empty() && stream_scanned + sizeof (LeapLogBlock) <= stream_len) {
+        LeapLogBlock block;
+        memcpy(&block, stream_map + stream_scanned, sizeof (LeapLogBlock));
+        if (!checkLeapLogBlock(&block)) {
+            printf("Bad block of the log!\n");
+            exit(1);
+        }
+        int blockSvId = blockVar(&block);
+
+        size_t end = stream_scanned + sizeof (LeapLogBlock) + block.storedLen;
+        if (end > stream_len) {
+            // the recorder was killed while writing
+            break;
+        }
+        if (blockSvId != -1) {
+            stream_blocks[blockSvId].push_back(stream_scanned);
+        }
+        stream_scanned = end;
+
+        if (stream_scanned >= stream_ahead) {
+            adviseLog(stream_scanned, stream_scanned + LEAP_READAHEAD, MADV_WILLNEED);
+            stream_ahead = stream_scanned + LEAP_READAHEAD / 2;
         }
     }
 
-    return -1;
+    bool found = !stream_blocks[svId].empty();
+    if (found) {
+        *offset = stream_blocks[svId].front();
+        stream_blocks[svId].pop_front();
+    }
+    pthread_mutex_unlock(&stream_mutex);
+    return found;
 }
 
-void static inline threadcreate(pthread_t tid) {
-    thread_idx_map[thread_idx++] = tid;
+/// replaces GLOG[svId] with the next block of the shared variable; returns
+/// false at the end of its log
+static bool readWindow(int svId) {
+    size_t offset;
+    while (nextBlock(svId, &offset)) {
+        LeapLogBlock block;
+        memcpy(&block, stream_map + offset, sizeof (LeapLogBlock));
+        if (block.count == 0) {
+            continue;
+        }
+
+        unsigned* window = (unsigned*) realloc(GLOG[svId], sizeof (unsigned) * block.count);
+        if (window == NULL) {
+            printf("Cannot allocate the window of a log!\n");
+            exit(1);
+        }
+        GLOG[svId] = window;
+
+        size_t end = offset + sizeof (LeapLogBlock) + block.storedLen;
+        if (!decodeLeapLogBlock(stream_map + offset + sizeof (LeapLogBlock), LEAP_LOG_GLOBAL, &block, window)) {
+            printf("Bad block of the log!\n");
+            exit(1);
+        }
+        adviseLog(offset, end, MADV_DONTNEED);
+
+        GIDX[svId] = 0;
+        GLEN[svId] = block.count;
+        return true;
+    }
+
+    free(GLOG[svId]);
+    GLOG[svId] = NULL;
+    GIDX[svId] = 0;
+    GLEN[svId] = 0;
+    return false;
 }
 
-void static inline load(int svId, int tid) {
+/// the thread of the first run of a shared variable of a mapped log; the
+/// first thread waiting for it reads its first block
+static int firstTurn(int svId) {
+    lock(svId);
+    int first = __atomic_load_n(&turns[svId], __ATOMIC_SEQ_CST);
+    if (first == LEAP_TURN_UNKNOWN) {
+        first = readWindow(svId) ? GLOG[svId][0] : 0;
+        __atomic_store_n(&turns[svId], first, __ATOMIC_SEQ_CST);
+    }
+    unlock(svId);
+    return first;
+}
+
+/// the id of a new thread
+int static inline threadcreate() {
+    if (thread_idx >= MAX_THREAD_NUM) {
+        printf("Too many threads!\n");
+        exit(0);
+    }
+    return thread_idx++;
+}
+
+bool static inline turn(int svId, int tid) {
+    int current = __atomic_load_n(&turns[svId], __ATOMIC_SEQ_CST);
+    if (current == LEAP_TURN_UNKNOWN) {
+        current = firstTurn(svId);
+    }
+    return current == tid;
+}
+
+/// waits until the next event of the shared variable is of the thread
+void static inline waitturn(int svId, int tid) {
+    int spins = 0;
+    bool slept = false;
 #ifdef DEBUG
     int count = 0;
 #endif
-    int currentIdx = GIDX[svId];
-    while (GLOG[svId][currentIdx] != (unsigned) tid) {
+    while (!turn(svId, tid)) {
+        if (spins < spin_limit) {
+            spins++;
+            _mm_pause();
+            continue;
+        }
+
 #ifdef DEBUG
         if (count++ < 2) {
-            fprintf(stdout, "#### %d, t%d is waiting for t%d\n", svId, tid, GLOG[svId][currentIdx]);
+            fprintf(stdout, "#### %d, t%d is waiting for t%d\n", svId, tid, turns[svId]);
             fflush(stdout);
         }
 #endif
-        wait(svId);
-        currentIdx = GIDX[svId];
+        // see handoff for the order of the accesses
+        Handoff& h = handoffs[tid];
+        __atomic_store_n(&h.sleeping, 1, __ATOMIC_SEQ_CST);
+        int seq = __atomic_load_n(&h.seq, __ATOMIC_SEQ_CST);
+        if (!turn(svId, tid)) {
+            syscall(SYS_futex, &h.seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+        }
+        __atomic_store_n(&h.sleeping, 0, __ATOMIC_RELAXED);
+        slept = true;
+    }
+
+    if (slept) {
+        spin_limit = spin_limit / 2 > LEAP_MIN_SPIN ? spin_limit / 2 : LEAP_MIN_SPIN;
+    } else if (spins > 0) {
+        spin_limit += (2 * spins - spin_limit) / 8;
+        spin_limit = spin_limit < LEAP_MAX_SPIN ? spin_limit : LEAP_MAX_SPIN;
+    }
+}
+
+/// ends the run of the current thread on the shared variable, and wakes the
+/// thread of the next run if it sleeps
+void static inline handoff(int svId, unsigned nextIdx) {
+    GIDX[svId] = nextIdx;
+    if (nextIdx >= GLEN[svId] && stream_map != NULL) {
+        readWindow(svId);
+    }
+
+    // a sleeping thread stores sleeping before it checks its turn, and turns
+    // is stored before sleeping is loaded, so either it sees its turn or it
+    // is woken
+    unsigned next = GIDX[svId] < GLEN[svId] ? GLOG[svId][GIDX[svId]] : 0;
+    __atomic_store_n(&turns[svId], (int) next, __ATOMIC_SEQ_CST);
+    if (next == 0 || next >= MAX_THREAD_NUM) {
+        return;
     }
 
-    if (GLOG[svId][currentIdx] == (unsigned) tid && GLOG[svId][currentIdx + 1] > 0) {
+    Handoff& h = handoffs[next];
+    __atomic_add_fetch(&h.seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&h.sleeping, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &h.seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/// waits for the turn of the thread, locks the shared variable and replays
+/// the event; the caller unlocks it after the access
+void static inline load(int svId, int tid) {
+    waitturn(svId, tid);
+    lock(svId);
+
+    unsigned currentIdx = GIDX[svId];
+    if (GLOG[svId][currentIdx + 1] > 0) {
         // do the event
         GLOG[svId][currentIdx + 1]--;
         if (GLOG[svId][currentIdx + 1] == 0) {
-            GIDX[svId] += 2;
+            handoff(svId, currentIdx + 2);
         }
     } else {
         //error
@@ -71,6 +349,83 @@ void static inline load(int svId, int tid) {
     }
 }
 
+// the log of a thread for a shared variable, pairs of <first index, number
+// of consecutive indices> in the order of the indices; entries is allocated
+// with malloc
+typedef struct LocalLog {
+    int tid;
+    unsigned* entries;
+    unsigned count;
+} LocalLog;
+
+#ifdef DEBUG
+static void dumpLocalLogs(std::vector<LocalLog>* locals) {
+    FILE* fdebug = fopen("log3.debug", "w+");
+    for (int i = 0; i < num_shared_vars; i++) {
+        fprintf(fdebug, "SV%d: \n", i);
+        for (unsigned k = 0; k < locals[i].size(); k++) {
+            fprintf(fdebug, "T%d: ", locals[i][k].tid);
+            for (unsigned j = 0; j < locals[i][k].count; j++) {
+                fprintf(fdebug, "%d, ", locals[i][k].entries[j]);
+            }
+            fprintf(fdebug, "\n");
+        }
+    }
+    fclose(fdebug);
+}
+#endif
+
+/// builds GLOG[svId] from the local logs of the shared variable with a k-way
+/// merge on the first indices, O(n log k) for n pairs in k logs, and frees
+/// them
+static void mergeLocalLogs(int svId, std::vector<LocalLog>& logs) {
+    unsigned total = 0;
+    for (unsigned k = 0; k < logs.size(); k++) {
+        total += logs[k].count;
+    }
+    unsigned * glog = new unsigned[total];
+    GLOG[svId] = glog;
+
+    // <the first index of the next pair of a log, the log>
+    typedef std::pair<unsigned, unsigned> Head;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads;
+    std::vector<unsigned> next(logs.size(), 0);
+    for (unsigned k = 0; k < logs.size(); k++) {
+        if (logs[k].count >= 2) {
+            heads.push(Head(logs[k].entries[0], k));
+        }
+    }
+
+    unsigned glogIdx = 0;
+    unsigned end = 0; // the end of the indices merged so far
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+
+        LocalLog& log = logs[head.second];
+        unsigned& j = next[head.second];
+        if (glogIdx > 0 && head.first < end) {
+            printf("ERROR when construct GLOG - overlapping indices of %d\n", svId);
+            exit(1);
+        }
+        glog[glogIdx] = log.tid;
+        glog[glogIdx + 1] = log.entries[j + 1];
+        glogIdx += 2;
+        end = head.first + log.entries[j + 1];
+
+        j += 2;
+        if (j + 1 < log.count) {
+            heads.push(Head(log.entries[j], head.second));
+        }
+    }
+    GIDX[svId] = glogIdx;
+
+    for (unsigned k = 0; k < logs.size(); k++) {
+        free(logs[k].entries);
+    }
+    logs.clear();
+}
+
 static void sigroutine(int dunno);
 
 extern "C" {
@@ -85,17 +440,16 @@ extern "C" {
         //start = true;
         num_shared_vars = svsNum + 2;
 
-        for (int i = 0; i < MAX_THREAD_NUM; i++) {
-            thread_idx_map[i] = 0;
-        }
-
         initialize(num_shared_vars); // init locks
 
         GIDX = new unsigned[num_shared_vars];
+        GLEN = new unsigned[num_shared_vars];
         GLOG = new unsigned*[num_shared_vars];
+        turns = new int[num_shared_vars];
 
         for (int i = 0; i < num_shared_vars; i++) {
             GIDX[i] = 0;
+            GLOG[i] = NULL;
         }
 
         FILE* fin = fopen("log.replay.dat", "rb");
@@ -112,124 +466,97 @@ extern "C" {
                 GLOG[i] = new unsigned[GIDX[i]];
                 fread(GLOG[i], sizeof (unsigned), GIDX[i], fin);
             }
-        } else if (strcmp(sig->recorder, "tsxleap") == 0) {
-            // read data
-            int TIDX = 0;
-            unsigned ** LIDX = new unsigned*[MAX_THREAD_NUM];
-            unsigned *** LLOG = new unsigned**[MAX_THREAD_NUM];
-            while (!feof(fin)) {
-                LIDX[TIDX] = new unsigned[num_shared_vars];
-                int count = fread(LIDX[TIDX], sizeof (unsigned), num_shared_vars, fin);
-                if(count != num_shared_vars){
-                    delete [] LIDX[TIDX];
-                    break;
-                }
-
-                LLOG[TIDX] = new unsigned*[num_shared_vars];
-                for (int i = 0; i < num_shared_vars; i++) {
-                    LLOG[TIDX][i] = new unsigned[LIDX[TIDX][i]];
-                    fread(LLOG[TIDX][i], sizeof (unsigned), LIDX[TIDX][i], fin);
-                    GIDX[i] = GIDX[i] + LIDX[TIDX][i];
-                }
-
-                TIDX++;
+        } else if (strcmp(sig->recorder, LEAP_LOG_SIG) == 0) {
+            LeapLogHeader header;
+            if (fread(&header, sizeof (LeapLogHeader), 1, fin) != 1 || header.version != LEAP_LOG_VERSION
+                    || header.numSharedVars < 2 || header.numThreads >= MAX_THREAD_NUM) {
+                printf("Bad header of the log: not recorded by this version or this program!\n");
+                exit(1);
+            }
+            log_shared_vars = header.numSharedVars;
+            if (log_shared_vars != num_shared_vars) {
+                printf("The log has %d shared variables and this program %d: they are matched by id.\n",
+                        log_shared_vars - 2, num_shared_vars - 2);
             }
-#ifdef DEBUG
-            FILE* fdebug = fopen("log3.debug", "w+");
 
-            for (int i = 0; i < TIDX; i++) {
-                fprintf(fdebug, "T%d: \n", i+1);
-                fprintf(fdebug, "LIDX: \n");
-                for (int j = 0; j < num_shared_vars; j++) {
-                    fprintf(fdebug, "%d, ", LIDX[i][j]);
-                }
-                fprintf(fdebug, "\nLLOG: \n");
+            if (header.kind == LEAP_LOG_GLOBAL && LEAP_REPLAY_STREAM && mapLog(fin)) {
+                // the blocks are decoded as they are replayed, see readWindow
+            } else {
+                // blocks are decoded one by one as they are read
+                int TIDX = header.numThreads;
+                std::vector<unsigned>* logs = new std::vector<unsigned>[num_shared_vars];
+                std::vector<LocalLog>* locals = new std::vector<LocalLog>[num_shared_vars];
+                LeapLogBlock block;
+                unsigned* entries = NULL;
+                while (readLeapLogBlock(fin, header.kind, &block, &entries)) {
+                    if (header.kind == LEAP_LOG_LOCAL && (block.thread < 1 || block.thread > TIDX)) {
+                        printf("Bad block of the log!\n");
+                        exit(1);
+                    }
+                    block.svId = blockVar(&block);
+                    if (block.svId == -1) {
+                        free(entries);
+                        continue;
+                    }
 
-                for (int j = 0; j < num_shared_vars; j++) {
-                    for (unsigned k = 0; k < LIDX[i][j]; k++) {
-                        fprintf(fdebug, "%d, ", LLOG[i][j][k]);
+                    if (header.kind == LEAP_LOG_LOCAL) {
+                        // a block of a thread is merged as it is
+                        LocalLog local = {block.thread, entries, block.count};
+                        locals[block.svId].push_back(local);
+                    } else {
+                        logs[block.svId].insert(logs[block.svId].end(), entries, entries + block.count);
+                        free(entries);
                     }
                 }
-                fprintf(fdebug, "\n");
-            }
 
-            fclose(fdebug);
+                if (header.kind == LEAP_LOG_LOCAL) {
+#ifdef DEBUG
+                    dumpLocalLogs(locals);
 #endif
-
-            // construct GLOG
-            for (int i = 0; i < num_shared_vars; i++) {
-                if(GIDX[i] == 0) continue;
-                
-                unsigned * glog = new unsigned[GIDX[i]];
-                GLOG[i] = glog;
-                int glogIdx = 0;
-                for (int t = 0; t < TIDX; t++) {
-                    unsigned * llog = LLOG[t][i];
-                    int num = LIDX[t][i]/2;
-                    for(int j = 0; j < num; j++){
-                        // insert llog[2*j] and llog[2*j+1] into GLOG[i]
-                        // find the pos
-                        int pos = 0;
-                        for(; pos<glogIdx; pos+=2){
-                            if(glog[pos] > llog[2*j]){
-                                break;
-                            }
-                        }
-                        
-                        // elmts from pos to GIDX[i]
-                        for(int k = glogIdx - 1; k>=pos; k-- ){
-                            glog[k+2] = glog[k];
-                        }
-                        
-                        // insert
-                        glog[pos] = llog[2*j];
-                        glog[pos+1] = llog[2*j+1];
-                        
-                        // increase the length
-                        glogIdx+=2;
-                        
-                        if(((unsigned) glogIdx) > GIDX[i]){
-                            printf("ERROR when construct GLOG - ERR1\n");
-                            exit(1);
-                        }
+                    for (int i = 0; i < num_shared_vars; i++) {
+                        mergeLocalLogs(i, locals[i]);
                     }
-                }
-                // replace each lidx with a thread id;
-                for(int k = 0; k<glogIdx/2; k++){
-                    // lidx = glog[k*2];
-                    bool found = false;
-                    for(int t = 0; t< TIDX; t++){
-                        unsigned * llog = LLOG[t][i];
-                        int num = LIDX[t][i]/2;
-                        for(int j = 0; j < num; j++){
-                            if(llog[j*2] == glog[k*2]){
-                                glog[k*2] = t + 1; // tid from 1
-                                found = true;
-                                break;
-                            }
-                        }
-                        if(found)
-                            break;
-                    }
-                    if(!found){
-                        printf("ERROR when construct GLOG - ERR2\n");
-                        exit(1);
+                } else {
+                    for (int i = 0; i < num_shared_vars; i++) {
+                        GIDX[i] = logs[i].size();
+                        GLOG[i] = new unsigned[GIDX[i]];
+                        std::copy(logs[i].begin(), logs[i].end(), GLOG[i]);
                     }
                 }
+                delete[] logs;
+                delete[] locals;
             }
-            // release memory
-            for (int i = 0; i < TIDX; i++) {
-                for (int j = 0; j < num_shared_vars; j++) {
-                    delete[] LLOG[i][j];
+        } else if (strcmp(sig->recorder, "tsxleap") == 0) {
+            // read data: the lengths of the logs of a thread, then the logs
+            int TIDX = 0;
+            unsigned * LIDX = new unsigned[num_shared_vars];
+            std::vector<LocalLog>* locals = new std::vector<LocalLog>[num_shared_vars];
+            while (!feof(fin) && TIDX + 1 < MAX_THREAD_NUM) {
+                int count = fread(LIDX, sizeof (unsigned), num_shared_vars, fin);
+                if(count != num_shared_vars){
+                    break;
+                }
+
+                TIDX++;
+                for (int i = 0; i < num_shared_vars; i++) {
+                    unsigned* entries = (unsigned*) malloc(sizeof (unsigned) * LIDX[i] + 1);
+                    if (entries == NULL) {
+                        printf("Cannot allocate the log of a thread!\n");
+                        exit(1);
+                    }
+                    LocalLog local = {TIDX, entries, (unsigned) fread(entries, sizeof (unsigned), LIDX[i], fin)};
+                    locals[i].push_back(local);
                 }
-                delete[] LLOG[i];
             }
-            delete [] LLOG;
+            delete[] LIDX;
 
-            for (int i = 0; i < TIDX; i++) {
-                delete [] LIDX[i];
+#ifdef DEBUG
+            dumpLocalLogs(locals);
+#endif
+            for (int i = 0; i < num_shared_vars; i++) {
+                mergeLocalLogs(i, locals[i]);
             }
-            delete [] LIDX;
+            delete[] locals;
         } else {
             printf("Bad signature!\n");
             fclose(fin);
@@ -255,13 +582,21 @@ extern "C" {
 #endif        
 
         for (int i = 0; i < num_shared_vars; i++) {
+            GLEN[i] = GIDX[i];
             GIDX[i] = 0;
+            if (stream_map != NULL) {
+                turns[i] = LEAP_TURN_UNKNOWN;
+            } else {
+                turns[i] = GLEN[i] > 0 ? GLOG[i][0] : 0;
+            }
         }
-        // main thread.
-        pthread_t tid = pthread_self();
-        if (threadid(tid) == -1) {
-            threadcreate(tid);
+
+        if (!readAtomicLogs(atomic_logs, MAX_THREAD_NUM)) {
+            printf("No atomic operations are replayed: cannot read %s!\n", LEAP_ATOMIC_LOG_FILE);
         }
+
+        // main thread.
+        __leap_tid = threadcreate();
     }
 
     void OnExit(int nouse) {
@@ -274,12 +609,7 @@ extern "C" {
         if (!start) {
             return;
         }
-        lock(svId);
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
 
         load(svId, _tid);
 #ifdef DEBUG
@@ -300,12 +630,7 @@ extern "C" {
         if (!start) {
             return;
         }
-        lock(svId);
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
         load(svId, _tid);
 
 #ifdef DEBUG        
@@ -322,18 +647,125 @@ extern "C" {
         unlock(svId);
     }
 
-    void OnPreLock(int nouse) {
+    /// The accesses of the owner thread are counted in its run, see the
+    /// recorder, so each one is replayed as an event, which ends after the
+    /// access in OnOwnerCheckEnd.
+    void OnOwnerCheck(int svId, int debug) {
         if (!start) {
             return;
         }
+        int _tid = threadid();
 
-        lock(num_shared_vars - 2);
+        load(svId, _tid);
+#ifdef DEBUG
+        printf("OnOwnerCheck: %d at t%d [%d]\n", svId, _tid, debug);
+#endif
+    }
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+    void OnOwnerCheckEnd(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+        unlock(svId);
+    }
+
+    /// A region is logged once for each of its shared variables, so the
+    /// thread waits for its turn on all of them, in the recorded lock order.
+    void OnPreRegion(int* svIds, int num, int debug) {
+        if (!start) {
+            return;
+        }
+        int _tid = threadid();
+
+        for (int i = 0; i < num; i++) {
+            load(svIds[i], _tid);
+        }
+#ifdef DEBUG
+        printf("OnPreRegion: %d shared variables at t%d [%d]\n", num, _tid, debug);
+#endif
+    }
+
+    void OnRegion(int* svIds, int num, int debug) {
+        if (!start) {
+            return;
+        }
+
+        for (int i = num - 1; i >= 0; i--) {
+            unlock(svIds[i]);
+        }
+    }
+
+    /// A memcpy, memmove or memset: one event for each of the (at most two)
+    /// shared variables it touches, however many bytes it copies.
+    /// svId1 < svId2, or svId2 is -1.
+    void OnPreMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnPreRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    void OnMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    /// Waits until the memory holds the value the atomic operation observed
+    /// when recorded, so that it has the same outcome, see AtomicLog.h.
+    void OnPreAtomic(int svId, void* addr, int size, int debug) {
+        if (!start) {
+            return;
+        }
+
+        int _tid = threadid();
+        AtomicLog& log = atomic_logs[_tid];
+        if (log.idx >= log.capacity) {
+            return;
+        }
+
+        unsigned long long expected = log.values[log.idx];
+        struct timespec begin;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        for (unsigned spins = 1; loadAtomic(addr, size) != expected; spins++) {
+            sched_yield();
+            if (spins % 1024 != 0) {
+                continue;
+            }
+
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (now.tv_sec - begin.tv_sec >= LEAP_ATOMIC_STALL_SECONDS) {
+                printf("ERROR when replay atomic operation: %d at t%d [%d] expects %llu but memory holds %llu\n",
+                        svId, _tid, debug, expected, loadAtomic(addr, size));
+                exit(1);
+            }
+        }
+#ifdef DEBUG
+        printf("OnPreAtomic: %d at t%d expects %llu [%d]\n", svId, _tid, expected, debug);
+#endif
+    }
+
+    void OnAtomic(int svId, unsigned long long observed, int debug) {
+        if (!start) {
+            return;
+        }
+
+        int _tid = threadid();
+        AtomicLog& log = atomic_logs[_tid];
+        if (log.idx >= log.capacity) {
+            return;
+        }
+
+        if (log.values[log.idx] != observed) {
+            printf("ERROR when replay atomic operation: %d at t%d [%d]\n", svId, _tid, debug);
+        }
+        log.idx++;
+    }
+
+    void OnPreLock(int nouse) {
+        if (!start) {
+            return;
+        }
+
+        int _tid = threadid();
 
         load(num_shared_vars - 2, _tid);
 #ifdef DEBUG
@@ -347,7 +779,7 @@ extern "C" {
         }
 
 #ifdef DEBUG
-        int _tid = threadid(pthread_self());
+        int _tid = threadid();
         printf("OnLock --> t%d\n", _tid);
 #endif
 
@@ -368,11 +800,7 @@ extern "C" {
         if (!start) {
             return;
         }
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
         printf("OnunLock <-- t%d\n", _tid);
 #endif
     }
@@ -385,26 +813,20 @@ extern "C" {
 #ifdef DEBUG
         printf("OnPreFork\n");
 #endif
-        lock(num_shared_vars - 1);
-
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
         load(num_shared_vars - 1, _tid);
     }
 
+    /// called instead of pthread_create, between OnPreFork and OnFork
+    int __leap_pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*routine)(void*), void* arg) {
+        return createThread(thread, attr, routine, arg, threadcreate());
+    }
+
     void OnFork(long forked_tid_ptr) {
         if (!start) {
             return;
         }
 
-        pthread_t ftid = *((pthread_t*) forked_tid_ptr);
-        if (threadid(ftid) == -1) {
-            threadcreate(ftid);
-        }
-
 #ifdef DEBUG
         printf("OnFork\n");
 #endif
@@ -423,12 +845,7 @@ extern "C" {
             return;
         }
 
-        lock(num_shared_vars - 2);
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
 
         load(num_shared_vars - 2, _tid);
 #ifdef DEBUG
@@ -455,17 +872,12 @@ extern "C" {
             return;
         }
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
 
 #ifdef DEBUG        
         printf("OnPrewait\n");
 #endif
 
-        lock(num_shared_vars - 2);
         load(num_shared_vars - 2, _tid);
         unlock(num_shared_vars - 2);
 
@@ -477,14 +889,9 @@ extern "C" {
             return;
         }
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
+        int _tid = threadid();
 
-        int currentIdx = GIDX[num_shared_vars - 2];
-        while (GLOG[num_shared_vars - 2][currentIdx] != (unsigned)_tid) {
+        while (!turn(num_shared_vars - 2, _tid)) {
             //wait;
             //printf("#### %d\n", num_shared_vars - 2);
             struct timespec tv;
@@ -492,14 +899,14 @@ extern "C" {
             tv.tv_nsec = 50000000; //50ms
             pthread_cond_signal((pthread_cond_t*) cond_ptr);
             pthread_cond_wait((pthread_cond_t*) cond_ptr, (pthread_mutex_t*) mutex_ptr);
-            currentIdx = GIDX[num_shared_vars - 2];
         }
 
-        if (GLOG[num_shared_vars - 2][currentIdx] == (unsigned)_tid && GLOG[num_shared_vars - 2][currentIdx + 1] > 0) {
+        unsigned currentIdx = GIDX[num_shared_vars - 2];
+        if (GLOG[num_shared_vars - 2][currentIdx + 1] > 0) {
             // do the event
             GLOG[num_shared_vars - 2][currentIdx + 1]--;
             if (GLOG[num_shared_vars - 2][currentIdx + 1] == 0) {
-                GIDX[num_shared_vars - 2] += 2;
+                handoff(num_shared_vars - 2, currentIdx + 2);
             }
         } else {
             //error
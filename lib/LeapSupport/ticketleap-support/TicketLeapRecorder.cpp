@@ -0,0 +1,409 @@
+/*
+ * A leap recorder without mutexes. Each shared variable has a ticket counter:
+ * a thread takes the next ticket with an atomic fetch-add, waits until the
+ * ticket is served, accesses the shared variable and serves the next one.
+ * The ticket is the position of the access in the order of the shared
+ * variable, so, as in the tsx recorder, each thread appends <first ticket,
+ * number of consecutive tickets> pairs to its own logs without locking, and
+ * the replayer merges them (local logs, see CompactLog.h).
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+#include "LeapSupport/Signature.h"
+#include "LeapSupport/AtomicLog.h"
+#include "LeapSupport/CompactLog.h"
+#include "LeapSupport/Records.h"
+#include "LeapSupport/SignalRoutine.h"
+#include "LeapSupport/ThreadLogs.h"
+#include "LeapSupport/ThreadStart.h"
+
+typedef struct c_thread {
+    int pseudo_tid;
+    LeapThreadLogs logs; // of the shared variables the thread accessed
+} c_thread_t;
+
+// the replayer numbers the threads from 1 below its MAX_THREAD_NUM
+#define MAX_THREAD_NUM (1 << 14)
+
+// the c_thread_t of each thread id - 1, created by the thread at its first
+// event
+static c_thread_t** threads = NULL;
+static bool start = false;
+static int thread_idx = 0;
+
+// the record of each shared variable, on its own cache line
+typedef struct TicketLeapVar {
+    unsigned next; // the next ticket to take
+    unsigned serving; // the ticket that may access the shared variable
+} __attribute__((aligned(LEAP_CACHE_LINE))) TicketLeapVar;
+
+static TicketLeapVar *vars = NULL;
+
+static int num_shared_vars = 0;
+
+// the values observed by the atomic operations of each thread, from 1
+static AtomicLog atomic_logs[MAX_THREAD_NUM + 1];
+
+static struct timeval tpstart, tpend;
+
+/// the id of a new thread
+int static inline threadcreate() {
+    if (thread_idx + 1 >= MAX_THREAD_NUM) {
+        printf("Too many threads: the replayer takes at most %d!\n", MAX_THREAD_NUM - 1);
+        exit(1);
+    }
+
+    // OnExit reads it while threads are created
+    __atomic_store_n(&thread_idx, thread_idx + 1, __ATOMIC_RELEASE);
+    return thread_idx;
+}
+
+/// the c_thread_t of the caller, whose id is tid
+static inline c_thread_t* currentthread(int tid) {
+    c_thread_t* current = threads[tid - 1];
+    if (current != NULL) {
+        return current;
+    }
+
+    current = new c_thread_t;
+    initThreadLogs(&current->logs);
+    current->pseudo_tid = tid;
+    __atomic_store_n(&threads[tid - 1], current, __ATOMIC_RELEASE);
+    return current;
+}
+
+/// waits until the shared variable is free for the caller
+void static inline acquire(int svId) {
+    TicketLeapVar& var = vars[svId];
+    unsigned ticket = __sync_fetch_and_add(&var.next, 1);
+    while (__atomic_load_n(&var.serving, __ATOMIC_ACQUIRE) != ticket) {
+        sched_yield();
+    }
+}
+
+/// lets the next ticket access the shared variable; returns the caller's
+unsigned static inline release(int svId) {
+    TicketLeapVar& var = vars[svId];
+    unsigned ticket = var.serving;
+    __atomic_store_n(&var.serving, ticket + 1, __ATOMIC_RELEASE);
+    return ticket;
+}
+
+/// appends a ticket to the log of the thread, which only the thread writes
+void static inline store(int svId, int tid, unsigned ticket) {
+    appendThreadLog(&currentthread(tid)->logs, svId, ticket);
+}
+
+extern "C" {
+
+    void OnInit(int svsNum) {
+        printf("OnInit-Record\n");
+        initializeSigRoutine();
+
+        num_shared_vars = svsNum + 2; // one for fork, and the other is for synchronizations
+
+        threads = (c_thread_t**) calloc(MAX_THREAD_NUM, sizeof (c_thread_t*));
+        if (threads == NULL) {
+            printf("Cannot allocate the threads!\n");
+            exit(1);
+        }
+
+        // all fields are 0, see Records.h
+        vars = (TicketLeapVar*) allocateRecords(num_shared_vars, sizeof (TicketLeapVar));
+
+        // main thread.
+        __leap_tid = threadcreate();
+
+        gettimeofday(&tpstart, NULL);
+    }
+
+    void OnExit(int nouse) {
+        start = false;
+
+        gettimeofday(&tpend, NULL);
+        double timeuse = 1000000 * (tpend.tv_sec - tpstart.tv_sec) + tpend.tv_usec - tpstart.tv_usec;
+        timeuse /= 1000;
+        printf("processor time is %lf ms\n", timeuse);
+
+        Sig* sig = new Sig;
+        strcpy(sig->recorder, LEAP_LOG_SIG);
+
+        FILE * fout = fopen("log.replay.dat", "wb");
+        if (fout == NULL) {
+            printf("Cannot write the log: log.replay.dat!\n");
+            exit(1);
+        }
+        printf("OnExit-Record\n");
+
+        fwrite(sig, sizeof (Sig), 1, fout);
+        int num = __atomic_load_n(&thread_idx, __ATOMIC_ACQUIRE);
+        writeLeapLogHeader(fout, LEAP_LOG_LOCAL, num_shared_vars, num);
+        for (int i = 0; i < num; i++) {
+            c_thread_t* current = __atomic_load_n(&threads[i], __ATOMIC_ACQUIRE);
+            if (current != NULL) {
+                writeThreadLogs(fout, &current->logs, current->pseudo_tid);
+            }
+        }
+
+        fclose(fout);
+
+        writeAtomicLogs(atomic_logs, num + 1);
+    }
+
+    void OnPreLoad(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+
+        acquire(svId);
+#ifdef DEBUG
+        printf("OnPreLoad\n");
+#endif
+    }
+
+    void OnLoad(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+
+        unsigned ticket = release(svId);
+        int _tid = threadid();
+        store(svId, _tid, ticket);
+#ifdef DEBUG
+        printf("OnLoad: %d at t%d [%d]\n", svId, _tid, debug);
+#endif
+    }
+
+    void OnPreStore(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+
+        acquire(svId);
+#ifdef DEBUG
+        printf("OnPreStore\n");
+#endif
+    }
+
+    void OnStore(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+
+        unsigned ticket = release(svId);
+        int _tid = threadid();
+        store(svId, _tid, ticket);
+#ifdef DEBUG
+        printf("OnStore: %d at t%d [%d]\n", svId, _tid, debug);
+#endif
+    }
+
+    /// The replayer needs the accesses of the owner thread in order with the
+    /// others, and they have no ticket unless they take one, so an owner
+    /// check is recorded like any other access: the ticket is held until
+    /// OnOwnerCheckEnd, after the access.
+    void OnOwnerCheck(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+
+        acquire(svId);
+    }
+
+    void OnOwnerCheckEnd(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+
+        unsigned ticket = release(svId);
+        store(svId, threadid(), ticket);
+    }
+
+    /// svIds are ascending, so that threads take the tickets of a region in
+    /// the same order
+    void OnPreRegion(int* svIds, int num, int debug) {
+        if (!start) {
+            return;
+        }
+
+        for (int i = 0; i < num; i++) {
+            acquire(svIds[i]);
+        }
+#ifdef DEBUG
+        printf("OnPreRegion\n");
+#endif
+    }
+
+    void OnRegion(int* svIds, int num, int debug) {
+        if (!start) {
+            return;
+        }
+
+        unsigned tickets[num];
+        for (int i = num - 1; i >= 0; i--) {
+            tickets[i] = release(svIds[i]);
+        }
+
+        int _tid = threadid();
+        for (int i = 0; i < num; i++) {
+            store(svIds[i], _tid, tickets[i]);
+        }
+#ifdef DEBUG
+        printf("OnRegion: %d shared variables at t%d [%d]\n", num, _tid, debug);
+#endif
+    }
+
+    /// A memcpy, memmove or memset: one event for each of the (at most two)
+    /// shared variables it touches, however many bytes it copies.
+    /// svId1 < svId2, or svId2 is -1.
+    void OnPreMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnPreRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    void OnMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    /// An atomic operation (cmpxchg or atomicrmw) is ordered by the memory
+    /// itself: it takes no ticket, and the value it observed is appended to
+    /// the log of the thread, see AtomicLog.h.
+    void OnPreAtomic(int svId, void* addr, int size, int debug) {
+    }
+
+    void OnAtomic(int svId, unsigned long long observed, int debug) {
+        if (!start) {
+            return;
+        }
+
+        int _tid = threadid();
+        appendAtomic(&atomic_logs[_tid], observed);
+#ifdef DEBUG
+        printf("OnAtomic: %d at t%d observed %llu [%d]\n", svId, _tid, observed, debug);
+#endif
+    }
+
+    void OnPreLock(int nouse) {
+    }
+
+    void OnLock(int nouse) {
+        if (!start) {
+            return;
+        }
+
+        acquire(num_shared_vars - 2);
+        unsigned ticket = release(num_shared_vars - 2);
+        int _tid = threadid();
+        store(num_shared_vars - 2, _tid, ticket);
+#ifdef DEBUG
+        printf("OnLock --> t%d\n", _tid);
+#endif
+    }
+
+    void OnPreUnlock(int nouse) {
+    }
+
+    void OnUnlock(int nouse) {
+    }
+
+    void OnPreFork(int nouse) {
+        if (!start) {
+            start = true;
+        }
+#ifdef DEBUG
+        printf("OnPreFork\n");
+#endif
+        acquire(num_shared_vars - 1);
+    }
+
+    /// called instead of pthread_create, between OnPreFork and OnFork
+    int __leap_pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*routine)(void*), void* arg) {
+        return createThread(thread, attr, routine, arg, threadcreate());
+    }
+
+    void OnFork(long forked_tid_ptr) {
+        if (!start) {
+            return;
+        }
+
+#ifdef DEBUG
+        printf("OnFork\n");
+#endif
+        unsigned ticket = release(num_shared_vars - 1);
+        store(num_shared_vars - 1, threadid(), ticket);
+    }
+
+    void OnPreJoin(int id) {
+    }
+
+    void OnJoin(int id) {
+    }
+
+    void OnPreWait(int condId) {
+        if (!start) {
+            return;
+        }
+#ifdef DEBUG
+        printf("OnPrewait\n");
+#endif
+        acquire(num_shared_vars - 2);
+        unsigned ticket = release(num_shared_vars - 2);
+        store(num_shared_vars - 2, threadid(), ticket);
+    }
+
+    void OnWait(int condId, long cond_ptr, long mutex_ptr) {
+        if (!start) {
+            return;
+        }
+#ifdef DEBUG
+        printf("OnWait\n");
+#endif
+        acquire(num_shared_vars - 2);
+        unsigned ticket = release(num_shared_vars - 2);
+        store(num_shared_vars - 2, threadid(), ticket);
+    }
+
+    void OnPreNotify(int condId) {
+        if (!start) {
+            return;
+        }
+#ifdef DEBUG
+        printf("OnPreNotify\n");
+#endif
+        acquire(num_shared_vars - 2);
+    }
+
+    void OnNotify(int condId) {
+        if (!start) {
+            return;
+        }
+#ifdef DEBUG
+        printf("OnNotify\n");
+#endif
+        unsigned ticket = release(num_shared_vars - 2);
+        store(num_shared_vars - 2, threadid(), ticket);
+    }
+}
+
+/* ************************************************************************
+ * Signal Process
+ * ************************************************************************/
+
+void sigroutine(int dunno) {
+    printSigInformation(dunno);
+
+    OnExit(num_shared_vars);
+    exit(dunno);
+}
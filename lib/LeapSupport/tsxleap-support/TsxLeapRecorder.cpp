@@ -12,86 +12,112 @@
 #include <pthread.h>
 #include <sys/time.h>
 #include "LeapSupport/Signature.h"
+#include "LeapSupport/AtomicLog.h"
+#include "LeapSupport/CompactLog.h"
+#include "LeapSupport/Records.h"
 #include "LeapSupport/SignalRoutine.h"
+#include "LeapSupport/ThreadLogs.h"
+#include "LeapSupport/ThreadStart.h"
 
 #define RTM_ENABLED
 
 #include "LeapSupport/Lock.h"
 
 typedef struct c_thread {
-    pthread_t real_tid;
     int pseudo_tid;
-    unsigned * LIDX;
-    unsigned ** LLOG;
+    bool retired; // the logs were written when the thread exited
+    LeapThreadLogs logs; // of the shared variables the thread accessed
 } c_thread_t;
 
-#define MAX_LOG_LEN 50000 // the events of each sv in each thread
-#define MAX_THREAD_NUM 50
-
-#define LOCAL_THREAD_INIT
-#undef LOCAL_THREAD_INIT
+// the replayer numbers the threads from 1 below its MAX_THREAD_NUM
+#define MAX_THREAD_NUM (1 << 14)
 
+// the c_thread_t of each thread id - 1; a thread creates its c_thread_t at
+// its first event and finds it in self afterwards
 static c_thread_t** threads = NULL;
 static bool start = false;
 static int thread_idx = 0;
 
-static unsigned *GIDX = NULL;
+static __thread c_thread_t* self = NULL;
 
-static int num_shared_vars = 0;
+// retires the c_thread_t of an exiting thread
+static pthread_key_t retire_key;
 
-static struct timeval tpstart, tpend;
+// log.replay.dat; the logs of a thread are written when it exits, the others
+// at exit
+static FILE* flog = NULL;
+static pthread_mutex_t flog_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-int static inline threadid(pthread_t tid) {
-    for (int i = 0; i < thread_idx; i++) {
-        if (threads[i]->real_tid == tid) {
-            return threads[i]->pseudo_tid;
-        }
-    }
+// the record of each shared variable, on its own cache line
+typedef struct TsxLeapVar {
+    unsigned gidx; // the number of events logged
+} __attribute__((aligned(LEAP_CACHE_LINE))) TsxLeapVar;
 
-    return -1;
-}
+static TsxLeapVar *vars = NULL;
 
-void static inline threadcreate(pthread_t tid) {
-#ifdef LOCAL_THREAD_INIT
-    c_thread_t* newthread = new c_thread_t;
-    threads[thread_idx] = newthread;
-    thread_idx++;
+static int num_shared_vars = 0;
 
-    newthread->LIDX = new unsigned[num_shared_vars];
-    newthread->LLOG = new unsigned*[num_shared_vars];
+// the values observed by the atomic operations of each thread, from 1
+static AtomicLog atomic_logs[MAX_THREAD_NUM + 1];
 
-    for (int i = 0; i < num_shared_vars; i++) {
-        newthread->LLOG[i] = new unsigned[MAX_LOG_LEN];
-        newthread->LIDX[i] = 0;
-    }
-#else
-    c_thread_t* newthread = threads[thread_idx++];
-#endif
+static struct timeval tpstart, tpend;
 
-    if (thread_idx > MAX_THREAD_NUM) {
+/// the id of a new thread
+int static inline threadcreate() {
+    if (thread_idx + 1 >= MAX_THREAD_NUM) {
         printf("Too many threads!\n");
         exit(0);
     }
 
-    newthread->pseudo_tid = thread_idx; // start from 1
-    newthread->real_tid = tid; // must be last, which indicate the c_thread_t is completely initialized
+    // OnExit reads it while threads are created
+    __atomic_store_n(&thread_idx, thread_idx + 1, __ATOMIC_RELEASE);
+    return thread_idx;
 }
 
-void static inline store(int svId, int tid, unsigned currentGIdx) {
-    c_thread_t * currentT = threads[tid - 1];
-    unsigned currentLIdx = currentT->LIDX[svId];
-    unsigned * LLOG = currentT->LLOG[svId];
+/// the c_thread_t of the caller, created at its first event
+static inline c_thread_t* currentthread() {
+    if (self != NULL) {
+        return self;
+    }
 
-    if (currentLIdx > 0 && LLOG[currentLIdx - 1] + LLOG[currentLIdx - 2] == currentGIdx) {
-        LLOG[currentLIdx - 1]++;
-    } else {
-        LLOG[currentLIdx] = currentGIdx;
-        LLOG[currentLIdx + 1] = 1;
+    c_thread_t* newthread = new c_thread_t;
+    newthread->retired = false;
+    initThreadLogs(&newthread->logs);
+
+    newthread->pseudo_tid = threadid();
+    __atomic_store_n(&threads[newthread->pseudo_tid - 1], newthread, __ATOMIC_RELEASE);
+    self = newthread;
+    pthread_setspecific(retire_key, newthread);
+    return newthread;
+}
+
+/// writes the logs of a thread as blocks of log.replay.dat; called with
+/// flog_mutex held
+void static inline writethread(c_thread_t* current) {
+    writeThreadLogs(flog, &current->logs, current->pseudo_tid);
+    current->retired = true;
+
+#ifdef DEBUG
+    printf("T%d: logs written\n", current->pseudo_tid);
+#endif
+}
 
-        currentT->LIDX[svId] = currentLIdx + 2;
+/// writes the logs of an exiting thread unless OnExit did, and frees them
+static void retirethread(void* thread) {
+    c_thread_t* current = (c_thread_t*) thread;
+    pthread_mutex_lock(&flog_mutex);
+    if (!current->retired && flog != NULL) {
+        writethread(current);
     }
+    current->retired = true;
+    pthread_mutex_unlock(&flog_mutex);
 
-    //GIDX[svId]++; move out; should be in critical sections
+    freeThreadLogs(&current->logs);
+}
+
+/// appends an event to the log of the thread, which only the thread writes
+void static inline store(int svId, c_thread_t* currentT, unsigned currentGIdx) {
+    appendThreadLog(&currentT->logs, svId, currentGIdx);
 }
 
 extern "C" {
@@ -103,33 +129,31 @@ extern "C" {
         //start = true;
         num_shared_vars = svsNum + 2; // one for fork, and the other is for synchronizations
 
-        threads = new c_thread_t*[MAX_THREAD_NUM];
-#ifndef LOCAL_THREAD_INIT
-        for (int j = 0; j < MAX_THREAD_NUM; j++) {
-            c_thread_t* newthread = new c_thread_t;
-            threads[j] = newthread;
-
-            newthread->LIDX = new unsigned[num_shared_vars];
-            newthread->LLOG = new unsigned*[num_shared_vars];
-
-            for (int i = 0; i < num_shared_vars; i++) {
-                newthread->LLOG[i] = new unsigned[MAX_LOG_LEN];
-                newthread->LIDX[i] = 0;
-            }
+        threads = (c_thread_t**) calloc(MAX_THREAD_NUM, sizeof (c_thread_t*));
+        if (threads == NULL) {
+            printf("Cannot allocate the threads!\n");
+            exit(1);
         }
-#endif
+        pthread_key_create(&retire_key, retirethread);
+
         initialize(num_shared_vars); // initialize locks
 
-        GIDX = new unsigned[num_shared_vars];
-        for (int i = 0; i < num_shared_vars; i++) {
-            GIDX[i] = 0;
+        // all fields are 0, see Records.h
+        vars = (TsxLeapVar*) allocateRecords(num_shared_vars, sizeof (TsxLeapVar));
+
+        flog = fopen("log.replay.dat", "wb");
+        if (flog == NULL) {
+            printf("Cannot write the log: log.replay.dat!\n");
+            exit(1);
         }
+        Sig sig;
+        strcpy(sig.recorder, LEAP_LOG_SIG);
+        fwrite(&sig, sizeof (Sig), 1, flog);
+        // the number of threads is known at exit
+        writeLeapLogHeader(flog, LEAP_LOG_LOCAL, num_shared_vars, 0);
 
         // main thread.
-        pthread_t tid = pthread_self();
-        if (threadid(tid) == -1) {
-            threadcreate(tid);
-        }
+        __leap_tid = threadcreate();
 
         gettimeofday(&tpstart, NULL);
     }
@@ -141,48 +165,31 @@ extern "C" {
         double timeuse = 1000000 * (tpend.tv_sec - tpstart.tv_sec) + tpend.tv_usec - tpstart.tv_usec;
         timeuse /= 1000;
         printf("processor time is %lf ms\n", timeuse);
+        printlocks(num_shared_vars);
 
-        Sig* sig = new Sig;
-        strcpy(sig->recorder, "tsxleap");
-
-        FILE * fout = fopen("log.replay.dat", "wb");
+        pthread_mutex_lock(&flog_mutex);
+        if (flog == NULL) {
+            pthread_mutex_unlock(&flog_mutex);
+            return;
+        }
         printf("OnExit-Record\n");
 
-        fwrite(sig, sizeof (Sig), 1, fout);
-        for (int i = 0; i < thread_idx; i++) {
-            c_thread_t* current = threads[i];
-            //fwrite(current, sizeof (c_thread_t), 1, fout);
-            fwrite(current->LIDX, sizeof (unsigned), num_shared_vars, fout);
-            for (int j = 0; j < num_shared_vars; j++) {
-                fwrite(current->LLOG[j], sizeof (unsigned), current->LIDX[j], fout);
+        // the threads that are still running
+        int num = __atomic_load_n(&thread_idx, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < num; i++) {
+            c_thread_t* current = __atomic_load_n(&threads[i], __ATOMIC_ACQUIRE);
+            if (current != NULL && !current->retired) {
+                writethread(current);
             }
         }
 
-        fclose(fout);
-
-#ifdef DEBUG
-        // debug out
-        FILE* fdebug = fopen("log.debug", "w+");
-
-        for (int i = 0; i < thread_idx; i++) {
-            c_thread_t* current = threads[i];
-            fprintf(fdebug, "T%d: \n", current->pseudo_tid);
-            fprintf(fdebug, "LIDX: \n");
-            for (int j = 0; j < num_shared_vars; j++) {
-                fprintf(fdebug, "%d, ", current->LIDX[j]);
-            }
-            fprintf(fdebug, "\nLLOG: \n");
-
-            for (int j = 0; j < num_shared_vars; j++) {
-                for (int k = 0; k < current->LIDX[j]; k++) {
-                    fprintf(fdebug, "%d, ", current->LLOG[j][k]);
-                }
-            }
-            fprintf(fdebug, "\n");
-        }
+        fseek(flog, sizeof (Sig), SEEK_SET);
+        writeLeapLogHeader(flog, LEAP_LOG_LOCAL, num_shared_vars, num);
+        fclose(flog);
+        flog = NULL;
+        pthread_mutex_unlock(&flog_mutex);
 
-        fclose(fdebug);
-#endif
+        writeAtomicLogs(atomic_logs, num + 1);
     }
 
     void OnPreLoad(int svId, int debug) {
@@ -202,19 +209,15 @@ extern "C" {
         if (!start) {
             return;
         }
-        unsigned tmp = GIDX[svId];
-        GIDX[svId]++;
+        unsigned tmp = vars[svId].gidx;
+        vars[svId].gidx++;
         unlock(svId);
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        store(svId, _tid, tmp);
+        c_thread_t* current = currentthread();
+        store(svId, current, tmp);
 
 #ifdef DEBUG
-        printf("OnLoad: %d at t%d [%d]\n", svId, _tid, debug);
+        printf("OnLoad: %d at t%d [%d]\n", svId, current->pseudo_tid, debug);
 #endif
     }
 
@@ -233,19 +236,103 @@ extern "C" {
         if (!start) {
             return;
         }
-        unsigned tmp = GIDX[svId];
-        GIDX[svId]++;
+        unsigned tmp = vars[svId].gidx;
+        vars[svId].gidx++;
         unlock(svId);
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        store(svId, _tid, tmp);
+        c_thread_t* current = currentthread();
+        store(svId, current, tmp);
 
 #ifdef DEBUG        
-        printf("OnStore: %d at t%d [%d]\n", svId, _tid, debug);
+        printf("OnStore: %d at t%d [%d]\n", svId, current->pseudo_tid, debug);
+#endif
+    }
+
+    /// The replayer needs the accesses of the owner thread in order with the
+    /// others, and they have no index unless they take one, so an owner check
+    /// is recorded like any other access: the lock is held until
+    /// OnOwnerCheckEnd, after the access.
+    void OnOwnerCheck(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+
+        lock(svId);
+    }
+
+    void OnOwnerCheckEnd(int svId, int debug) {
+        if (!start) {
+            return;
+        }
+        unsigned tmp = vars[svId].gidx;
+        vars[svId].gidx++;
+        unlock(svId);
+
+        c_thread_t* current = currentthread();
+        store(svId, current, tmp);
+    }
+
+    void OnPreRegion(int* svIds, int num, int debug) {
+        if (!start) {
+            return;
+        }
+
+        lockall(svIds, num);
+#ifdef DEBUG
+        printf("OnPreRegion\n");
+#endif
+    }
+
+    void OnRegion(int* svIds, int num, int debug) {
+        if (!start) {
+            return;
+        }
+
+        unsigned tmp[num];
+        for (int i = 0; i < num; i++) {
+            tmp[i] = vars[svIds[i]].gidx;
+            vars[svIds[i]].gidx++;
+        }
+        unlockall(svIds, num);
+
+        c_thread_t* current = currentthread();
+        for (int i = 0; i < num; i++) {
+            store(svIds[i], current, tmp[i]);
+        }
+
+#ifdef DEBUG
+        printf("OnRegion: %d shared variables at t%d [%d]\n", num, current->pseudo_tid, debug);
+#endif
+    }
+
+    /// A memcpy, memmove or memset: one event for each of the (at most two)
+    /// shared variables it touches, however many bytes it copies.
+    /// svId1 < svId2, or svId2 is -1.
+    void OnPreMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnPreRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    void OnMemAccess(int svId1, int svId2, int debug) {
+        int svIds[2] = {svId1, svId2};
+        OnRegion(svIds, svId2 == -1 ? 1 : 2, debug);
+    }
+
+    /// An atomic operation (cmpxchg or atomicrmw) is ordered by the memory
+    /// itself: it takes no lock, and the value it observed is appended to the
+    /// log of the thread, see AtomicLog.h.
+    void OnPreAtomic(int svId, void* addr, int size, int debug) {
+    }
+
+    void OnAtomic(int svId, unsigned long long observed, int debug) {
+        if (!start) {
+            return;
+        }
+
+        c_thread_t* current = currentthread();
+        appendAtomic(&atomic_logs[current->pseudo_tid], observed);
+#ifdef DEBUG
+        printf("OnAtomic: %d at t%d observed %llu [%d]\n", svId, current->pseudo_tid, observed, debug);
 #endif
     }
 
@@ -254,12 +341,8 @@ extern "C" {
         if (!start) {
             return;
         }
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        printf("OnPreLock[%d]\n", _tid);
+        c_thread_t* current = currentthread();
+        printf("OnPreLock[%d]\n", current->pseudo_tid);
 #endif
     }
 
@@ -268,17 +351,15 @@ extern "C" {
             return;
         }
 
-        unsigned tmp = GIDX[num_shared_vars - 2];
-        GIDX[num_shared_vars - 2]++;
+        lock(num_shared_vars - 2);
+        unsigned tmp = vars[num_shared_vars - 2].gidx;
+        vars[num_shared_vars - 2].gidx++;
+        unlock(num_shared_vars - 2);
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        store(num_shared_vars - 2, _tid, tmp);
+        c_thread_t* current = currentthread();
+        store(num_shared_vars - 2, current, tmp);
 #ifdef DEBUG
-        printf("OnLock --> t%d\n", _tid);
+        printf("OnLock --> t%d\n", current->pseudo_tid);
 #endif
 
     }
@@ -297,12 +378,8 @@ extern "C" {
         if (!start) {
             return;
         }
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        printf("OnunLock <-- t%d\n", _tid);
+        c_thread_t* current = currentthread();
+        printf("OnunLock <-- t%d\n", current->pseudo_tid);
 #endif
     }
 
@@ -317,29 +394,26 @@ extern "C" {
         forklock(num_shared_vars - 1);
     }
 
+    /// called instead of pthread_create, between OnPreFork and OnFork
+    int __leap_pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*routine)(void*), void* arg) {
+        return createThread(thread, attr, routine, arg, threadcreate());
+    }
+
     void OnFork(long forked_tid_ptr) {
         if (!start) {
             return;
         }
 
-        pthread_t ftid = *((pthread_t*) forked_tid_ptr);
-        if (threadid(ftid) == -1) {
-            threadcreate(ftid);
-        }
 #ifdef DEBUG
         printf("OnFork\n");
 #endif
-        unsigned tmp = GIDX[num_shared_vars - 1];
-        GIDX[num_shared_vars - 1]++;
+        unsigned tmp = vars[num_shared_vars - 1].gidx;
+        vars[num_shared_vars - 1].gidx++;
 
         forkunlock(num_shared_vars - 1);
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        store(num_shared_vars - 1, _tid, tmp);
+        c_thread_t* current = currentthread();
+        store(num_shared_vars - 1, current, tmp);
     }
 
     void OnPreJoin(int id) {
@@ -355,15 +429,13 @@ extern "C" {
 #ifdef DEBUG        
         printf("OnPrewait\n");
 #endif
-        unsigned tmp = GIDX[num_shared_vars - 2];
-        GIDX[num_shared_vars - 2]++;
-
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        store(num_shared_vars - 2, _tid, tmp);
+        lock(num_shared_vars - 2);
+        unsigned tmp = vars[num_shared_vars - 2].gidx;
+        vars[num_shared_vars - 2].gidx++;
+        unlock(num_shared_vars - 2);
+
+        c_thread_t* current = currentthread();
+        store(num_shared_vars - 2, current, tmp);
     }
 
     void OnWait(int condId, long cond_ptr, long mutex_ptr) {
@@ -373,15 +445,13 @@ extern "C" {
 #ifdef DEBUG
         printf("OnWait\n");
 #endif
-        unsigned tmp = GIDX[num_shared_vars - 2];
-        GIDX[num_shared_vars - 2]++;
-
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        store(num_shared_vars - 2, _tid, tmp);
+        lock(num_shared_vars - 2);
+        unsigned tmp = vars[num_shared_vars - 2].gidx;
+        vars[num_shared_vars - 2].gidx++;
+        unlock(num_shared_vars - 2);
+
+        c_thread_t* current = currentthread();
+        store(num_shared_vars - 2, current, tmp);
     }
 
     void OnPreNotify(int condId) {
@@ -401,17 +471,13 @@ extern "C" {
 #ifdef DEBUG
         printf("OnNotify\n");
 #endif
-        unsigned tmp = GIDX[num_shared_vars - 2];
-        GIDX[num_shared_vars - 2]++;
+        unsigned tmp = vars[num_shared_vars - 2].gidx;
+        vars[num_shared_vars - 2].gidx++;
 
         unlock(num_shared_vars - 2);
 
-        pthread_t tid = pthread_self();
-        int _tid = -1;
-        do {
-            _tid = threadid(tid);
-        } while (_tid < 0);
-        store(num_shared_vars - 2, _tid, tmp);
+        c_thread_t* current = currentthread();
+        store(num_shared_vars - 2, current, tmp);
     }
 }
 
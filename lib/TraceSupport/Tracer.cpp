@@ -33,11 +33,13 @@ void createEvent(int eid,
         pthread_t synctid,
         pthread_cond_t * cond,
         const char * srcfile,
-        long line) {
+        long line,
+        long size = 0) {
 
     events[events_pointer].eid = eid;
     events[events_pointer].tid = tid;
     events[events_pointer].mem = mem;
+    events[events_pointer].size = size;
     events[events_pointer].type = type;
     strcpy(events[events_pointer].srcfile, srcfile);
     events[events_pointer].locks = locks;
@@ -70,10 +72,16 @@ void dump() {
         const char * srcfile = events[i].srcfile;
         switch (type) {
             case READ:
-                fprintf(fdebug, "READ from %ld at Line %s:%ld in thread %lu\n", mem, srcfile, line, tid);
+                if (events[i].size)
+                    fprintf(fdebug, "READ %ld bytes from %ld at Line %s:%ld in thread %lu\n", events[i].size, mem, srcfile, line, tid);
+                else
+                    fprintf(fdebug, "READ from %ld at Line %s:%ld in thread %lu\n", mem, srcfile, line, tid);
                 break;
             case WRITE:
-                fprintf(fdebug, "WRITE to %ld at Line %s:%ld in thread %lu\n", mem, srcfile, line, tid);
+                if (events[i].size)
+                    fprintf(fdebug, "WRITE %ld bytes to %ld at Line %s:%ld in thread %lu\n", events[i].size, mem, srcfile, line, tid);
+                else
+                    fprintf(fdebug, "WRITE to %ld at Line %s:%ld in thread %lu\n", mem, srcfile, line, tid);
                 break;
             case ACQUIRE:
                 fprintf(fdebug, "ACQUIRE %ld at Line %s:%ld in thread %lu\n", mem, srcfile, line, tid);
@@ -253,6 +261,31 @@ extern "C" {
         pthread_mutex_unlock(&mutex);
     }
 
+    /// A memcpy, memmove or memset is one READ of the source range and one
+    /// WRITE of the destination range; dst or src is NULL if not shared.
+    void OnPreMemAccess(long* dst, long* src, long size, long line, char * file) {
+        if (!start) {
+            return;
+        }
+
+        pthread_mutex_lock(&mutex);
+    }
+
+    void OnMemAccess(long* dst, long* src, long size, long line, char * file) {
+        if (!start) {
+            return;
+        }
+
+        if (src != NULL) {
+            createEvent(0, pthread_self(), (long) src, READ, NULL, 0, 0, NULL, file, line, size);
+        }
+        if (dst != NULL) {
+            createEvent(0, pthread_self(), (long) dst, WRITE, NULL, 0, 0, NULL, file, line, size);
+        }
+
+        pthread_mutex_unlock(&mutex);
+    }
+
     void OnPreLock(long* mem, long line, char * file) {
         return;
     }
@@ -0,0 +1,171 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "Transformer/AccessElision.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <iterator>
+
+bool AccessElision::isBarrier(Instruction* inst) {
+    if (isa<FenceInst>(inst) || isa<AtomicCmpXchgInst>(inst) || isa<AtomicRMWInst>(inst)) {
+        return true;
+    }
+
+    if (LoadInst* load = dyn_cast<LoadInst>(inst)) {
+        return load->isAtomic() || load->isVolatile();
+    }
+
+    if (StoreInst* store = dyn_cast<StoreInst>(inst)) {
+        return store->isAtomic() || store->isVolatile();
+    }
+
+    if (CallInst* call = dyn_cast<CallInst>(inst)) {
+        if (isa<DbgInfoIntrinsic>(call)) {
+            return false;
+        }
+        if (IntrinsicInst* ii = dyn_cast<IntrinsicInst>(call)) {
+            if (ii->getIntrinsicID() == Intrinsic::lifetime_start || ii->getIntrinsicID() == Intrinsic::lifetime_end) {
+                return false;
+            }
+        }
+        // pure functions cannot synchronize, other calls may lock, wait, or
+        // contain recorded accesses themselves
+        return !call->doesNotAccessMemory();
+    }
+
+    return false;
+}
+
+void AccessElision::meet(State& to, const State& from) const {
+    if (from.top) {
+        return;
+    }
+
+    if (to.top) {
+        to = from;
+        return;
+    }
+
+    set<int> accessed, written;
+    set_intersection(to.accessed.begin(), to.accessed.end(), from.accessed.begin(), from.accessed.end(),
+            inserter(accessed, accessed.begin()));
+    set_intersection(to.written.begin(), to.written.end(), from.written.begin(), from.written.end(),
+            inserter(written, written.begin()));
+    to.accessed.swap(accessed);
+    to.written.swap(written);
+}
+
+void AccessElision::transfer(BasicBlock* bb, State& state, bool collect) {
+    for (BasicBlock::iterator it = bb->begin(); it != bb->end(); it++) {
+        Instruction* inst = it;
+
+        if (isBarrier(inst)) {
+            state.accessed.clear();
+            state.written.clear();
+            continue;
+        }
+
+        int svIdx = -1;
+        bool isWrite = false;
+        if (LoadInst* load = dyn_cast<LoadInst>(inst)) {
+            svIdx = getIndex(load->getPointerOperand());
+        } else if (StoreInst* store = dyn_cast<StoreInst>(inst)) {
+            svIdx = getIndex(store->getPointerOperand());
+            isWrite = true;
+        }
+
+        if (svIdx == -1) {
+            continue;
+        }
+
+        if (collect) {
+            stats[bb->getParent()].first++;
+            if (isWrite ? state.written.count(svIdx) : state.accessed.count(svIdx)) {
+                redundant.insert(inst);
+                stats[bb->getParent()].second++;
+            }
+        }
+
+        state.accessed.insert(svIdx);
+        if (isWrite) {
+            state.written.insert(svIdx);
+        }
+    }
+}
+
+void AccessElision::analyze(Function* f) {
+    if (f->empty()) {
+        return;
+    }
+
+    // forward must-analysis: the state at the entry of a block is the
+    // intersection of the states at the exits of its predecessors
+    map<BasicBlock*, State> out;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Function::iterator bit = f->begin(); bit != f->end(); bit++) {
+            BasicBlock* bb = bit;
+
+            State state;
+            if (bb == &f->getEntryBlock()) {
+                state.top = false;
+            } else {
+                for (pred_iterator pit = pred_begin(bb); pit != pred_end(bb); pit++) {
+                    meet(state, out[*pit]);
+                }
+                if (state.top) {
+                    // not reached yet, or unreachable
+                    continue;
+                }
+            }
+
+            transfer(bb, state, false);
+
+            State& old = out[bb];
+            if (old.top || old.accessed != state.accessed || old.written != state.written) {
+                old = state;
+                changed = true;
+            }
+        }
+    }
+
+    for (Function::iterator bit = f->begin(); bit != f->end(); bit++) {
+        BasicBlock* bb = bit;
+
+        State state;
+        if (bb == &f->getEntryBlock()) {
+            state.top = false;
+        } else {
+            for (pred_iterator pit = pred_begin(bb); pit != pred_end(bb); pit++) {
+                meet(state, out[*pit]);
+            }
+            state.top = false;
+        }
+
+        transfer(bb, state, true);
+    }
+}
+
+void AccessElision::printReport(Module* module, raw_ostream& os) const {
+    unsigned total = 0, removed = 0;
+    for (Module::iterator fit = module->begin(); fit != module->end(); fit++) {
+        auto it = stats.find(fit);
+        if (it == stats.end() || it->second.second == 0) {
+            continue;
+        }
+        os << "[Elision] " << fit->getName() << ": removed " << it->second.second << " of "
+                << it->second.first << " access sites\n";
+    }
+
+    for (auto it = stats.begin(); it != stats.end(); it++) {
+        total += it->second.first;
+        removed += it->second.second;
+    }
+    os << "[Elision] Removed " << removed << " of " << total << " access sites in total.\n";
+}
@@ -0,0 +1,193 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "Transformer/LeapBodyCache.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <vector>
+
+void LeapBodyCache::load(const string& file, LLVMContext& context) {
+    SMDiagnostic err;
+    cache = parseIRFile(file, err, context);
+}
+
+bool LeapBodyCache::has(Function* f) const {
+    if (cache == NULL || !f->hasName()) {
+        return false;
+    }
+    Function* cached = cache->getFunction(f->getName());
+    return cached != NULL && !cached->isDeclaration();
+}
+
+void LeapBodyCache::reuse(Function* f) {
+    reused.insert(f->getName().str());
+}
+
+bool LeapBodyCache::restore(Module* module, string& error) {
+    if (cache == NULL || reused.empty()) {
+        cache.reset();
+        return true;
+    }
+
+    // the linkages to put back after linking
+    map<string, pair<GlobalValue::LinkageTypes, Comdat*> > saved;
+
+    // only the reused bodies are linked in: the module keeps its bodies of the others
+    for (auto fit = cache->begin(); fit != cache->end(); fit++) {
+        if (!fit->isDeclaration() && !reused.count(fit->getName().str())) {
+            fit->deleteBody();
+        }
+    }
+
+    for (auto it = reused.begin(); it != reused.end(); it++) {
+        Function* f = module->getFunction(*it);
+        saved[*it] = make_pair(f->getLinkage(), f->getComdat());
+        f->deleteBody();
+        f->setComdat(NULL);
+    }
+
+    // the linker does not resolve a declaration to a local value, so the
+    // locals the cached bodies refer to are external while linking
+    vector<GlobalValue*> declared;
+    for (auto fit = cache->begin(); fit != cache->end(); fit++) {
+        if (fit->isDeclaration()) declared.push_back(fit);
+    }
+    for (auto git = cache->global_begin(); git != cache->global_end(); git++) {
+        if (git->isDeclaration()) declared.push_back(git);
+    }
+    for (unsigned i = 0; i < declared.size(); i++) {
+        GlobalValue* local = module->getNamedValue(declared[i]->getName());
+        if (local != NULL && local->hasLocalLinkage() && !saved.count(local->getName().str())) {
+            Comdat* comdat = isa<GlobalObject>(local) ? ((GlobalObject*) local)->getComdat() : NULL;
+            saved[local->getName().str()] = make_pair(local->getLinkage(), comdat);
+            local->setLinkage(GlobalValue::ExternalLinkage);
+        }
+    }
+
+    bool failed = Linker::LinkModules(module, cache.get());
+    cache.reset();
+
+    for (auto it = saved.begin(); it != saved.end(); it++) {
+        GlobalValue* gv = module->getNamedValue(it->first);
+        if (gv == NULL) {
+            continue;
+        }
+        gv->setLinkage(it->second.first);
+        if (GlobalObject* go = dyn_cast<GlobalObject>(gv)) {
+            go->setComdat(it->second.second);
+        }
+    }
+
+    if (failed) {
+        error = "cannot link the cached bodies";
+        return false;
+    }
+    return true;
+}
+
+/// the functions whose instructions use v, directly or in constants
+static void getUserFunctions(Value* v, set<Function*>& users) {
+    for (auto it = v->user_begin(); it != v->user_end(); it++) {
+        if (Instruction* inst = dyn_cast<Instruction>(*it)) {
+            users.insert(inst->getParent()->getParent());
+        } else if (isa<Constant>(*it) && !isa<GlobalValue>(*it)) {
+            getUserFunctions(*it, users);
+        }
+    }
+}
+
+bool LeapBodyCache::save(Module* module, const set<string>& functions, const string& file, string& error) {
+    std::unique_ptr<Module> clone(CloneModule(module));
+
+    // what the linker cannot resolve by name: unnamed values that would be
+    // declared, so the functions using them are not cached
+    set<Function*> unnamedUsers;
+    for (auto fit = clone->begin(); fit != clone->end(); fit++) {
+        if (!fit->hasName()) getUserFunctions(fit, unnamedUsers);
+    }
+    for (auto git = clone->global_begin(); git != clone->global_end(); git++) {
+        if (!git->hasName() && !(git->hasLocalLinkage() && git->isConstant())) getUserFunctions(git, unnamedUsers);
+    }
+
+    for (auto fit = clone->begin(); fit != clone->end(); fit++) {
+        if (fit->isDeclaration()) {
+            continue;
+        }
+        if (functions.count(fit->getName().str()) && !unnamedUsers.count(fit)) {
+            fit->setLinkage(GlobalValue::ExternalLinkage);
+        } else {
+            fit->deleteBody();
+        }
+        fit->setComdat(NULL);
+    }
+
+    // local constants, e.g. strings, are copied with the bodies; the other
+    // variables are declared, and the intrinsic ones are dropped
+    vector<GlobalVariable*> intrinsic;
+    for (auto git = clone->global_begin(); git != clone->global_end(); git++) {
+        if (git->getName().startswith("llvm.")) {
+            intrinsic.push_back(git);
+        } else if (!git->isDeclaration() && !(git->hasLocalLinkage() && git->isConstant())) {
+            git->setInitializer(NULL);
+            git->setLinkage(GlobalValue::ExternalLinkage);
+            git->setComdat(NULL);
+        }
+    }
+    for (unsigned i = 0; i < intrinsic.size(); i++) {
+        intrinsic[i]->eraseFromParent();
+    }
+
+    // an alias needs a definition, so it is declared as what it aliases
+    vector<GlobalAlias*> aliases;
+    for (auto ait = clone->alias_begin(); ait != clone->alias_end(); ait++) {
+        aliases.push_back(ait);
+    }
+    for (unsigned i = 0; i < aliases.size(); i++) {
+        GlobalAlias* alias = aliases[i];
+        string name = alias->getName().str();
+        alias->setName("");
+
+        Type* ty = alias->getType()->getElementType();
+        GlobalValue* decl;
+        if (FunctionType* fty = dyn_cast<FunctionType>(ty)) {
+            decl = Function::Create(fty, GlobalValue::ExternalLinkage, name, clone.get());
+        } else {
+            decl = new GlobalVariable(*clone, ty, false, GlobalValue::ExternalLinkage, NULL, name);
+        }
+        alias->replaceAllUsesWith(ConstantExpr::getBitCast(decl, alias->getType()));
+        alias->eraseFromParent();
+    }
+
+    // debug info and module flags stay with the module
+    while (!clone->named_metadata_empty()) {
+        clone->named_metadata_begin()->eraseFromParent();
+    }
+
+    std::error_code ec;
+    raw_fd_ostream out(file, ec, sys::fs::F_None);
+    if (ec) {
+        // the bodies of the last build do not match the ids any more
+        sys::fs::remove(file);
+        error = ec.message();
+        return false;
+    }
+    WriteBitcodeToFile(clone.get(), out);
+    out.close();
+    if (out.has_error()) {
+        out.clear_error();
+        sys::fs::remove(file);
+        error = "cannot write " + file;
+        return false;
+    }
+    return true;
+}
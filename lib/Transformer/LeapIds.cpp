@@ -0,0 +1,312 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "Transformer/LeapIds.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// version 1 has no decisions in func lines
+#define LEAP_IDS_VERSION 2
+
+LeapIds::LeapIds(bool compact) : numOldIds(0), numOldDebugIndices(0), numDebugIndices(0), numChangedFunctions(0),
+        numRetiredIds(0), compact(compact) {
+}
+
+bool LeapIds::load(const string& file, string& error) {
+    ifstream in(file.c_str());
+    if (!in) {
+        // the first build
+        return true;
+    }
+
+    string kind;
+    int version = 0;
+    if (!(in >> kind >> version >> numOldIds >> numOldDebugIndices) || kind != "leap-ids") {
+        error = file + " is not a leap id file";
+        return false;
+    }
+    if (version != 1 && version != LEAP_IDS_VERSION) {
+        error = file + " has an unsupported version";
+        return false;
+    }
+
+    string line;
+    getline(in, line);
+    while (getline(in, line)) {
+        istringstream fields(line);
+        int id = 0;
+        Range r;
+        r.decisions = 0;
+        string rest;
+        if (!(fields >> kind)) {
+            continue;
+        } else if (kind == "sv" && fields >> id && id >= 0 && (unsigned) id < numOldIds && getline(fields >> ws, rest)) {
+            oldKeys[rest] = id;
+        } else if (kind == "func" && fields >> r.hash && (version == 1 || fields >> r.decisions)
+                && fields >> r.base >> r.size && r.base + r.size <= numOldDebugIndices && getline(fields >> ws, rest)) {
+            oldFunctions[rest] = r;
+        } else {
+            error = file + ": cannot parse \"" + line + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LeapIds::save(const string& file) const {
+    ofstream out(file.c_str());
+    if (!out) {
+        return false;
+    }
+
+    out << "leap-ids " << LEAP_IDS_VERSION << " " << keys.size() << " " << numDebugIndices << "\n";
+    for (unsigned id = 0; id < keys.size(); id++) {
+        for (auto it = keys[id].begin(); it != keys[id].end(); it++) {
+            out << "sv " << id << " " << *it << "\n";
+        }
+    }
+    for (unsigned i = 0; i < functions.size(); i++) {
+        if (functions[i].name.empty()) {
+            // cannot be looked up in the next build
+            continue;
+        }
+        const Range& r = functions[i].range;
+        out << "func " << r.hash << " " << r.decisions << " " << r.base << " " << r.size << " " << functions[i].name << "\n";
+    }
+    return out.good();
+}
+
+static string getConstantKey(Constant* c) {
+    string key;
+    raw_string_ostream os(key);
+    c->print(os);
+    os.flush();
+    // a key is the rest of a line
+    for (unsigned i = 0; i < key.size(); i++) {
+        if (key[i] == '\n') key[i] = ' ';
+    }
+    return key;
+}
+
+void LeapIds::getKeys(Module* module, unordered_map<const Value*, string>& valueKeys) {
+    for (auto git = module->global_begin(); git != module->global_end(); git++) {
+        if (git->hasName()) {
+            valueKeys[git] = "@" + git->getName().str();
+        }
+    }
+
+    for (auto fit = module->begin(); fit != module->end(); fit++) {
+        if (!fit->hasName()) {
+            continue;
+        }
+
+        string name = fit->getName().str();
+        valueKeys[fit] = "@" + name;
+
+        unsigned argNo = 0;
+        for (auto ait = fit->arg_begin(); ait != fit->arg_end(); ait++) {
+            ostringstream os;
+            os << name << "%arg" << argNo++;
+            valueKeys[ait] = os.str();
+        }
+
+        unsigned instNo = 0;
+        for (auto bit = fit->begin(); bit != fit->end(); bit++) {
+            for (auto iit = bit->begin(); iit != bit->end(); iit++) {
+                ostringstream os;
+                os << name << "%" << instNo++;
+                valueKeys[iit] = os.str();
+
+                for (unsigned i = 0; i < iit->getNumOperands(); i++) {
+                    if (ConstantExpr* ce = dyn_cast<ConstantExpr>(iit->getOperand(i))) {
+                        if (!valueKeys.count(ce)) {
+                            valueKeys[ce] = getConstantKey(ce);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void LeapIds::assignSharedVariables(Module* module, vector<const set<Value*>*>& svs, unordered_map<const Value*, int>& index) {
+    unordered_map<const Value*, string> valueKeys;
+    getKeys(module, valueKeys);
+
+    // shared variables in their current order, so that the assignment is deterministic
+    vector<const set<Value*>*> byId(numOldIds, (const set<Value*>*) NULL);
+    vector<const set<Value*>*> fresh;
+    for (unsigned i = 0; i < svs.size(); i++) {
+        map<int, unsigned> votes;
+        for (auto vit = svs[i]->begin(); vit != svs[i]->end(); vit++) {
+            auto kit = valueKeys.find(*vit);
+            if (kit == valueKeys.end()) continue;
+            auto oit = oldKeys.find(kit->second);
+            if (oit != oldKeys.end()) votes[oit->second]++;
+        }
+
+        int best = -1;
+        for (auto it = votes.begin(); it != votes.end(); it++) {
+            if (byId[it->first] == NULL && (best == -1 || it->second > votes[best])) {
+                best = it->first;
+            }
+        }
+
+        if (best != -1) {
+            byId[best] = svs[i];
+        } else {
+            fresh.push_back(svs[i]);
+        }
+    }
+    byId.insert(byId.end(), fresh.begin(), fresh.end());
+
+    numRetiredIds = std::count(byId.begin(), byId.end(), (const set<Value*>*) NULL);
+    if (compact) {
+        byId.erase(std::remove(byId.begin(), byId.end(), (const set<Value*>*) NULL), byId.end());
+    }
+
+    static const set<Value*> retired;
+    svs.clear();
+    index.clear();
+    keys.clear();
+    keys.resize(byId.size());
+    for (unsigned id = 0; id < byId.size(); id++) {
+        const set<Value*>* sv = byId[id] == NULL ? &retired : byId[id];
+        svs.push_back(sv);
+        for (auto vit = sv->begin(); vit != sv->end(); vit++) {
+            index[*vit] = id;
+            auto kit = valueKeys.find(*vit);
+            if (kit != valueKeys.end()) keys[id].insert(kit->second);
+        }
+    }
+}
+
+unsigned long long LeapIds::hashFunction(Function* f, const IndexFunction& getIndex) {
+    // FNV-1a, which does not change from build to build
+    unsigned long long hash = 14695981039346656037ULL;
+    auto mix = [&hash](const string & s) {
+        for (unsigned i = 0; i < s.size(); i++) {
+            hash ^= (unsigned char) s[i];
+            hash *= 1099511628211ULL;
+        }
+        hash ^= 0xff;
+        hash *= 1099511628211ULL;
+    };
+
+    // the text of the function without metadata, e.g. debug locations, whose
+    // numbers depend on the other functions, and attribute groups
+    string text;
+    raw_string_ostream os(text);
+    f->print(os);
+    os.flush();
+
+    istringstream lines(text);
+    string line;
+    while (getline(lines, line)) {
+        if (line.find("@llvm.dbg.") != string::npos) {
+            continue;
+        }
+        size_t md = line.find(", !");
+        if (md != string::npos) {
+            line.erase(md);
+        }
+        size_t attrs = 0;
+        while ((attrs = line.find(" #", attrs)) != string::npos) {
+            size_t end = line.find_first_not_of("0123456789", attrs + 2);
+            if (end == attrs + 2 || (end != string::npos && line[end] != ' ')) {
+                attrs += 2;
+                continue;
+            }
+            line.erase(attrs, end == string::npos ? string::npos : end - attrs);
+        }
+        mix(line);
+    }
+
+    // and the shared variables it uses
+    for (auto bit = f->begin(); bit != f->end(); bit++) {
+        for (auto iit = bit->begin(); iit != bit->end(); iit++) {
+            if (isa<DbgInfoIntrinsic>(iit)) continue;
+            for (unsigned i = 0; i < iit->getNumOperands(); i++) {
+                Value* op = iit->getOperand(i);
+                if (!op->getType()->isPointerTy()) continue;
+                ostringstream sv;
+                sv << getIndex(op);
+                mix(sv.str());
+            }
+        }
+    }
+    return hash;
+}
+
+unsigned LeapIds::getMaxSites(Function* f) {
+    unsigned sites = 0;
+    for (auto bit = f->begin(); bit != f->end(); bit++) {
+        for (auto iit = bit->begin(); iit != bit->end(); iit++) {
+            if (isa<LoadInst>(iit) || isa<StoreInst>(iit) || isa<AtomicRMWInst>(iit) || isa<AtomicCmpXchgInst>(iit)) {
+                sites++;
+            } else if (CallInst* call = dyn_cast<CallInst>(iit)) {
+                // a call to an external function is a site for each argument
+                sites += call->getNumArgOperands() > 0 ? call->getNumArgOperands() : 1;
+            }
+        }
+    }
+    return sites;
+}
+
+void LeapIds::assignFunctions(Module* module, const std::function<bool(Function*)>& toTransform, const IndexFunction& getIndex,
+        const std::function<unsigned long long(Function*)>& getDecisions) {
+    // compacting packs the ranges in module order
+    numDebugIndices = compact ? 0 : numOldDebugIndices;
+    for (auto fit = module->begin(); fit != module->end(); fit++) {
+        Function* f = fit;
+        if (!toTransform(f)) {
+            continue;
+        }
+
+        FunctionIds ids;
+        ids.name = f->getName().str();
+        ids.range.hash = hashFunction(f, getIndex);
+        ids.range.decisions = getDecisions(f);
+        ids.range.size = getMaxSites(f);
+        ids.unchanged = false;
+
+        auto it = oldFunctions.find(ids.name);
+        if (!compact && f->hasName() && it != oldFunctions.end() && it->second.hash == ids.range.hash
+                && it->second.size == ids.range.size) {
+            ids.range.base = it->second.base;
+            ids.unchanged = it->second.decisions != 0 && it->second.decisions == ids.range.decisions;
+        } else {
+            ids.range.base = numDebugIndices;
+            numDebugIndices += ids.range.size;
+            numChangedFunctions++;
+        }
+
+        functionIndex[f] = functions.size();
+        functions.push_back(ids);
+    }
+}
+
+unsigned LeapIds::getDebugBase(Function* f) const {
+    auto it = functionIndex.find(f);
+    assert(it != functionIndex.end() && "getDebugBase: the function is not assigned!");
+    return functions[it->second].range.base;
+}
+
+bool LeapIds::isUnchanged(Function* f) const {
+    auto it = functionIndex.find(f);
+    return it != functionIndex.end() && functions[it->second].unchanged;
+}
+
+unsigned LeapIds::getNumUnusedDebugIndices() const {
+    unsigned used = 0;
+    for (unsigned i = 0; i < functions.size(); i++) {
+        used += functions[i].range.size;
+    }
+    return numDebugIndices - used;
+}
@@ -0,0 +1,122 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "Transformer/LeapProfile.h"
+#include "LeapSupport/Profile.h"
+#include "llvm/IR/DebugInfo.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+bool LeapProfile::load(const string& file, unsigned numSVs, string& error) {
+    ifstream in(file.c_str());
+    if (!in) {
+        error = "cannot open " + file;
+        return false;
+    }
+
+    string kind;
+    int version = 0;
+    unsigned profiled = 0;
+    if (!(in >> kind >> version >> profiled) || kind != "leap-profile") {
+        error = file + " is not a leap profile";
+        return false;
+    }
+    if (version != LEAP_PROFILE_VERSION) {
+        error = file + " has an unsupported version";
+        return false;
+    }
+    if (profiled != numSVs) {
+        error = file + " was not produced by this bitcode file and these options (the numbers of shared variables differ)";
+        return false;
+    }
+    numSharedVariables = numSVs;
+
+    string line;
+    getline(in, line);
+    while (getline(in, line)) {
+        istringstream fields(line);
+        int idx = 0;
+        unsigned long count = 0, changes = 0;
+        if (!(fields >> kind)) {
+            continue;
+        } else if (kind == "var" && fields >> idx >> count >> changes && idx >= 0 && (unsigned) idx < numSVs) {
+            vars[idx] = make_pair(count, changes);
+        } else if (kind == "site" && fields >> idx >> count) {
+            sites[idx] = count;
+        } else {
+            error = file + ": cannot parse \"" + line + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LeapProfile::isSingleOwner(int svIdx) const {
+    // variables that never ran are not known to be single-owner
+    auto it = vars.find(svIdx);
+    return it != vars.end() && it->second.first > 0 && it->second.second == 0;
+}
+
+void LeapProfile::noteOwnerCheck(int svIdx, int debugIdx, Instruction* inst) {
+    string location = "?";
+    if (MDNode* md = inst->getMetadata("dbg")) {
+        DILocation DI(md);
+        ostringstream os;
+        os << DI.getFilename().str() << ":" << DI.getLineNumber();
+        location = os.str();
+    }
+
+    Site site;
+    site.debugIdx = debugIdx;
+    site.location = location;
+    ownerCheckedSites[svIdx].push_back(site);
+}
+
+unsigned long LeapProfile::getSiteCount(int debugIdx) const {
+    auto it = sites.find(debugIdx);
+    return it == sites.end() ? 0 : it->second;
+}
+
+bool LeapProfile::writeReport(const string& file, unsigned long hotCount) const {
+    ofstream out(file.c_str());
+    if (!out) {
+        return false;
+    }
+
+    unsigned numOwnerChecked = 0;
+    for (auto it = ownerCheckedSites.begin(); it != ownerCheckedSites.end(); it++) {
+        numOwnerChecked += it->second.size();
+    }
+    out << "# " << numOwnerChecked << " sites check the owner, " << numRecordedSites << " sites are recorded\n";
+
+    out << "\n# shared variable: decision (accesses, owner changes)\n";
+    for (unsigned i = 0; i < numSharedVariables; i++) {
+        auto it = vars.find(i);
+        out << "sv" << i << ": ";
+        if (it == vars.end()) {
+            out << "record (not run when profiled)\n";
+        } else {
+            out << (isSingleOwner(i) ? "owner-check" : "record") << " (" << it->second.first << ", " << it->second.second << ")\n";
+        }
+    }
+
+    out << "\n# single-owner sites by shared variable: debug index, executions, location\n";
+    for (auto it = ownerCheckedSites.begin(); it != ownerCheckedSites.end(); it++) {
+        vector<Site> group = it->second;
+        stable_sort(group.begin(), group.end(), [this](const Site& a, const Site& b) {
+            return getSiteCount(a.debugIdx) > getSiteCount(b.debugIdx);
+        });
+
+        out << "sv" << it->first << ":\n";
+        for (unsigned i = 0; i < group.size(); i++) {
+            unsigned long count = getSiteCount(group[i].debugIdx);
+            out << "    " << group[i].debugIdx << ", " << count << ", " << group[i].location
+                    << (count >= hotCount ? " [hot]" : "") << "\n";
+        }
+    }
+    return true;
+}
@@ -0,0 +1,333 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "Transformer/LocksetAnalysis.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+
+#include <algorithm>
+#include <iterator>
+
+LocksetAnalysis::LocksetAnalysis(const IndexFunction& indexFunc, const IgnoreFunction& ignoreFunc,
+        const vector<const set<Value*>*>& svs, DyckAliasAnalysis* AA) :
+        getIndex(indexFunc), isIgnored(ignoreFunc), sharedVariables(svs), callGraph(NULL) {
+    if (AA->callGraphPreserved()) {
+        callGraph = AA->getCallGraph();
+    }
+}
+
+static Function* getCalledFunction(CallInst* call) {
+    return dyn_cast<Function>(call->getCalledValue()->stripPointerCastsNoFollowAliases());
+}
+
+int LocksetAnalysis::getLock(Value* mutex) {
+    int idx = getIndex(mutex);
+    if (idx == -1) {
+        return -1;
+    }
+
+    auto cached = singleMutex.find(idx);
+    if (cached != singleMutex.end()) {
+        return cached->second ? idx : -1;
+    }
+
+    // the objects of the alias class, looking through casts and constant offsets;
+    // loads, arguments, phis, etc. only point to them
+    set<Value*> objects;
+    bool single = true;
+    const set<Value*>* aliasSet = sharedVariables[idx];
+    for (auto it = aliasSet->begin(); it != aliasSet->end() && single; it++) {
+        Value* v = *it;
+        while (true) {
+            v = v->stripPointerCastsNoFollowAliases();
+            GEPOperator* gep = dyn_cast<GEPOperator>(v);
+            if (gep == NULL || !gep->hasAllConstantIndices()) {
+                break;
+            }
+            v = gep->getPointerOperand();
+        }
+
+        if (GlobalVariable* gv = dyn_cast<GlobalVariable>(v)) {
+            // an array of mutexes shares one class
+            single = !gv->getType()->getElementType()->isArrayTy();
+            objects.insert(gv);
+        } else if (isa<GEPOperator>(v) || isa<AllocaInst>(v) || isa<IntToPtrInst>(v) || isa<GlobalAlias>(v)) {
+            single = false;
+        } else if (isa<CallInst>(v)) {
+            // a function with a body only returns what it points to
+            Function* callee = getCalledFunction((CallInst*) v);
+            single = callee != NULL && !callee->isDeclaration();
+        }
+    }
+
+    single = single && objects.size() == 1;
+    singleMutex[idx] = single;
+    return single ? idx : -1;
+}
+
+void LocksetAnalysis::computeUnlocks(Module* module) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Module::iterator fit = module->begin(); fit != module->end(); fit++) {
+            Function* f = fit;
+            if (f->isDeclaration() || mayUnlockAll.count(f)) {
+                continue;
+            }
+
+            set<int>& fUnlocks = unlocks[f];
+            size_t oldSize = fUnlocks.size();
+            for (inst_iterator it = inst_begin(f); it != inst_end(f); it++) {
+                CallInst* call = dyn_cast<CallInst>(&*it);
+                if (call == NULL || isa<IntrinsicInst>(call)) {
+                    continue;
+                }
+
+                set<Function*> callees;
+                if (!getCallees(call, callGraph, callees)) {
+                    mayUnlockAll.insert(f);
+                    changed = true;
+                    break;
+                }
+
+                for (auto cit = callees.begin(); cit != callees.end(); cit++) {
+                    Function* callee = *cit;
+                    if (callee->getName() == "pthread_mutex_unlock" && call->getNumArgOperands() > 0) {
+                        int lock = getIndex(call->getArgOperand(0));
+                        if (lock != -1) {
+                            fUnlocks.insert(lock);
+                        }
+                    } else if (mayUnlockAll.count(callee)) {
+                        mayUnlockAll.insert(f);
+                        changed = true;
+                        break;
+                    } else if (unlocks.count(callee)) {
+                        fUnlocks.insert(unlocks[callee].begin(), unlocks[callee].end());
+                    }
+                }
+                if (mayUnlockAll.count(f)) {
+                    break;
+                }
+            }
+            if (fUnlocks.size() != oldSize) {
+                changed = true;
+            }
+        }
+    }
+}
+
+void LocksetAnalysis::meet(Lockset& to, const Lockset& from) const {
+    if (from.top) {
+        return;
+    }
+
+    if (to.top) {
+        to = from;
+        return;
+    }
+
+    set<int> held;
+    set_intersection(to.held.begin(), to.held.end(), from.held.begin(), from.held.end(), inserter(held, held.begin()));
+    to.held.swap(held);
+}
+
+void LocksetAnalysis::noteAccess(Value* pointer, Instruction* inst, const Lockset& state) {
+    int svIdx = getIndex(pointer);
+    if (svIdx == -1 || (isIgnored && isIgnored(inst))) {
+        return;
+    }
+    meet(guards[svIdx], state);
+}
+
+void LocksetAnalysis::step(Instruction* inst, Lockset& state, bool effects, bool collect, bool& changed) {
+    if (collect) {
+        if (LoadInst* load = dyn_cast<LoadInst>(inst)) {
+            noteAccess(load->getPointerOperand(), inst, state);
+        } else if (StoreInst* store = dyn_cast<StoreInst>(inst)) {
+            noteAccess(store->getPointerOperand(), inst, state);
+        } else if (AtomicRMWInst* rmw = dyn_cast<AtomicRMWInst>(inst)) {
+            noteAccess(rmw->getPointerOperand(), inst, state);
+        } else if (AtomicCmpXchgInst* cas = dyn_cast<AtomicCmpXchgInst>(inst)) {
+            noteAccess(cas->getPointerOperand(), inst, state);
+        }
+    }
+
+    CallInst* call = dyn_cast<CallInst>(inst);
+    if (call == NULL || isa<DbgInfoIntrinsic>(call)) {
+        return;
+    }
+
+    set<Function*> callees;
+    bool resolved = getCallees(call, callGraph, callees);
+
+    Function* callee = getCalledFunction(call);
+    if (callee != NULL && callee->getName().startswith("pthread_")) {
+        StringRef name = callee->getName();
+        if (name == "pthread_mutex_lock" && call->getNumArgOperands() > 0) {
+            int lock = getLock(call->getArgOperand(0));
+            if (lock != -1 && !state.top) {
+                state.held.insert(lock);
+            }
+        } else if (name == "pthread_mutex_unlock" && call->getNumArgOperands() > 0) {
+            state.held.erase(getIndex(call->getArgOperand(0)));
+        }
+
+        // mutexes, condition variables, thread handles, etc.
+        if (collect && name != "pthread_create") {
+            for (unsigned i = 0; i < call->getNumArgOperands(); i++) {
+                int svIdx = getIndex(call->getArgOperand(i));
+                if (svIdx != -1) {
+                    syncObjects.insert(svIdx);
+                }
+            }
+        }
+        return;
+    }
+
+    bool external = !resolved || call->isInlineAsm();
+    for (auto it = callees.begin(); it != callees.end(); it++) {
+        Function* f = *it;
+        if (f->isDeclaration()) {
+            external = true;
+        } else if (effects && !roots.count(f)) {
+            Lockset old = entries[f];
+            meet(entries[f], state);
+            if (old.top != entries[f].top || old.held != entries[f].held) {
+                changed = true;
+            }
+        }
+    }
+
+    if (collect && external) {
+        // external functions, including memcpy and memset, may access what they get
+        for (unsigned i = 0; i < call->getNumArgOperands(); i++) {
+            noteAccess(call->getArgOperand(i), inst, state);
+        }
+    }
+
+    if (!resolved) {
+        state.held.clear();
+        return;
+    }
+    for (auto it = callees.begin(); it != callees.end(); it++) {
+        Function* f = *it;
+        if (mayUnlockAll.count(f)) {
+            state.held.clear();
+            return;
+        }
+        auto uit = unlocks.find(f);
+        if (uit != unlocks.end()) {
+            for (auto lit = uit->second.begin(); lit != uit->second.end(); lit++) {
+                state.held.erase(*lit);
+            }
+        }
+    }
+}
+
+bool LocksetAnalysis::transfer(Function* f, bool collect) {
+    Lockset entry = entries[f];
+    if (entry.top) {
+        if (!collect) {
+            // not called with any known lockset yet
+            return false;
+        }
+        // never called
+        entry.top = false;
+    }
+
+    // the locks held at the exits of blocks, intersected at joins
+    map<BasicBlock*, Lockset> out;
+    bool unused = false;
+    bool blockChanged = true;
+    while (blockChanged) {
+        blockChanged = false;
+        for (Function::iterator bit = f->begin(); bit != f->end(); bit++) {
+            BasicBlock* bb = bit;
+            Lockset state;
+            if (bb == &f->getEntryBlock()) {
+                state = entry;
+            } else {
+                for (pred_iterator pit = pred_begin(bb); pit != pred_end(bb); pit++) {
+                    meet(state, out[*pit]);
+                }
+                if (state.top) {
+                    continue;
+                }
+            }
+
+            for (BasicBlock::iterator it = bb->begin(); it != bb->end(); it++) {
+                step(it, state, false, false, unused);
+            }
+
+            Lockset& old = out[bb];
+            if (old.top || old.held != state.held) {
+                old = state;
+                blockChanged = true;
+            }
+        }
+    }
+
+    bool changed = false;
+    for (Function::iterator bit = f->begin(); bit != f->end(); bit++) {
+        BasicBlock* bb = bit;
+        Lockset state;
+        if (bb == &f->getEntryBlock()) {
+            state = entry;
+        } else {
+            for (pred_iterator pit = pred_begin(bb); pit != pred_end(bb); pit++) {
+                meet(state, out[*pit]);
+            }
+            // unreachable blocks hold nothing
+            state.top = false;
+        }
+
+        for (BasicBlock::iterator it = bb->begin(); it != bb->end(); it++) {
+            step(it, state, true, collect, changed);
+        }
+    }
+    return changed;
+}
+
+void LocksetAnalysis::analyze(Module* module) {
+    computeUnlocks(module);
+
+    for (Module::iterator fit = module->begin(); fit != module->end(); fit++) {
+        Function* f = fit;
+        if (f->isDeclaration()) {
+            continue;
+        }
+        if (f->getName() == "main" || f->use_empty() || isAddressTaken(f)) {
+            roots.insert(f);
+            entries[f].top = false;
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Module::iterator fit = module->begin(); fit != module->end(); fit++) {
+            if (!fit->isDeclaration() && transfer(fit, false)) {
+                changed = true;
+            }
+        }
+    }
+
+    for (Module::iterator fit = module->begin(); fit != module->end(); fit++) {
+        if (!fit->isDeclaration()) {
+            transfer(fit, true);
+        }
+    }
+}
+
+bool LocksetAnalysis::isProtected(int svIdx) const {
+    if (syncObjects.count(svIdx)) {
+        return false;
+    }
+
+    auto it = guards.find(svIdx);
+    return it != guards.end() && !it->second.top && !it->second.held.empty();
+}
@@ -0,0 +1,78 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "Transformer/RegionCoarsening.h"
+#include "Transformer/AccessElision.h"
+
+#include <algorithm>
+
+RegionCoarsening::~RegionCoarsening() {
+    for (unsigned i = 0; i < regions.size(); i++) {
+        delete regions[i];
+    }
+}
+
+void RegionCoarsening::close(vector<Instruction*>& accesses, vector<int>& vars) {
+    if (accesses.size() >= 2) {
+        Region* r = new Region;
+        r->first = accesses.front();
+        r->last = accesses.back();
+        r->svIndices = vars;
+        sort(r->svIndices.begin(), r->svIndices.end());
+        regions.push_back(r);
+
+        for (unsigned i = 0; i < accesses.size(); i++) {
+            regionOf[accesses[i]] = r;
+        }
+        numAccesses += accesses.size();
+    }
+
+    accesses.clear();
+    vars.clear();
+}
+
+void RegionCoarsening::analyze(Function* f) {
+    for (Function::iterator bit = f->begin(); bit != f->end(); bit++) {
+        vector<Instruction*> accesses;
+        vector<int> vars;
+        unsigned pos = 0, start = 0;
+
+        for (BasicBlock::iterator it = bit->begin(); it != bit->end(); it++, pos++) {
+            Instruction* inst = it;
+
+            if (AccessElision::isBarrier(inst)) {
+                close(accesses, vars);
+                continue;
+            }
+
+            int svIdx = -1;
+            if (LoadInst* load = dyn_cast<LoadInst>(inst)) {
+                svIdx = getIndex(load->getPointerOperand());
+            } else if (StoreInst* store = dyn_cast<StoreInst>(inst)) {
+                svIdx = getIndex(store->getPointerOperand());
+            }
+
+            if (svIdx == -1) {
+                continue;
+            }
+
+            bool newVar = find(vars.begin(), vars.end(), svIdx) == vars.end();
+            if (!accesses.empty() && ((newVar && vars.size() >= maxVars) || pos - start >= maxSize)) {
+                close(accesses, vars);
+                newVar = true;
+            }
+
+            if (accesses.empty()) {
+                start = pos;
+            }
+            accesses.push_back(inst);
+            if (newVar) {
+                vars.push_back(svIdx);
+            }
+        }
+
+        close(accesses, vars);
+    }
+}
@@ -0,0 +1,186 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "Transformer/ThreadPhaseAnalysis.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+
+ThreadPhaseAnalysis::ThreadPhaseAnalysis(const IndexFunction& indexFunc, DyckAliasAnalysis* AA) :
+        getIndex(indexFunc), callGraph(NULL), mainFunction(NULL) {
+    if (AA->callGraphPreserved()) {
+        callGraph = AA->getCallGraph();
+    }
+}
+
+bool ThreadPhaseAnalysis::mayCreateThread(CallInst* call) {
+    if (isa<IntrinsicInst>(call)) {
+        return false;
+    }
+
+    set<Function*> callees;
+    if (!getCallees(call, callGraph, callees)) {
+        return true;
+    }
+    for (auto it = callees.begin(); it != callees.end(); it++) {
+        if (spawners.count(*it)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPhaseAnalysis::computeSpawners(Module* module) {
+    Function* pthreadCreate = module->getFunction("pthread_create");
+    if (pthreadCreate == NULL) {
+        return;
+    }
+    spawners.insert(pthreadCreate);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Module::iterator fit = module->begin(); fit != module->end(); fit++) {
+            Function* f = fit;
+            if (spawners.count(f)) {
+                continue;
+            }
+            for (inst_iterator it = inst_begin(f); it != inst_end(f); it++) {
+                if (isa<CallInst>(&*it) && mayCreateThread((CallInst*) &*it)) {
+                    spawners.insert(f);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void ThreadPhaseAnalysis::computeMainPhases() {
+    // forward reachability from the points right after the calls that may create threads
+    set<BasicBlock*> visited;
+    vector<BasicBlock*> worklist;
+    for (Function::iterator bit = mainFunction->begin(); bit != mainFunction->end(); bit++) {
+        bool afterSpawn = false;
+        for (BasicBlock::iterator it = bit->begin(); it != bit->end(); it++) {
+            if (afterSpawn) {
+                multiThreadedInMain.insert(it);
+            } else if (isa<CallInst>(it) && mayCreateThread((CallInst*) &*it)) {
+                afterSpawn = true;
+            }
+        }
+        if (afterSpawn) {
+            for (succ_iterator sit = succ_begin(bit); sit != succ_end(bit); sit++) {
+                worklist.push_back(*sit);
+            }
+        }
+    }
+
+    while (!worklist.empty()) {
+        BasicBlock* bb = worklist.back();
+        worklist.pop_back();
+        if (!visited.insert(bb).second) {
+            continue;
+        }
+        for (BasicBlock::iterator it = bb->begin(); it != bb->end(); it++) {
+            multiThreadedInMain.insert(it);
+        }
+        for (succ_iterator sit = succ_begin(bb); sit != succ_end(bb); sit++) {
+            worklist.push_back(*sit);
+        }
+    }
+}
+
+void ThreadPhaseAnalysis::computeSingleThreadedFunctions(Module* module) {
+    // the greatest fix point: drop the functions with a call site that may be multi-threaded
+    for (Module::iterator fit = module->begin(); fit != module->end(); fit++) {
+        Function* f = fit;
+        if (f != mainFunction && !f->isDeclaration() && !spawners.count(f) && !isAddressTaken(f)) {
+            singleThreadedFunctions.insert(f);
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto fit = singleThreadedFunctions.begin(); fit != singleThreadedFunctions.end();) {
+            Function* f = *fit;
+            bool single = true;
+            for (Value::user_iterator it = f->user_begin(); it != f->user_end() && single; it++) {
+                // not address-taken, so all users are direct calls
+                single = this->isSingleThreaded((CallInst*) (*it));
+            }
+            if (!single) {
+                singleThreadedFunctions.erase(fit++);
+                changed = true;
+            } else {
+                fit++;
+            }
+        }
+    }
+}
+
+void ThreadPhaseAnalysis::computeWrites(Module* module) {
+    for (Module::iterator fit = module->begin(); fit != module->end(); fit++) {
+        for (inst_iterator it = inst_begin(fit); it != inst_end(fit); it++) {
+            Instruction* inst = &*it;
+            if (this->isSingleThreaded(inst)) {
+                continue;
+            }
+
+            if (StoreInst* store = dyn_cast<StoreInst>(inst)) {
+                writtenWhenMultiThreaded.insert(getIndex(store->getPointerOperand()));
+            } else if (AtomicRMWInst* rmw = dyn_cast<AtomicRMWInst>(inst)) {
+                writtenWhenMultiThreaded.insert(getIndex(rmw->getPointerOperand()));
+            } else if (AtomicCmpXchgInst* cas = dyn_cast<AtomicCmpXchgInst>(inst)) {
+                writtenWhenMultiThreaded.insert(getIndex(cas->getPointerOperand()));
+            } else if (CallInst* call = dyn_cast<CallInst>(inst)) {
+                if (isa<DbgInfoIntrinsic>(call)) {
+                    continue;
+                }
+
+                // the writes in functions with bodies are visited themselves
+                set<Function*> callees;
+                bool external = !getCallees(call, callGraph, callees) || call->isInlineAsm();
+                for (auto cit = callees.begin(); cit != callees.end() && !external; cit++) {
+                    external = (*cit)->isDeclaration();
+                }
+                if (!external) {
+                    continue;
+                }
+                for (unsigned i = 0; i < call->getNumArgOperands(); i++) {
+                    writtenWhenMultiThreaded.insert(getIndex(call->getArgOperand(i)));
+                }
+            }
+        }
+    }
+    writtenWhenMultiThreaded.erase(-1);
+}
+
+void ThreadPhaseAnalysis::analyze(Module* module) {
+    mainFunction = module->getFunction("main");
+    if (mainFunction == NULL || mainFunction->isDeclaration() || isAddressTaken(mainFunction) || !mainFunction->use_empty()) {
+        // no single-threaded phase is known
+        mainFunction = NULL;
+        return;
+    }
+
+    computeSpawners(module);
+    computeMainPhases();
+    computeSingleThreadedFunctions(module);
+    computeWrites(module);
+}
+
+bool ThreadPhaseAnalysis::isSingleThreaded(Instruction* inst) const {
+    if (mainFunction == NULL) {
+        return false;
+    }
+
+    Function* f = inst->getParent()->getParent();
+    if (f == mainFunction) {
+        return !multiThreadedInMain.count(inst);
+    }
+    return singleThreadedFunctions.count(f);
+}
@@ -9,6 +9,7 @@
 #include "Transformer/Transformer.h"
 #include <llvm/Support/Debug.h>
 #include <list>
+#include <algorithm>
 
 //Transformer::Transformer(Module* m, set<Value*>* svs, unsigned psize) {
 //    module = m;
@@ -124,6 +125,65 @@ CallInst* Transformer::insertCallInstAtTail(Function* theFunc, Function* tocall,
     return NULL;
 }
 
+static void numberValue(Value* v, std::unordered_map<const Value*, unsigned>& order) {
+    if (!order.insert(std::make_pair(v, (unsigned) order.size())).second)
+        return;
+
+    // constant expressions are only reachable from their users
+    if (ConstantExpr* ce = dyn_cast<ConstantExpr>(v)) {
+        for (unsigned i = 0; i < ce->getNumOperands(); i++)
+            numberValue(ce->getOperand(i), order);
+    }
+}
+
+void Transformer::indexSharedVariables(Module* module, std::vector<const set<Value*>*>& svs,
+        std::unordered_map<const Value*, int>& index) {
+    std::unordered_map<const Value*, unsigned> order;
+    for (auto git = module->global_begin(); git != module->global_end(); git++) {
+        numberValue(git, order);
+    }
+    for (auto fit = module->begin(); fit != module->end(); fit++) {
+        numberValue(fit, order);
+        for (auto ait = fit->arg_begin(); ait != fit->arg_end(); ait++) {
+            numberValue(ait, order);
+        }
+        for (auto bit = fit->begin(); bit != fit->end(); bit++) {
+            for (auto iit = bit->begin(); iit != bit->end(); iit++) {
+                numberValue(iit, order);
+                for (unsigned i = 0; i < iit->getNumOperands(); i++) {
+                    numberValue(iit->getOperand(i), order);
+                }
+            }
+        }
+    }
+
+    // the sets come from a std::set of vertices, whose order depends on addresses
+    std::vector<std::pair<unsigned, const set<Value*>*> > keyed;
+    for (unsigned i = 0; i < svs.size(); i++) {
+        unsigned key = ~0U;
+        for (auto vit = svs[i]->begin(); vit != svs[i]->end(); vit++) {
+            auto it = order.find(*vit);
+            if (it != order.end() && it->second < key)
+                key = it->second;
+        }
+        keyed.push_back(std::make_pair(key, svs[i]));
+    }
+    // sets do not overlap, so only sets without values in the module tie;
+    // they cannot be looked up and are kept at the end
+    std::stable_sort(keyed.begin(), keyed.end(),
+            [](const std::pair<unsigned, const set<Value*>*>& a, const std::pair<unsigned, const set<Value*>*>& b) {
+                return a.first < b.first;
+            });
+
+    index.clear();
+    for (unsigned i = 0; i < keyed.size(); i++) {
+        svs[i] = keyed[i].second;
+        for (auto vit = svs[i]->begin(); vit != svs[i]->end(); vit++) {
+            index[*vit] = i;
+        }
+    }
+}
+
 void Transformer::transform(Module* module, AliasAnalysis* AAptr) {
     AliasAnalysis& AA = *AAptr;
     this->beforeTransform(module, AA);
@@ -140,6 +200,10 @@ void Transformer::transform(Module* module, AliasAnalysis* AAptr) {
 
         outs() << "Remaining... " << (functionsNum - handledNum++) << " functions             \r";
 
+        if (!this->beforeTransformFunction(module, &f)) {
+            continue;
+        }
+
         bool allocHasHandled = false;
         vector<AllocaInst*> allocas;
         for (ilist_iterator<BasicBlock> iterB = f.getBasicBlockList().begin(); iterB != f.getBasicBlockList().end(); iterB++) {
@@ -266,6 +330,14 @@ bool Transformer::handleCalls(Module* module, CallInst* call, Function* calledFu
         // system exit
         transformSystemExit(module, call, AA);
         return true;
+    } else if (cf.isDeclaration() && (cf.getName().str() == "memcpy" || cf.getName().str() == "memmove")
+            && call->getNumArgOperands() == 3) {
+        // the library versions of the intrinsics
+        transformMemCpyMov(module, call, AA);
+        return true;
+    } else if (cf.isDeclaration() && cf.getName().str() == "memset" && call->getNumArgOperands() == 3) {
+        transformMemSet(module, call, AA);
+        return true;
     } else if (cf.getName().str() == "malloc" || cf.getName().str() == "calloc"
             || cf.getName().str() == "realloc"
             || cf.getName().str() == "_Znaj"
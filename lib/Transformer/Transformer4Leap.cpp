@@ -4,6 +4,10 @@
  */
 
 #include "Transformer/Transformer4Leap.h"
+#include "LeapSupport/FastPath.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/CommandLine.h"
 
 #define POINTER_BIT_SIZE ptrsize*8
 #define INT_BIT_SIZE 32
@@ -11,13 +15,66 @@
 #define FUNCTION_ARG_TYPE Type::getVoidTy(context),Type::getIntNTy(context,INT_BIT_SIZE),(Type*)0
 #define FUNCTION_LDST_ARG_TYPE Type::getVoidTy(context),Type::getIntNTy(context,INT_BIT_SIZE),Type::getIntNTy(context,INT_BIT_SIZE),(Type*)0
 #define FUNCTION_WAIT_ARG_TYPE Type::getVoidTy(context),Type::getIntNTy(context,INT_BIT_SIZE),Type::getIntNTy(context,POINTER_BIT_SIZE),Type::getIntNTy(context,POINTER_BIT_SIZE),(Type*)0
+#define FUNCTION_MEM_ARG_TYPE Type::getVoidTy(context),Type::getIntNTy(context,INT_BIT_SIZE),Type::getIntNTy(context,INT_BIT_SIZE),Type::getIntNTy(context,INT_BIT_SIZE),(Type*)0
+#define FUNCTION_PREATOMIC_ARG_TYPE Type::getVoidTy(context),Type::getIntNTy(context,INT_BIT_SIZE),Type::getInt8PtrTy(context,0),Type::getIntNTy(context,INT_BIT_SIZE),Type::getIntNTy(context,INT_BIT_SIZE),(Type*)0
+#define FUNCTION_ATOMIC_ARG_TYPE Type::getVoidTy(context),Type::getIntNTy(context,INT_BIT_SIZE),Type::getInt64Ty(context),Type::getIntNTy(context,INT_BIT_SIZE),(Type*)0
 #define FUNCTION_FORK_ARG_TYPE Type::getVoidTy(context),Type::getIntNTy(context,POINTER_BIT_SIZE),(Type*)0
 
+static cl::opt<bool> ElideRedundantAccesses("leap-elide-redundant-accesses", cl::init(false), cl::Hidden,
+        cl::desc("Do not record a shared access if the same thread has recorded one to the same shared variable "
+                "on every path to it, with no synchronization or call in between. Races between the two "
+                "accesses may then not be reproduced on replay."));
+
+static cl::opt<bool> InlineFastPath("leap-inline-fast-path", cl::init(false), cl::Hidden,
+        cl::desc("Record shared loads and stores with inline code, and only call the recorder "
+                "for new threads, contention and full logs."));
+
+static cl::opt<bool> RegionCoarseningMode("leap-region-coarsening", cl::init(false), cl::Hidden,
+        cl::desc("Lock and log the shared variables of a run of accesses in a basic block once, "
+                "instead of once per access."));
+
+static cl::opt<unsigned> MaxRegionSize("leap-max-region-size", cl::init(32), cl::Hidden,
+        cl::desc("The maximum number of instructions of a region with -leap-region-coarsening."));
+
+static cl::opt<unsigned> MaxRegionVars("leap-max-region-vars", cl::init(4), cl::Hidden,
+        cl::desc("The maximum number of shared variables of a region with -leap-region-coarsening."));
+
+static cl::opt<std::string> ProfileFile("leap-profile", cl::init(""), cl::Hidden,
+        cl::desc("A profile from the leap profiler (-lleapprofile). The loads and stores of shared variables "
+                "that were only accessed by one thread at a time only check the owner thread."));
+
+static cl::opt<std::string> ProfileReportFile("leap-profile-report", cl::init("leap.profile.report"), cl::Hidden,
+        cl::desc("Where to write the decisions made with -leap-profile."));
+
+static cl::opt<unsigned long> ProfileHotCount("leap-profile-hot-count", cl::init(1000), cl::Hidden,
+        cl::desc("A site that ran at least this many times when profiled is hot in the -leap-profile report."));
+
+static cl::opt<bool> ThreadPhases("leap-thread-phases", cl::init(true), cl::Hidden,
+        cl::desc("Do not record the shared accesses that run before any thread is created, "
+                "or that read shared variables only written before that."));
+
+static cl::opt<std::string> IdFile("leap-ids", cl::init(""), cl::Hidden,
+        cl::desc("Keep the ids of shared variables and the debug indices of unchanged functions "
+                "in this file from one instrumentation to the next, and their instrumented bodies "
+                "in <file>.bc."));
+
+static cl::opt<bool> CompactIds("leap-ids-compact", cl::init(false), cl::Hidden,
+        cl::desc("Renumber the shared variables and debug indices of -leap-ids without the retired ones. "
+                "Logs recorded by older builds are not replayable after that."));
+
+static cl::opt<bool> LocksetElision("leap-lockset-elision", cl::init(true), cl::Hidden,
+        cl::desc("Do not record the loads and stores of shared variables that are always accessed "
+                "holding the same global mutex, whose acquisitions are recorded."));
+
 int Transformer4Leap::stmt_idx = 0;
 
 char Transformer4Leap::ID = 0;
 
-Transformer4Leap::Transformer4Leap() : ModulePass(ID) {
+Transformer4Leap::Transformer4Leap() : ModulePass(ID), F_create(NULL),
+        F_fast_preaccess(NULL), F_fast_postaccess(NULL), F_slow_preaccess(NULL),
+        F_preregion(NULL), F_region(NULL), F_ownercheck(NULL), F_ownercheckend(NULL), elision(NULL), regions(NULL), profile(NULL),
+        phases(NULL), numSingleThreadedSites(0), numReadOnlySites(0), locksets(NULL), numProtectedSites(0),
+        ids(NULL), bodies(NULL) {
 }
 
 bool Transformer4Leap::debug() {
@@ -53,6 +110,12 @@ void Transformer4Leap::beforeTransform(Module* m, AliasAnalysis& AA) {
     F_prefork = cast<Function>(m->getOrInsertFunction("OnPreFork", FUNCTION_ARG_TYPE));
     F_fork = cast<Function>(m->getOrInsertFunction("OnFork", FUNCTION_FORK_ARG_TYPE));
 
+    // the runtime gives a thread its id before it starts, see LeapSupport/ThreadStart.h
+    Function* create = m->getFunction("pthread_create");
+    if (create != NULL) {
+        F_create = cast<Function>(m->getOrInsertFunction("__leap_pthread_create", create->getFunctionType()));
+    }
+
     F_prejoin = cast<Function>(m->getOrInsertFunction("OnPreJoin", FUNCTION_ARG_TYPE));
     F_join = cast<Function>(m->getOrInsertFunction("OnJoin", FUNCTION_ARG_TYPE));
 
@@ -61,6 +124,81 @@ void Transformer4Leap::beforeTransform(Module* m, AliasAnalysis& AA) {
 
     F_prewait = cast<Function>(m->getOrInsertFunction("OnPreWait", FUNCTION_ARG_TYPE));
     F_wait = cast<Function>(m->getOrInsertFunction("OnWait", FUNCTION_WAIT_ARG_TYPE));
+
+    F_prememaccess = cast<Function>(m->getOrInsertFunction("OnPreMemAccess", FUNCTION_MEM_ARG_TYPE));
+    F_memaccess = cast<Function>(m->getOrInsertFunction("OnMemAccess", FUNCTION_MEM_ARG_TYPE));
+
+    F_preatomic = cast<Function>(m->getOrInsertFunction("OnPreAtomic", FUNCTION_PREATOMIC_ARG_TYPE));
+    F_atomic = cast<Function>(m->getOrInsertFunction("OnAtomic", FUNCTION_ATOMIC_ARG_TYPE));
+
+    if (InlineFastPath) {
+        this->createFastPathFunctions(m);
+    }
+
+    if (!ProfileFile.empty()) {
+        F_ownercheck = cast<Function>(m->getOrInsertFunction("OnOwnerCheck", FUNCTION_LDST_ARG_TYPE));
+        F_ownercheckend = cast<Function>(m->getOrInsertFunction("OnOwnerCheckEnd", FUNCTION_LDST_ARG_TYPE));
+
+        std::string error;
+        profile = new LeapProfile;
+        if (!profile->load(ProfileFile, sharedVariables.size(), error)) {
+            errs() << "[Canary] Invalid -leap-profile: " << error << "\n";
+            exit(1);
+        }
+    }
+
+    // analyze all functions before any of them is instrumented
+    AliasAnalysis* AAptr = &AA;
+    auto indexFunc = [this, m, AAptr](Value * v) {
+        return this->getValueIndex(m, v, *AAptr);
+    };
+
+    if (ElideRedundantAccesses) {
+        elision = new AccessElision(indexFunc);
+        for (Module::iterator it = m->begin(); it != m->end(); it++) {
+            if (this->functionToTransform(m, it)) {
+                elision->analyze(it);
+            }
+        }
+    }
+
+    if (RegionCoarseningMode) {
+        // void OnPreRegion(int* svIds, int num, int debug)
+        Type* regionArgs[] = {PointerType::getUnqual(Type::getIntNTy(context, INT_BIT_SIZE)),
+            Type::getIntNTy(context, INT_BIT_SIZE), Type::getIntNTy(context, INT_BIT_SIZE)};
+        FunctionType* regionTy = FunctionType::get(Type::getVoidTy(context), regionArgs, false);
+        F_preregion = cast<Function>(m->getOrInsertFunction("OnPreRegion", regionTy));
+        F_region = cast<Function>(m->getOrInsertFunction("OnRegion", regionTy));
+
+        regions = new RegionCoarsening(indexFunc, MaxRegionSize, MaxRegionVars);
+        for (Module::iterator it = m->begin(); it != m->end(); it++) {
+            if (this->functionToTransform(m, it)) {
+                regions->analyze(it);
+            }
+        }
+    }
+
+    if (ids != NULL) {
+        ids->assignFunctions(m, [this, m](Function * f) {
+            return this->functionToTransform(m, f);
+        }, indexFunc, [this, m, AAptr](Function * f) {
+            return this->hashDecisions(m, f, *AAptr);
+        });
+    }
+}
+
+bool Transformer4Leap::beforeTransformFunction(Module* module, Function* f) {
+    if (ids == NULL) {
+        return true;
+    }
+
+    // OnInit and OnExit go into main with the number of shared variables
+    if (bodies != NULL && f->getName() != "main" && ids->isUnchanged(f) && bodies->has(f)) {
+        bodies->reuse(f);
+        return false;
+    }
+    stmt_idx = ids->getDebugBase(f);
+    return true;
 }
 
 void Transformer4Leap::afterTransform(Module* module, AliasAnalysis& AA) {
@@ -70,6 +208,85 @@ void Transformer4Leap::afterTransform(Module* module, AliasAnalysis& AA) {
         this->insertCallInstAtHead(mainFunction, F_init, tmp, NULL);
         this->insertCallInstAtTail(mainFunction, F_exit, tmp, NULL);
     }
+
+    if (elision != NULL) {
+        outs() << "\n";
+        elision->printReport(module, outs());
+        delete elision;
+        elision = NULL;
+    }
+
+    if (regions != NULL) {
+        outs() << "[Region] " << regions->getNumCoveredAccesses() << " access sites are recorded in "
+                << regions->getNumRegions() << " regions.\n";
+        delete regions;
+        regions = NULL;
+        regionIndices.clear();
+    }
+
+    if (profile != NULL) {
+        if (profile->writeReport(ProfileReportFile, ProfileHotCount)) {
+            outs() << "[Profile] The instrumentation decisions are written to " << ProfileReportFile << ".\n";
+        } else {
+            errs() << "[Profile] Cannot write " << ProfileReportFile << ".\n";
+        }
+        delete profile;
+        profile = NULL;
+    }
+
+    if (phases != NULL) {
+        outs() << "[Phase] " << numSingleThreadedSites << " access sites only run before threads are created, "
+                << numReadOnlySites << " loads read shared variables only written before that.\n";
+        delete phases;
+        phases = NULL;
+    }
+
+    if (locksets != NULL) {
+        outs() << "[Lockset] " << numProtectedSites << " access sites are protected by a global mutex.\n";
+        delete locksets;
+        locksets = NULL;
+    }
+
+    if (ids != NULL) {
+        std::string error;
+        std::string bodyFile = IdFile + ".bc";
+        if (bodies != NULL) {
+            if (!bodies->restore(module, error)) {
+                errs() << "[Ids] " << error << "; delete " << bodyFile << " to instrument every function.\n";
+                exit(1);
+            }
+            outs() << "[Ids] " << bodies->getNumReused() << " unchanged functions are not instrumented again, "
+                    << "their bodies are taken from " << bodyFile << ".\n";
+            delete bodies;
+            bodies = NULL;
+        }
+
+        set<string> cached;
+        for (Module::iterator it = module->begin(); it != module->end(); it++) {
+            if (it->hasName() && it->getName() != "main" && this->functionToTransform(module, it)) {
+                cached.insert(it->getName().str());
+            }
+        }
+        if (!LeapBodyCache::save(module, cached, bodyFile, error)) {
+            errs() << "[Ids] Cannot write " << bodyFile << ": " << error << ".\n";
+        }
+
+        if (ids->save(IdFile)) {
+            outs() << "[Ids] " << ids->getNumChangedFunctions() << " of " << ids->getNumFunctions()
+                    << " functions are new or changed; the ids are saved in " << IdFile << ".\n";
+        } else {
+            errs() << "[Ids] Cannot write " << IdFile << ".\n";
+        }
+        if (CompactIds) {
+            outs() << "[Ids] " << ids->getNumRetiredIds() << " retired shared variable ids are dropped and the debug "
+                    << "indices are packed; logs recorded by older builds are not replayable.\n";
+        } else if (ids->getNumRetiredIds() > 0 || ids->getNumUnusedDebugIndices() > 0) {
+            outs() << "[Ids] " << ids->getNumRetiredIds() << " shared variable ids and " << ids->getNumUnusedDebugIndices()
+                    << " debug indices are retired; -leap-ids-compact drops them.\n";
+        }
+        delete ids;
+        ids = NULL;
+    }
 }
 
 bool Transformer4Leap::functionToTransform(Module* module, Function* f) {
@@ -85,25 +302,85 @@ bool Transformer4Leap::instructionToTransform(Module* module, Instruction* ins)
 }
 
 void Transformer4Leap::transformLoadInst(Module* module, LoadInst* inst, AliasAnalysis& AA) {
+    // a whole region is either single-threaded or not, since creating a thread ends it
+    if (phases != NULL && phases->isSingleThreaded(inst)) {
+        if (this->getValueIndex(module, inst->getOperand(0), AA) != -1) numSingleThreadedSites++;
+        return;
+    }
+    if (regions != NULL && this->transformRegionAccess(module, inst)) return;
+    if (elision != NULL && elision->isRedundant(inst)) return;
+
     Value * val = inst->getOperand(0);
     int svIdx = this->getValueIndex(module, val, AA);
     if (svIdx == -1) return;
 
+    if (phases != NULL && phases->isReadOnlyShared(svIdx)) {
+        numReadOnlySites++;
+        return;
+    }
+    if (locksets != NULL && locksets->isProtected(svIdx)) {
+        numProtectedSites++;
+        return;
+    }
+
     ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx);
     ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
 
+    if (profile != NULL && profile->isSingleOwner(svIdx)) {
+        profile->noteOwnerCheck(svIdx, debug_idx->getSExtValue(), inst);
+        this->insertCallInstBefore(inst, F_ownercheck, tmp, debug_idx, NULL);
+        this->insertCallInstAfter(inst, F_ownercheckend, tmp, debug_idx, NULL);
+        return;
+    } else if (profile != NULL) {
+        profile->noteRecorded();
+    }
+
+    if (InlineFastPath) {
+        CallInst* held = this->insertCallInstBefore(inst, F_fast_preaccess, tmp, debug_idx, NULL);
+        this->insertCallInstAfter(inst, F_fast_postaccess, tmp, held, NULL);
+        return;
+    }
+
     this->insertCallInstBefore(inst, F_preload, tmp, debug_idx, NULL);
     this->insertCallInstAfter(inst, F_load, tmp, debug_idx, NULL);
 }
 
 void Transformer4Leap::transformStoreInst(Module* module, StoreInst* inst, AliasAnalysis& AA) {
+    // a whole region is either single-threaded or not, since creating a thread ends it
+    if (phases != NULL && phases->isSingleThreaded(inst)) {
+        if (this->getValueIndex(module, inst->getOperand(1), AA) != -1) numSingleThreadedSites++;
+        return;
+    }
+    if (regions != NULL && this->transformRegionAccess(module, inst)) return;
+    if (elision != NULL && elision->isRedundant(inst)) return;
+
     Value * val = inst->getOperand(1);
     int svIdx = this->getValueIndex(module, val, AA);
     if (svIdx == -1) return;
 
+    if (locksets != NULL && locksets->isProtected(svIdx)) {
+        numProtectedSites++;
+        return;
+    }
+
     ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx);
     ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
 
+    if (profile != NULL && profile->isSingleOwner(svIdx)) {
+        profile->noteOwnerCheck(svIdx, debug_idx->getSExtValue(), inst);
+        this->insertCallInstBefore(inst, F_ownercheck, tmp, debug_idx, NULL);
+        this->insertCallInstAfter(inst, F_ownercheckend, tmp, debug_idx, NULL);
+        return;
+    } else if (profile != NULL) {
+        profile->noteRecorded();
+    }
+
+    if (InlineFastPath) {
+        CallInst* held = this->insertCallInstBefore(inst, F_fast_preaccess, tmp, debug_idx, NULL);
+        this->insertCallInstAfter(inst, F_fast_postaccess, tmp, held, NULL);
+        return;
+    }
+
     this->insertCallInstBefore(inst, F_prestore, tmp, debug_idx, NULL);
     this->insertCallInstAfter(inst, F_store, tmp, debug_idx, NULL);
 }
@@ -112,6 +389,18 @@ void Transformer4Leap::transformPthreadCreate(Module* module, CallInst* ins, Ali
     ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), -1);
     this->insertCallInstBefore(ins, F_prefork, tmp, NULL);
 
+    Function* create = module->getFunction("pthread_create");
+    Value* callee = ins->getCalledValue();
+    if (F_create != NULL && callee->stripPointerCasts() == create) {
+        ins->setCalledFunction(ConstantExpr::getPointerCast(F_create, callee->getType()));
+    } else if (F_create != NULL && !isa<Function>(callee->stripPointerCasts())) {
+        // a pointer call the call graph says may call pthread_create: it calls
+        // the wrapper when the pointer is pthread_create
+        IRBuilder<> builder(ins);
+        Value* isCreate = builder.CreateICmpEQ(callee, ConstantExpr::getPointerCast(create, callee->getType()));
+        ins->setCalledFunction(builder.CreateSelect(isCreate, ConstantExpr::getPointerCast(F_create, callee->getType()), callee));
+    }
+
     CastInst* c = CastInst::CreatePointerCast(ins->getArgOperand(0), Type::getIntNTy(module->getContext(), POINTER_BIT_SIZE));
     c->insertAfter(ins);
     this->insertCallInstAfter(c, F_fork, c, NULL);
@@ -197,72 +486,140 @@ void Transformer4Leap::transformSystemExit(Module* module, CallInst* ins, AliasA
 }
 
 void Transformer4Leap::transformMemCpyMov(Module* module, CallInst* call, AliasAnalysis& AA) {
-    Value * dst = call->getArgOperand(0);
-    Value * src = call->getArgOperand(1);
-    int svIdx_dst = this->getValueIndex(module, dst, AA);
-    int svIdx_src = this->getValueIndex(module, src, AA);
-    if (svIdx_dst == -1 && svIdx_src == -1) {
+    int svIdx_dst = this->getValueIndex(module, call->getArgOperand(0), AA);
+    int svIdx_src = this->getValueIndex(module, call->getArgOperand(1), AA);
+    this->transformMemAccess(module, call, svIdx_dst, svIdx_src);
+}
+
+void Transformer4Leap::transformMemSet(Module* module, CallInst* call, AliasAnalysis& AA) {
+    int svIdx = this->getValueIndex(module, call->getArgOperand(0), AA);
+    this->transformMemAccess(module, call, svIdx, -1);
+}
+
+void Transformer4Leap::transformMemAccess(Module* module, CallInst* call, int svIdx_dst, int svIdx_src) {
+    if (svIdx_dst == -1 && svIdx_src == -1) return;
+
+    if (phases != NULL && phases->isSingleThreaded(call)) {
+        numSingleThreadedSites++;
         return;
-    } else if (svIdx_dst != -1 && svIdx_src != -1) {
-        if (svIdx_dst > svIdx_src) {
-            ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx_dst);
-            ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
+    }
+    if (phases != NULL && svIdx_src != -1 && svIdx_src != svIdx_dst && phases->isReadOnlyShared(svIdx_src)) {
+        svIdx_src = -1;
+    }
+    if (locksets != NULL && svIdx_dst != -1 && locksets->isProtected(svIdx_dst)) {
+        svIdx_dst = -1;
+    }
+    if (locksets != NULL && svIdx_src != -1 && locksets->isProtected(svIdx_src)) {
+        svIdx_src = -1;
+    }
 
-            this->insertCallInstBefore(call, F_prestore, tmp, debug_idx, NULL);
-            this->insertCallInstAfter(call, F_store, tmp, debug_idx, NULL);
+    // the runtime locks them in ascending order
+    int first = svIdx_dst, second = svIdx_src;
+    if (first == -1 || first == second) {
+        first = second;
+        second = -1;
+    } else if (second != -1 && second < first) {
+        std::swap(first, second);
+    }
+    if (first == -1) return;
 
-            tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx_src);
-            debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
+    ConstantInt* tmp1 = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), first);
+    ConstantInt* tmp2 = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), second);
+    ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
 
-            this->insertCallInstBefore(call, F_preload, tmp, debug_idx, NULL);
-            this->insertCallInstAfter(call, F_load, tmp, debug_idx, NULL);
+    this->insertCallInstBefore(call, F_prememaccess, tmp1, tmp2, debug_idx, NULL);
+    this->insertCallInstAfter(call, F_memaccess, tmp1, tmp2, debug_idx, NULL);
+}
 
-        } else if (svIdx_dst < svIdx_src) {
-            ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx_src);
-            ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
+void Transformer4Leap::transformAtomicCmpXchgInst(Module* module, AtomicCmpXchgInst* inst, AliasAnalysis& AA) {
+    this->transformAtomicAccess(module, inst, inst->getPointerOperand(), inst->getNewValOperand(), AA);
+}
 
+void Transformer4Leap::transformAtomicRMWInst(Module* module, AtomicRMWInst* inst, AliasAnalysis& AA) {
+    this->transformAtomicAccess(module, inst, inst->getPointerOperand(), inst->getValOperand(), AA);
+}
 
-            tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx_dst);
-            debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
-            this->insertCallInstBefore(call, F_prestore, tmp, debug_idx, NULL);
-            this->insertCallInstAfter(call, F_store, tmp, debug_idx, NULL);
-        } else {
-            ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx_src);
-            ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
+/// whether an atomic operation may read or write addresses: its values are
+/// pointers, or integers of the size of a pointer converted from or to one
+static bool mayHoldAddress(Instruction* inst, Value* value, unsigned pointerBits) {
+    if (value->getType()->isPointerTy()) {
+        return true;
+    }
+    if (!value->getType()->isIntegerTy(pointerBits)) {
+        return false;
+    }
+    if (isa<PtrToIntOperator>(value)) {
+        return true;
+    }
+    if (isa<AtomicCmpXchgInst>(inst) && isa<PtrToIntOperator>(((AtomicCmpXchgInst*) inst)->getCompareOperand())) {
+        return true;
+    }
 
-            this->insertCallInstBefore(call, F_preload, tmp, debug_idx, NULL);
-            this->insertCallInstAfter(call, F_load, tmp, debug_idx, NULL);
+    // the old value, which is the first element of the result of a cmpxchg
+    vector<Value*> observed;
+    if (isa<AtomicCmpXchgInst>(inst)) {
+        for (Value::user_iterator it = inst->user_begin(); it != inst->user_end(); it++) {
+            if (isa<ExtractValueInst>(*it) && ((ExtractValueInst*) (*it))->getIndices()[0] == 0) {
+                observed.push_back(*it);
+            }
+        }
+    } else {
+        observed.push_back(inst);
+    }
+    for (unsigned i = 0; i < observed.size(); i++) {
+        for (Value::user_iterator it = observed[i]->user_begin(); it != observed[i]->user_end(); it++) {
+            if (isa<IntToPtrInst>(*it)) {
+                return true;
+            }
         }
+    }
+    return false;
+}
 
-        return;
-    } else if (svIdx_dst != -1) {
-        int svIdx = svIdx_dst;
-        ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx);
-        ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
+void Transformer4Leap::transformAtomicAccess(Module* module, Instruction* inst, Value* pointer, Value* value, AliasAnalysis& AA) {
+    int svIdx = this->getValueIndex(module, pointer, AA);
+    if (svIdx == -1) return;
 
-        this->insertCallInstBefore(call, F_prestore, tmp, debug_idx, NULL);
-        this->insertCallInstAfter(call, F_store, tmp, debug_idx, NULL);
+    if (phases != NULL && phases->isSingleThreaded(inst)) {
+        numSingleThreadedSites++;
         return;
-    } else {
-        ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx_src);
-        ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
+    }
+
+    LLVMContext& context = module->getContext();
+    ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(context, INT_BIT_SIZE), svIdx);
+    ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(context, INT_BIT_SIZE), stmt_idx++);
 
-        this->insertCallInstBefore(call, F_preload, tmp, debug_idx, NULL);
-        this->insertCallInstAfter(call, F_load, tmp, debug_idx, NULL);
+    // Addresses differ from one run to the next (ASLR, the allocator), so the
+    // replayer could wait forever for an observed address. Such an operation
+    // is ordered with the other accesses of the shared variable instead.
+    if (mayHoldAddress(inst, value, POINTER_BIT_SIZE)) {
+        this->insertCallInstBefore(inst, F_prestore, tmp, debug_idx, NULL);
+        this->insertCallInstAfter(inst, F_store, tmp, debug_idx, NULL);
         return;
     }
-}
 
-void Transformer4Leap::transformMemSet(Module* module, CallInst* call, AliasAnalysis& AA) {
-    Value * val = call->getArgOperand(0);
-    int svIdx = this->getValueIndex(module, val, AA);
-    if (svIdx == -1) return;
-
-    ConstantInt* tmp = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), svIdx);
-    ConstantInt* debug_idx = ConstantInt::get(Type::getIntNTy(module->getContext(), INT_BIT_SIZE), stmt_idx++);
+    // the old value, which is the first element of the result of a cmpxchg
+    Instruction* observed = inst;
+    if (isa<AtomicCmpXchgInst>(inst)) {
+        observed = ExtractValueInst::Create(inst, 0);
+        observed->insertAfter(inst);
+    }
 
-    this->insertCallInstBefore(call, F_prestore, tmp, debug_idx, NULL);
-    this->insertCallInstAfter(call, F_store, tmp, debug_idx, NULL);
+    Type* valueTy = observed->getType();
+    ConstantInt* size = ConstantInt::get(Type::getIntNTy(context, INT_BIT_SIZE), AA.getDataLayout()->getTypeStoreSize(valueTy));
+    CastInst* addr = CastInst::CreatePointerCast(pointer, Type::getInt8PtrTy(context, 0));
+    addr->insertBefore(inst);
+    this->insertCallInstBefore(inst, F_preatomic, tmp, addr, size, debug_idx, NULL);
+
+    // the observed value is logged as an i64
+    Instruction* last = observed;
+    Value* logged = observed;
+    if (logged->getType() != Type::getInt64Ty(context)) {
+        CastInst* c = CastInst::CreateIntegerCast(logged, Type::getInt64Ty(context), false);
+        c->insertAfter(last);
+        logged = last = c;
+    }
+    this->insertCallInstAfter(last, F_atomic, tmp, logged, debug_idx, NULL);
 }
 
 void Transformer4Leap::transformOtherFunctionCalls(Module* module, CallInst* call, AliasAnalysis& AA) {
@@ -310,11 +667,184 @@ bool Transformer4Leap::isInstrumentationFunction(Module* module, Function * call
             || called == F_prefork || called == F_fork
             || called == F_prejoin || called == F_join
             || called == F_prenotify || called == F_notify
-            || called == F_prewait || called == F_wait;
+            || called == F_prewait || called == F_wait
+            || called == F_prememaccess || called == F_memaccess
+            || called == F_preatomic || called == F_atomic
+            || (called != NULL && (called == F_fast_preaccess || called == F_fast_postaccess || called == F_slow_preaccess
+            || called == F_preregion || called == F_region || called == F_ownercheck || called == F_ownercheckend || called == F_create));
 }
 
 // private functions
 
+bool Transformer4Leap::transformRegionAccess(Module* module, Instruction* inst) {
+    RegionCoarsening::Region* r = regions->getRegion(inst);
+    if (r == NULL) return false;
+
+    IntegerType* intTy = Type::getIntNTy(module->getContext(), INT_BIT_SIZE);
+    Constant*& indices = regionIndices[r];
+    if (indices == NULL) {
+        vector<Constant*> elements;
+        for (unsigned i = 0; i < r->svIndices.size(); i++) {
+            elements.push_back(ConstantInt::get(intTy, r->svIndices[i]));
+        }
+        Constant* init = ConstantArray::get(ArrayType::get(intTy, elements.size()), elements);
+        GlobalVariable* array = new GlobalVariable(*module, init->getType(), true, GlobalValue::PrivateLinkage, init, "__leap_region");
+        array->setUnnamedAddr(true);
+
+        vector<Value *> gepIndices;
+        gepIndices.push_back(ConstantInt::get(intTy, 0));
+        gepIndices.push_back(ConstantInt::get(intTy, 0));
+        indices = ConstantExpr::getGetElementPtr(array, gepIndices, true);
+    }
+
+    ConstantInt* num = ConstantInt::get(intTy, r->svIndices.size());
+    if (inst == r->first) {
+        ConstantInt* debug_idx = ConstantInt::get(intTy, stmt_idx++);
+        this->insertCallInstBefore(inst, F_preregion, indices, num, debug_idx, NULL);
+    }
+    if (inst == r->last) {
+        ConstantInt* debug_idx = ConstantInt::get(intTy, stmt_idx++);
+        this->insertCallInstAfter(inst, F_region, indices, num, debug_idx, NULL);
+    }
+    return true;
+}
+
+/// the LeapVar of svId; the records are LEAP_VAR_SIZE bytes apart, which is
+/// more than the fields the fast path uses
+static Value* createLeapVarGEP(IRBuilder<>& builder, GlobalVariable* vars, Value* svId) {
+    Type* varPtrTy = vars->getType()->getElementType();
+    Value* base = builder.CreateBitCast(builder.CreateLoad(vars), builder.getInt8PtrTy());
+    Value* offset = builder.CreateMul(svId, ConstantInt::get(svId->getType(), LEAP_VAR_SIZE));
+    return builder.CreateBitCast(builder.CreateGEP(base, offset), varPtrTy);
+}
+
+void Transformer4Leap::createFastPathFunctions(Module* m) {
+    LLVMContext& context = m->getContext();
+    IntegerType* intTy = Type::getIntNTy(context, INT_BIT_SIZE);
+    Constant* zero = ConstantInt::get(intTy, 0);
+    Constant* one = ConstantInt::get(intTy, 1);
+    Constant* two = ConstantInt::get(intTy, 2);
+
+    // struct LeapVar { int lock; unsigned idx; unsigned* log; unsigned capacity; ... }
+    Type* fields[] = {intTy, intTy, PointerType::getUnqual(intTy), intTy};
+    StructType* varTy = StructType::create(context, fields, "struct.LeapVar");
+
+    GlobalVariable* vars = cast<GlobalVariable>(m->getOrInsertGlobal(LEAP_VARS_SYMBOL, PointerType::getUnqual(varTy)));
+    GlobalVariable* recording = cast<GlobalVariable>(m->getOrInsertGlobal(LEAP_RECORDING_SYMBOL, intTy));
+    GlobalVariable* tidVar = cast<GlobalVariable>(m->getOrInsertGlobal(LEAP_TID_SYMBOL, intTy));
+    tidVar->setThreadLocal(true);
+    GlobalVariable* version = cast<GlobalVariable>(m->getOrInsertGlobal(LEAP_VERSION_SYMBOL, intTy));
+
+    F_slow_preaccess = cast<Function>(m->getOrInsertFunction(LEAP_SLOW_PATH_SYMBOL, intTy, intTy, intTy, (Type*) 0));
+
+    // int __leap_fast_preaccess(int svId, int debug), returns whether the lock is held
+    F_fast_preaccess = cast<Function>(m->getOrInsertFunction("__leap_fast_preaccess", intTy, intTy, intTy, (Type*) 0));
+    F_fast_preaccess->setLinkage(GlobalValue::InternalLinkage);
+    F_fast_preaccess->addFnAttr(Attribute::AlwaysInline);
+    {
+        Function::arg_iterator ait = F_fast_preaccess->arg_begin();
+        Value* svId = ait++;
+        Value* debug = ait;
+
+        BasicBlock* entry = BasicBlock::Create(context, "entry", F_fast_preaccess);
+        BasicBlock* notRecording = BasicBlock::Create(context, "not_recording", F_fast_preaccess);
+        BasicBlock* knownThread = BasicBlock::Create(context, "known_thread", F_fast_preaccess);
+        BasicBlock* locked = BasicBlock::Create(context, "locked", F_fast_preaccess);
+        BasicBlock* checkLast = BasicBlock::Create(context, "check_last", F_fast_preaccess);
+        BasicBlock* bump = BasicBlock::Create(context, "bump", F_fast_preaccess);
+        BasicBlock* checkRoom = BasicBlock::Create(context, "check_room", F_fast_preaccess);
+        BasicBlock* append = BasicBlock::Create(context, "append", F_fast_preaccess);
+        BasicBlock* full = BasicBlock::Create(context, "full", F_fast_preaccess);
+        BasicBlock* slow = BasicBlock::Create(context, "slow", F_fast_preaccess);
+
+        IRBuilder<> builder(entry);
+        // the version is not used, it only makes a mismatched recorder fail to link
+        builder.CreateLoad(version, true);
+        LoadInst* isRecording = builder.CreateLoad(recording);
+        isRecording->setAtomic(Monotonic);
+        isRecording->setAlignment(4);
+        builder.CreateCondBr(builder.CreateICmpEQ(isRecording, zero), notRecording, knownThread);
+
+        builder.SetInsertPoint(notRecording);
+        builder.CreateRet(zero);
+
+        builder.SetInsertPoint(knownThread);
+        Value* tid = builder.CreateLoad(tidVar);
+        Value* var = createLeapVarGEP(builder, vars, svId);
+        Value* lockWord = builder.CreateStructGEP(var, LEAP_VAR_LOCK);
+        BasicBlock* tryLock = BasicBlock::Create(context, "try_lock", F_fast_preaccess, locked);
+        builder.CreateCondBr(builder.CreateICmpEQ(tid, zero), slow, tryLock);
+
+        builder.SetInsertPoint(tryLock);
+        Value* cas = builder.CreateAtomicCmpXchg(lockWord, zero, one, Acquire, Monotonic);
+        builder.CreateCondBr(builder.CreateExtractValue(cas, 1), locked, slow);
+
+        // the same as store() in the recorder
+        builder.SetInsertPoint(locked);
+        Value* idxPtr = builder.CreateStructGEP(var, LEAP_VAR_IDX);
+        Value* idx = builder.CreateLoad(idxPtr);
+        Value* log = builder.CreateLoad(builder.CreateStructGEP(var, LEAP_VAR_LOG));
+        builder.CreateCondBr(builder.CreateICmpEQ(idx, zero), checkRoom, checkLast);
+
+        builder.SetInsertPoint(checkLast);
+        Value* lastTid = builder.CreateLoad(builder.CreateGEP(log, builder.CreateSub(idx, two)));
+        builder.CreateCondBr(builder.CreateICmpEQ(lastTid, tid), bump, checkRoom);
+
+        builder.SetInsertPoint(bump);
+        Value* countPtr = builder.CreateGEP(log, builder.CreateSub(idx, one));
+        builder.CreateStore(builder.CreateAdd(builder.CreateLoad(countPtr), one), countPtr);
+        builder.CreateRet(one);
+
+        builder.SetInsertPoint(checkRoom);
+        Value* capacity = builder.CreateLoad(builder.CreateStructGEP(var, LEAP_VAR_CAPACITY));
+        Value* next = builder.CreateAdd(idx, two);
+        builder.CreateCondBr(builder.CreateICmpULE(next, capacity), append, full);
+
+        builder.SetInsertPoint(append);
+        builder.CreateStore(tid, builder.CreateGEP(log, idx));
+        builder.CreateStore(one, builder.CreateGEP(log, builder.CreateAdd(idx, one)));
+        builder.CreateStore(next, idxPtr);
+        builder.CreateRet(one);
+
+        // the recorder deals with a full log
+        builder.SetInsertPoint(full);
+        StoreInst* release = builder.CreateStore(zero, lockWord);
+        release->setAtomic(Release);
+        release->setAlignment(4);
+        builder.CreateBr(slow);
+
+        builder.SetInsertPoint(slow);
+        builder.CreateRet(builder.CreateCall2(F_slow_preaccess, svId, debug));
+    }
+
+    // void __leap_fast_postaccess(int svId, int held)
+    F_fast_postaccess = cast<Function>(m->getOrInsertFunction("__leap_fast_postaccess", Type::getVoidTy(context), intTy, intTy, (Type*) 0));
+    F_fast_postaccess->setLinkage(GlobalValue::InternalLinkage);
+    F_fast_postaccess->addFnAttr(Attribute::AlwaysInline);
+    {
+        Function::arg_iterator ait = F_fast_postaccess->arg_begin();
+        Value* svId = ait++;
+        Value* held = ait;
+
+        BasicBlock* entry = BasicBlock::Create(context, "entry", F_fast_postaccess);
+        BasicBlock* unlock = BasicBlock::Create(context, "unlock", F_fast_postaccess);
+        BasicBlock* exit = BasicBlock::Create(context, "exit", F_fast_postaccess);
+
+        IRBuilder<> builder(entry);
+        builder.CreateCondBr(builder.CreateICmpEQ(held, zero), exit, unlock);
+
+        builder.SetInsertPoint(unlock);
+        Value* lockWord = builder.CreateStructGEP(createLeapVarGEP(builder, vars, svId), LEAP_VAR_LOCK);
+        StoreInst* release = builder.CreateStore(zero, lockWord);
+        release->setAtomic(Release);
+        release->setAlignment(4);
+        builder.CreateBr(exit);
+
+        builder.SetInsertPoint(exit);
+        builder.CreateRetVoid();
+    }
+}
+
 int Transformer4Leap::getValueIndex(Module* module, Value* v, AliasAnalysis & AA) {
     v = v->stripPointerCastsNoFollowAliases();
     while (isa<GlobalAlias>(v)) {
@@ -329,22 +859,114 @@ int Transformer4Leap::getValueIndex(Module* module, Value* v, AliasAnalysis & AA
         return -1;
     }
 
-    for (unsigned i = 0; i < sharedVariables.size(); i++) {
-        const set<Value*> * aliasSet = sharedVariables[i];
-        if (aliasSet->count(v)) {
-            return i;
-        }
+    auto it = sharedVariableIndex.find(v);
+    if (it != sharedVariableIndex.end()) {
+        return it->second;
     }
 
     return -1;
 }
 
+unsigned long long Transformer4Leap::hashDecisions(Module* module, Function* f, AliasAnalysis& AA) {
+    // FNV-1a, as LeapIds hashes functions
+    unsigned long long hash = 14695981039346656037ULL;
+    auto mix = [&hash](unsigned long long value) {
+        for (unsigned i = 0; i < 8; i++) {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    auto mixName = [&mix](StringRef name) {
+        for (unsigned i = 0; i < name.size(); i++) {
+            mix((unsigned char) name[i]);
+        }
+        mix(0);
+    };
+
+    mix(InlineFastPath);
+    mix(RegionCoarseningMode ? MaxRegionSize * 1000 + MaxRegionVars : 0);
+    mix(profile != NULL);
+    mix(F_create != NULL);
+
+    DyckCallGraph* callGraph = ((DyckAliasAnalysis*) & AA)->getCallGraph();
+    for (Function::iterator bit = f->begin(); bit != f->end(); bit++) {
+        for (BasicBlock::iterator iit = bit->begin(); iit != bit->end(); iit++) {
+            Instruction* inst = iit;
+            mix(phases != NULL && phases->isSingleThreaded(inst));
+            mix(elision != NULL && elision->isRedundant(inst));
+
+            RegionCoarsening::Region* r = regions != NULL ? regions->getRegion(inst) : NULL;
+            mix(r == NULL ? 0 : 1 + (r->first == inst) + 2 * (r->last == inst));
+
+            for (unsigned i = 0; i < inst->getNumOperands(); i++) {
+                if (!inst->getOperand(i)->getType()->isPointerTy()) continue;
+                int svIdx = this->getValueIndex(module, inst->getOperand(i), AA);
+                if (svIdx == -1) continue;
+                mix(phases != NULL && phases->isReadOnlyShared(svIdx));
+                mix(locksets != NULL && locksets->isProtected(svIdx));
+                mix(profile != NULL && profile->isSingleOwner(svIdx));
+            }
+
+            // the callees decide which calls are instrumented and how; the
+            // names of pointer calls are sorted, to not depend on addresses
+            CallInst* call = dyn_cast<CallInst>(inst);
+            set<Function*> callees;
+            if (call == NULL || !getCallees(call, callGraph, callees)) continue;
+            set<string> names;
+            for (auto cit = callees.begin(); cit != callees.end(); cit++) {
+                names.insert(((*cit)->isDeclaration() ? "declared " : "defined ") + (*cit)->getName().str());
+                if ((*cit)->getName() == "exit") {
+                    mix(sharedVariables.size());
+                }
+            }
+            for (auto nit = names.begin(); nit != names.end(); nit++) {
+                mixName(*nit);
+            }
+        }
+    }
+    return hash;
+}
+
 bool Transformer4Leap::runOnModule(Module& M) {
     DyckAliasAnalysis & AA = this->getAnalysis<DyckAliasAnalysis>();
 
     Function* PThreadCreate = M.getFunction("pthread_create");
     if (PThreadCreate != NULL) {
         AA.getEscapedPointersTo(&sharedVariables, PThreadCreate);
+        indexSharedVariables(&M, sharedVariables, sharedVariableIndex);
+
+        if (!IdFile.empty()) {
+            std::string error;
+            ids = new LeapIds(CompactIds);
+            if (!ids->load(IdFile, error)) {
+                errs() << "[Canary] Invalid -leap-ids: " << error << "\n";
+                exit(1);
+            }
+            ids->assignSharedVariables(&M, sharedVariables, sharedVariableIndex);
+
+            // compacting changes the ids in the bodies, and the -leap-profile
+            // report needs every site
+            if (!CompactIds && ProfileFile.empty()) {
+                bodies = new LeapBodyCache;
+                bodies->load(IdFile + ".bc", M.getContext());
+            }
+        }
+
+        if (ThreadPhases) {
+            phases = new ThreadPhaseAnalysis([this, &M, &AA](Value * v) {
+                return this->getValueIndex(&M, v, AA);
+            }, &AA);
+            phases->analyze(&M);
+        }
+
+        if (LocksetElision) {
+            locksets = new LocksetAnalysis([this, &M, &AA](Value * v) {
+                return this->getValueIndex(&M, v, AA);
+            }, [this](Instruction * inst) {
+                return phases != NULL && phases->isSingleThreaded(inst);
+            }, sharedVariables, &AA);
+            locksets->analyze(&M);
+        }
     }
 
     this->transform(&M, &AA);
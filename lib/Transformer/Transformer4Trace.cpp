@@ -11,6 +11,7 @@
 #define FUNCTION_MEM_LN_ARG_TYPE Type::getVoidTy(context),Type::getIntNPtrTy(context,POINTER_BIT_SIZE),Type::getIntNTy(context,POINTER_BIT_SIZE),Type::getInt8PtrTy(context,0),(Type*)0
 #define FUNCTION_TID_LN_ARG_TYPE Type::getVoidTy(context),Type::getIntNTy(context,POINTER_BIT_SIZE),Type::getIntNTy(context,POINTER_BIT_SIZE),Type::getInt8PtrTy(context,0),(Type*)0
 #define FUNCTION_2MEM_LN_ARG_TYPE Type::getVoidTy(context),Type::getIntNPtrTy(context,POINTER_BIT_SIZE),Type::getIntNPtrTy(context,POINTER_BIT_SIZE),Type::getIntNTy(context,POINTER_BIT_SIZE),Type::getInt8PtrTy(context,0),(Type*)0
+#define FUNCTION_RANGE_LN_ARG_TYPE Type::getVoidTy(context),Type::getIntNPtrTy(context,POINTER_BIT_SIZE),Type::getIntNPtrTy(context,POINTER_BIT_SIZE),Type::getIntNTy(context,POINTER_BIT_SIZE),Type::getIntNTy(context,POINTER_BIT_SIZE),Type::getInt8PtrTy(context,0),(Type*)0
 
 char Transformer4Trace::ID = 0;
 
@@ -59,6 +60,9 @@ void Transformer4Trace::beforeTransform(Module* module, AliasAnalysis& AA) {
 
     F_prewait = cast<Function>(m->getOrInsertFunction("OnPreWait", FUNCTION_2MEM_LN_ARG_TYPE));
     F_wait = cast<Function>(m->getOrInsertFunction("OnWait", FUNCTION_2MEM_LN_ARG_TYPE));
+
+    F_prememaccess = cast<Function>(m->getOrInsertFunction("OnPreMemAccess", FUNCTION_RANGE_LN_ARG_TYPE));
+    F_memaccess = cast<Function>(m->getOrInsertFunction("OnMemAccess", FUNCTION_RANGE_LN_ARG_TYPE));
     
     if (debug()) {
         errs() << "Start Preprocessing...\n";
@@ -227,62 +231,46 @@ void Transformer4Trace::transformSystemExit(Module* module, CallInst* ins, Alias
 }
 
 void Transformer4Trace::transformMemCpyMov(Module* module, CallInst* call, AliasAnalysis& AA) {
-    Value* lnval = getOtInsertLineNumberValue(module, call);
-
     Value * dst = call->getArgOperand(0);
     Value * src = call->getArgOperand(1);
     int svIdx_dst = this->getValueIndex(module, dst, AA);
     int svIdx_src = this->getValueIndex(module, src, AA);
-    if (svIdx_dst == -1 && svIdx_src == -1) {
-        return;
-    } else if (svIdx_dst != -1 && svIdx_src != -1) {
-        CastInst* d = CastInst::CreatePointerCast(dst, Type::getIntNPtrTy(module->getContext(),POINTER_BIT_SIZE));
-        d->insertBefore(call);
-
-        CastInst* s = CastInst::CreatePointerCast(src, Type::getIntNPtrTy(module->getContext(),POINTER_BIT_SIZE));
-        s->insertBefore(call);
-
-        if (svIdx_dst != svIdx_src) {
-
-
-            insertCallInstBefore(call, F_prestore, d, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-            insertCallInstAfter(call, F_store, d, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
+    if (svIdx_dst == -1 && svIdx_src == -1) return;
 
-            insertCallInstBefore(call, F_preload, s, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-            insertCallInstAfter(call, F_load, s, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-
-        } else {
-            insertCallInstBefore(call, F_prestore, d, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-            insertCallInstAfter(call, F_store, d, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-        }
-
-    } else if (svIdx_dst != -1) {
-        CastInst* d = CastInst::CreatePointerCast(dst, Type::getIntNPtrTy(module->getContext(),POINTER_BIT_SIZE));
-        d->insertBefore(call);
-
-        insertCallInstBefore(call, F_prestore, d, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-        insertCallInstAfter(call, F_store, d, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-    } else {
-        CastInst* s = CastInst::CreatePointerCast(src, Type::getIntNPtrTy(module->getContext(),POINTER_BIT_SIZE));
-        s->insertBefore(call);
-
-        insertCallInstBefore(call, F_preload, s, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-        insertCallInstAfter(call, F_load, s, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-    }
+    this->transformMemAccess(module, call, svIdx_dst == -1 ? NULL : dst, svIdx_src == -1 ? NULL : src);
 }
 
 void Transformer4Trace::transformMemSet(Module* module, CallInst* call, AliasAnalysis& AA) {
-    Value* lnval = getOtInsertLineNumberValue(module, call);
-
     Value * val = call->getArgOperand(0);
     int svIdx = this->getValueIndex(module, val, AA);
     if (svIdx == -1) return;
 
-    CastInst* c = CastInst::CreatePointerCast(val, Type::getIntNPtrTy(module->getContext(),POINTER_BIT_SIZE));
-    c->insertBefore(call);
+    this->transformMemAccess(module, call, val, NULL);
+}
+
+void Transformer4Trace::transformMemAccess(Module* module, CallInst* call, Value* dst, Value* src) {
+    Value* lnval = getOtInsertLineNumberValue(module, call);
+    PointerType* memTy = Type::getIntNPtrTy(module->getContext(), POINTER_BIT_SIZE);
 
-    insertCallInstBefore(call, F_prestore, c, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
-    insertCallInstAfter(call, F_store, c, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
+    Value* d = ConstantPointerNull::get(memTy);
+    if (dst != NULL) {
+        CastInst* c = CastInst::CreatePointerCast(dst, memTy);
+        c->insertBefore(call);
+        d = c;
+    }
+
+    Value* s = ConstantPointerNull::get(memTy);
+    if (src != NULL) {
+        CastInst* c = CastInst::CreatePointerCast(src, memTy);
+        c->insertBefore(call);
+        s = c;
+    }
+
+    CastInst* size = CastInst::CreateIntegerCast(call->getArgOperand(2), Type::getIntNTy(module->getContext(), POINTER_BIT_SIZE), false);
+    size->insertBefore(call);
+
+    insertCallInstBefore(call, F_prememaccess, d, s, size, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
+    insertCallInstAfter(call, F_memaccess, d, s, size, lnval, getOrInsertSrcFileNameValue(module, call), NULL);
 }
 
 void Transformer4Trace::transformOtherFunctionCalls(Module* module, CallInst* call, AliasAnalysis& AA) {
@@ -328,7 +316,8 @@ bool Transformer4Trace::isInstrumentationFunction(Module* module, Function* call
             || called == F_prefork || called == F_fork
             || called == F_prejoin || called == F_join
             || called == F_prenotify || called == F_notify
-            || called == F_prewait || called == F_wait;
+            || called == F_prewait || called == F_wait
+            || called == F_prememaccess || called == F_memaccess;
 }
 
 // private functions
@@ -347,11 +336,9 @@ int Transformer4Trace::getValueIndex(Module* module, Value* v, AliasAnalysis & A
         return -1;
     }
     
-    for(unsigned i = 0; i<sharedVariables.size(); i++ ){
-        const set<Value*> * aliasSet = sharedVariables[i];
-        if(aliasSet->count(v)) {
-            return i;
-        }
+    auto it = sharedVariableIndex.find(v);
+    if(it != sharedVariableIndex.end()) {
+        return it->second;
     }
 
     return -1;
@@ -392,6 +379,7 @@ bool Transformer4Trace::runOnModule(Module& M){
     Function* PThreadCreate = M.getFunction("pthread_create");
     if (PThreadCreate != NULL) {
         AA.getEscapedPointersTo(&sharedVariables, PThreadCreate);
+        indexSharedVariables(&M, sharedVariables, sharedVariableIndex);
     }
     
     this->transform(&M, &AA);
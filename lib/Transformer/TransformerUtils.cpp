@@ -0,0 +1,37 @@
+/*
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "Transformer/TransformerUtils.h"
+#include "DyckCG/DyckCallGraph.h"
+
+bool isAddressTaken(Function* f) {
+    for (Value::user_iterator it = f->user_begin(); it != f->user_end(); it++) {
+        User* u = (User*) (*it);
+        if (!isa<CallInst>(u) || ((CallInst*) u)->getCalledValue() != f) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool getCallees(CallInst* call, DyckCallGraph* callGraph, set<Function*>& callees) {
+    Value* cv = call->getCalledValue()->stripPointerCastsNoFollowAliases();
+    if (Function* f = dyn_cast<Function>(cv)) {
+        callees.insert(f);
+        return true;
+    }
+
+    if (call->isInlineAsm() || callGraph == NULL) {
+        return call->isInlineAsm();
+    }
+
+    Call* c = callGraph->getOrInsertFunction(call->getParent()->getParent())->getCall(call);
+    if (c == NULL || !isa<PointerCall>(c)) {
+        return false;
+    }
+    set<Function*>& mayAliased = ((PointerCall*) c)->mayAliasedCallees;
+    callees.insert(mayAliased.begin(), mayAliased.end());
+    return true;
+}
@@ -0,0 +1,270 @@
+/*
+ * Round trips of the compact replay log (LeapSupport/CompactLog.h): the
+ * varints, the gap encoding of local logs, the LZ77 compressor and the
+ * blocks of log.replay.dat, on edge cases and random inputs, and the
+ * rejection of truncated and corrupted payloads.
+ *
+ * Developed by Qingkai Shi
+ * Copy Right by Prism Research Group, HKUST and State Key Lab for Novel Software Tech., Nanjing University.
+ */
+
+#include "LeapSupport/CompactLog.h"
+
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond, what) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, what); \
+        failures++; \
+    } \
+} while (0)
+
+// xorshift, so that the random inputs are the same in every run
+static unsigned seed = 2463534242u;
+
+static unsigned nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static void testVarints() {
+    const unsigned values[] = {0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0x1fffff, 0x200000, 0xfffffff, 0x10000000, 0xffffffffu};
+    for (unsigned i = 0; i < sizeof (values) / sizeof (values[0]); i++) {
+        unsigned char buffer[5];
+        unsigned char* end = putVarint(buffer, values[i]);
+        CHECK(end - buffer <= 5, "a varint takes at most 5 bytes");
+
+        unsigned value = 0;
+        const unsigned char* next = getVarint(buffer, end, &value);
+        CHECK(next == end && value == values[i], "a varint round trips");
+
+        // every byte but the last has the continuation bit
+        CHECK(end - buffer == 1 || getVarint(buffer, end - 1, &value) == NULL, "a truncated varint is rejected");
+    }
+
+    unsigned value = 0;
+    const unsigned char endless[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+    CHECK(getVarint(endless, endless + sizeof (endless), &value) == NULL, "a varint longer than 5 bytes is rejected");
+    CHECK(getVarint(endless, endless, &value) == NULL, "an empty varint is rejected");
+}
+
+/// encodes and decodes count entries of a log of the given kind
+static bool roundTripEntries(const std::vector<unsigned>& entries, unsigned kind) {
+    std::vector<unsigned char> raw(5 * entries.size() + 1);
+    unsigned len = encodeEntries(entries.data(), entries.size(), kind, raw.data());
+    if (len > 5 * entries.size()) {
+        return false;
+    }
+
+    std::vector<unsigned> decoded(entries.size() + 1);
+    if (!decodeEntries(raw.data(), len, kind, decoded.data(), entries.size())) {
+        return false;
+    }
+    for (unsigned i = 0; i < entries.size(); i++) {
+        if (decoded[i] != entries[i]) return false;
+    }
+
+    // one byte short or one entry too many
+    if (len > 0 && decodeEntries(raw.data(), len - 1, kind, decoded.data(), entries.size())) {
+        return false;
+    }
+    return !decodeEntries(raw.data(), len, kind, decoded.data(), entries.size() + 2);
+}
+
+static void testEntries() {
+    std::vector<unsigned> empty;
+    CHECK(roundTripEntries(empty, LEAP_LOG_GLOBAL), "an empty global log round trips");
+    CHECK(roundTripEntries(empty, LEAP_LOG_LOCAL), "an empty local log round trips");
+
+    // the largest values: a thread id and run, and a local run ending at 2^32 - 1
+    unsigned global[] = {0xffffffffu, 0xffffffffu, 1, 1};
+    CHECK(roundTripEntries(std::vector<unsigned>(global, global + 4), LEAP_LOG_GLOBAL), "the largest global entries round trip");
+    unsigned local[] = {0, 1, 1, 0xfffffffeu};
+    CHECK(roundTripEntries(std::vector<unsigned>(local, local + 4), LEAP_LOG_LOCAL), "the largest local entries round trip");
+
+    for (unsigned round = 0; round < 100; round++) {
+        std::vector<unsigned> g, l;
+        unsigned pairs = nextRandom() % 2000;
+        unsigned index = nextRandom() % 16;
+        for (unsigned i = 0; i < pairs; i++) {
+            g.push_back(1 + nextRandom() % 64);
+            g.push_back(1 + (nextRandom() % 4 == 0 ? nextRandom() : nextRandom() % 300));
+
+            // ascending indices, adjacent or with a gap
+            unsigned run = 1 + nextRandom() % 100;
+            l.push_back(index);
+            l.push_back(run);
+            index += run + (nextRandom() % 2 == 0 ? 0 : nextRandom() % 100000);
+        }
+        CHECK(roundTripEntries(g, LEAP_LOG_GLOBAL), "random global entries round trip");
+        CHECK(roundTripEntries(l, LEAP_LOG_LOCAL), "random local entries round trip");
+    }
+}
+
+/// returns 0 if the input round trips, and its compressed length otherwise
+/// stored in *stored; -1 on a failure
+static int roundTripCompressed(const std::vector<unsigned char>& in, unsigned* stored) {
+    std::vector<unsigned char> packed(in.size() + 1);
+    unsigned len = compressBlock(in.data(), in.size(), packed.data());
+    *stored = len;
+    if (len == 0) {
+        // stored as it is
+        return 0;
+    }
+    if (len >= in.size()) {
+        return -1;
+    }
+
+    std::vector<unsigned char> out(in.size() + 1);
+    if (!decompressBlock(packed.data(), len, out.data(), in.size())) {
+        return -1;
+    }
+    if (memcmp(out.data(), in.data(), in.size()) != 0) {
+        return -1;
+    }
+
+    // a wrong length or a truncated stream is rejected
+    if (decompressBlock(packed.data(), len, out.data(), in.size() - 1)) {
+        return -1;
+    }
+    if (decompressBlock(packed.data(), len - 1, out.data(), in.size())) {
+        return -1;
+    }
+    return 0;
+}
+
+static void testCompression() {
+    unsigned stored = 0;
+    std::vector<unsigned char> empty;
+    CHECK(roundTripCompressed(empty, &stored) == 0 && stored == 0, "an empty block is not compressed");
+
+    std::vector<unsigned char> tiny(2 * LEAP_LZ_MIN_MATCH - 1, 'a');
+    CHECK(roundTripCompressed(tiny, &stored) == 0 && stored == 0, "a tiny block is not compressed");
+
+    // matches longer than LEAP_LZ_MAX_MATCH, overlapping their source
+    std::vector<unsigned char> same(100000, 0x5a);
+    CHECK(roundTripCompressed(same, &stored) == 0 && stored > 0 && stored < same.size() / 40, "a long run compresses");
+
+    std::vector<unsigned char> repeated;
+    for (unsigned i = 0; i < 50000; i++) {
+        repeated.push_back("leap-replay"[i % 11]);
+    }
+    CHECK(roundTripCompressed(repeated, &stored) == 0 && stored > 0, "a repeated pattern compresses");
+
+    // more literals than a token holds between matches
+    std::vector<unsigned char> literals;
+    for (unsigned i = 0; i < 3 * LEAP_LZ_MAX_LITERALS; i++) {
+        literals.push_back(nextRandom());
+    }
+    literals.insert(literals.end(), literals.begin(), literals.end());
+    CHECK(roundTripCompressed(literals, &stored) == 0 && stored > 0, "long literals before a match round trip");
+
+    std::vector<unsigned char> noise;
+    for (unsigned i = 0; i < 4096; i++) {
+        noise.push_back(nextRandom());
+    }
+    CHECK(roundTripCompressed(noise, &stored) == 0 && stored == 0, "random bytes are stored as they are");
+
+    for (unsigned round = 0; round < 200; round++) {
+        // few symbols, so that there are matches of all lengths and offsets
+        std::vector<unsigned char> in;
+        unsigned len = nextRandom() % 20000;
+        unsigned symbols = 2 + nextRandom() % 8;
+        for (unsigned i = 0; i < len; i++) {
+            in.push_back(nextRandom() % symbols);
+        }
+        CHECK(roundTripCompressed(in, &stored) == 0, "random blocks round trip");
+    }
+
+    unsigned char out[16];
+    const unsigned char before[] = {0x80, 0x01}; // a match before the start
+    CHECK(!decompressBlock(before, sizeof (before), out, 4), "a match before the start is rejected");
+    const unsigned char zero[] = {0x00, 'a', 0x80, 0x00}; // offset 0
+    CHECK(!decompressBlock(zero, sizeof (zero), out, 5), "a match at offset 0 is rejected");
+    const unsigned char over[] = {0x03, 'a', 'b', 'c', 'd', 0xff, 0x04}; // past the end of out
+    CHECK(!decompressBlock(over, sizeof (over), out, 16), "a match past the end is rejected");
+    const unsigned char cut[] = {0x05, 'a', 'b'}; // fewer literals than the token says
+    CHECK(!decompressBlock(cut, sizeof (cut), out, 6), "truncated literals are rejected");
+}
+
+/// writes the entries as a block of log.replay.dat and reads it back
+static bool roundTripBlock(const std::vector<unsigned>& entries, unsigned kind) {
+    FILE* f = tmpfile();
+    if (f == NULL) {
+        return false;
+    }
+    writeLeapLogHeader(f, kind, 7, 3);
+    writeLeapLogBlock(f, kind, 5, kind == LEAP_LOG_LOCAL ? 2 : 0, entries.data(), entries.size());
+    rewind(f);
+
+    LeapLogHeader header;
+    LeapLogBlock block;
+    unsigned* decoded = NULL;
+    bool ok = fread(&header, sizeof (LeapLogHeader), 1, f) == 1 && header.version == LEAP_LOG_VERSION
+            && header.kind == kind && header.numSharedVars == 7 && header.numThreads == 3
+            && readLeapLogBlock(f, kind, &block, &decoded)
+            && block.svId == 5 && block.count == entries.size();
+    for (unsigned i = 0; ok && i < entries.size(); i++) {
+        ok = decoded[i] == entries[i];
+    }
+    free(decoded);
+
+    // the end of the file
+    unsigned* none = NULL;
+    ok = ok && !readLeapLogBlock(f, kind, &block, &none);
+    fclose(f);
+    return ok;
+}
+
+static void testBlocks() {
+    std::vector<unsigned> empty;
+    CHECK(roundTripBlock(empty, LEAP_LOG_GLOBAL), "an empty block round trips");
+
+    std::vector<unsigned> global, local;
+    for (unsigned i = 0; i < 100000; i++) {
+        global.push_back(1 + i % 4);
+        global.push_back(1 + nextRandom() % 3);
+        local.push_back(10 * i);
+        local.push_back(1 + nextRandom() % 3);
+    }
+    CHECK(roundTripBlock(global, LEAP_LOG_GLOBAL), "a compressed global block round trips");
+    CHECK(roundTripBlock(local, LEAP_LOG_LOCAL), "a compressed local block round trips");
+
+    // a truncated block is the end of the log, as if the recorder was killed
+    FILE* f = tmpfile();
+    writeLeapLogBlock(f, LEAP_LOG_GLOBAL, 0, 0, global.data(), global.size());
+    fflush(f);
+    long len = ftell(f);
+    CHECK(ftruncate(fileno(f), len - 1) == 0, "the log is truncated");
+    rewind(f);
+    LeapLogBlock block;
+    unsigned* entries = NULL;
+    CHECK(!readLeapLogBlock(f, LEAP_LOG_GLOBAL, &block, &entries), "a truncated block is not read");
+    fclose(f);
+
+    LeapLogBlock bad = {0, 0, 3, 1, 1}; // an odd number of entries
+    CHECK(!checkLeapLogBlock(&bad), "a block of an odd number of entries is rejected");
+    LeapLogBlock big = {0, 0, 2, 11, 11}; // more bytes than 2 varints take
+    CHECK(!checkLeapLogBlock(&big), "a block longer than its entries is rejected");
+    LeapLogBlock grown = {0, 0, 2, 4, 5}; // compressed to more bytes
+    CHECK(!checkLeapLogBlock(&grown), "a block stored in more bytes than its raw length is rejected");
+}
+
+int main() {
+    testVarints();
+    testEntries();
+    testCompression();
+    testBlocks();
+
+    if (failures > 0) {
+        printf("%d checks failed.\n", failures);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,38 @@
+; -dyckaa-lib-spec=inputs/Test_2026_10_19_16_11_00.spec
+; expect-failure
+; ModuleID = 'test.bc'
+target datalayout = "e-m:e-p:32:32-f64:32:64-f80:32-n8:16:32-S128"
+target triple = "i386-pc-linux-gnu"
+
+@buffer = common global i8* null, align 4
+
+; Function Attrs: nounwind
+define i32 @main() #0 {
+entry:
+  %retval = alloca i32, align 4
+  %p = alloca i8*, align 4
+  %q = alloca i8*, align 4
+  store i32 0, i32* %retval
+  %call = call i8* @malloc(i32 16) #1
+  store i8* %call, i8** %p, align 4
+  %0 = load i8** %p, align 4
+  %call1 = call i8* @my_dup(i8* %0) #1
+  store i8* %call1, i8** %q, align 4
+  %1 = load i8** %q, align 4
+  %2 = load i8** %p, align 4
+  %call2 = call i8* @my_copy(i8* %1, i8* %2) #1
+  store i8* %call2, i8** @buffer, align 4
+  ret i32 0
+}
+
+; Function Attrs: nounwind
+declare i8* @malloc(i32) #0
+
+; Function Attrs: nounwind
+declare i8* @my_dup(i8*) #0
+
+; Function Attrs: nounwind
+declare i8* @my_copy(i8*, i8*) #0
+
+attributes #0 = { nounwind "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "stack-protector-buffer-size"="8" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #1 = { nounwind }
@@ -0,0 +1,31 @@
+; -dyckaa-field-policy=struct.node:fields=two
+; expect-failure
+; ModuleID = 'test.bc'
+target datalayout = "e-m:e-p:32:32-f64:32:64-f80:32-n8:16:32-S128"
+target triple = "i386-pc-linux-gnu"
+
+%struct.node = type { i32, %struct.node*, i8* }
+%struct.pair = type { i8*, i8* }
+
+; Function Attrs: nounwind
+define i32 @main() #0 {
+entry:
+  %retval = alloca i32, align 4
+  %n = alloca %struct.node, align 4
+  %q = alloca %struct.pair, align 4
+  store i32 0, i32* %retval
+  %next = getelementptr inbounds %struct.node* %n, i32 0, i32 1
+  store %struct.node* %n, %struct.node** %next, align 4
+  %first = getelementptr inbounds %struct.pair* %q, i32 0, i32 0
+  %0 = load i8** %first, align 4
+  %data = getelementptr inbounds %struct.node* %n, i32 0, i32 2
+  store i8* %0, i8** %data, align 4
+  %1 = load %struct.node** %next, align 4
+  %second = getelementptr inbounds %struct.pair* %q, i32 0, i32 1
+  %2 = bitcast %struct.node* %1 to i8*
+  store i8* %2, i8** %second, align 4
+  ret i32 0
+}
+
+attributes #0 = { nounwind "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "stack-protector-buffer-size"="8" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #1 = { nounwind }
@@ -0,0 +1,28 @@
+; -leap-transformer -leap-profile=inputs/Test_2026_10_19_16_14_00.profile -leap-profile-report=.test/leap.profile.report
+; ModuleID = 'test.bc'
+target datalayout = "e-m:e-p:32:32-f64:32:64-f80:32-n8:16:32-S128"
+target triple = "i386-pc-linux-gnu"
+
+@counter = global i32 0, align 4
+
+; Function Attrs: nounwind
+define void @increase() #0 {
+entry:
+  %0 = load i32* @counter, align 4
+  %inc = add nsw i32 %0, 1
+  store i32 %inc, i32* @counter, align 4
+  ret void
+}
+
+; Function Attrs: nounwind
+define i32 @main() #0 {
+entry:
+  %retval = alloca i32, align 4
+  store i32 0, i32* %retval
+  call void @increase()
+  %0 = load i32* @counter, align 4
+  ret i32 %0
+}
+
+attributes #0 = { nounwind "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "stack-protector-buffer-size"="8" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #1 = { nounwind }
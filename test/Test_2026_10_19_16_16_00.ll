@@ -0,0 +1,38 @@
+; -leap-transformer -leap-ids=.test/leap.ids
+; ModuleID = 'test.bc'
+target datalayout = "e-m:e-p:32:32-f64:32:64-f80:32-n8:16:32-S128"
+target triple = "i386-pc-linux-gnu"
+
+%union.pthread_attr_t = type { i32, [32 x i8] }
+
+@counter = global i32 0, align 4
+
+; Function Attrs: nounwind
+define i8* @worker(i8* %args) #0 {
+entry:
+  %args.addr = alloca i8*, align 4
+  store i8* %args, i8** %args.addr, align 4
+  %0 = load i32* @counter, align 4
+  %inc = add nsw i32 %0, 1
+  store i32 %inc, i32* @counter, align 4
+  ret i8* null
+}
+
+; Function Attrs: nounwind
+define i32 @main() #0 {
+entry:
+  %retval = alloca i32, align 4
+  %tid = alloca i32, align 4
+  store i32 0, i32* %retval
+  %call = call i32 @pthread_create(i32* %tid, %union.pthread_attr_t* null, i8* (i8*)* @worker, i8* null) #1
+  %0 = load i32* @counter, align 4
+  %dec = sub nsw i32 %0, 1
+  store i32 %dec, i32* @counter, align 4
+  ret i32 0
+}
+
+; Function Attrs: nounwind
+declare i32 @pthread_create(i32*, %union.pthread_attr_t*, i8* (i8*)*, i8*) #0
+
+attributes #0 = { nounwind "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "stack-protector-buffer-size"="8" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #1 = { nounwind }
@@ -0,0 +1,3 @@
+# the library functions of Test_2026_10_19_16_10_00.ll
+my_dup      1  content-alias(arg0, ret)
+my_copy     2  content-alias(arg0, arg1) alias(ret, arg0)
@@ -0,0 +1,3 @@
+# my_dup has one argument, so arg1 is out of range
+my_dup      1  content-alias(arg1, ret)
+my_copy     2  content-alias(arg0, arg1) alias(ret, arg0)
@@ -0,0 +1 @@
+leap-profile 1 0
@@ -0,0 +1,2 @@
+leap-profile 1 0
+var 0 100 3
@@ -13,10 +13,35 @@ do
     option=`head -1 $file`
     option=${option:1}
 
+    # a malformed input, e.g. a bad -dyckaa-lib-spec file, makes canary exit with 1
+    expected=0
+    if [ "`sed -n 2p $file`" == "; expect-failure" ]; then
+        expected=1
+    fi
+
     echo "Test: canary $option $outputfile"
     echo "==============================================="
     canary $option $outputfile -o $outputfile
     exitcode=$?
+    if [ $exitcode != $expected ]; then
+        echo "==============================================="
+        echo "Test Fail! Exit code: $exitcode."
+        exit -1;
+    fi
+done
+
+# drivers of the runtime support, e.g. the codec of the replay log
+for file in *.cpp
+do
+    num=$((num+1))
+
+    mkdir -p .test
+    outputfile=.test/${file%.*}
+
+    echo "Test: $outputfile"
+    echo "==============================================="
+    g++ -I../include $file -o $outputfile && $outputfile
+    exitcode=$?
     if [ $exitcode != 0 ]; then
         echo "==============================================="
         echo "Test Fail! Exit code: $exitcode."
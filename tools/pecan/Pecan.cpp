@@ -222,13 +222,22 @@ bool check(struct Event* ei, struct Event* ej) {
     return false;
 }
 
+/// a memory access covers [mem, mem + size), or only mem if size is 0
+bool overlap(struct Event* ei, struct Event* ej) {
+    if (ei->mem == ej->mem) return true;
+    if (ei->size == 0 && ej->size == 0) return false;
+    long ei_end = ei->mem + (ei->size ? ei->size : 1);
+    long ej_end = ej->mem + (ej->size ? ej->size : 1);
+    return ei->mem < ej_end && ej->mem < ei_end;
+}
+
 bool checkDR(struct Event* ei, struct Event* ej) {
     if (hbgraph->is_reachable(ei->eid, ej->eid)
             || hbgraph->is_reachable(ej->eid, ei->eid)) {
         return false;
     }
 
-    if (ei->tid != ej->tid && ei->mem == ej->mem && (ei->type == WRITE || ej->type == WRITE)) {
+    if (ei->tid != ej->tid && overlap(ei, ej) && (ei->type == WRITE || ej->type == WRITE)) {
         return true;
     }
     return false;